@@ -0,0 +1,395 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "AggregateUtil.h"
+
+// Number of groups of 1-based group codes, 0 or NA leaving a cell out; returns an error message, empty on success
+std::string GetNumGroups(const Rcpp::IntegerVector &group, std::size_t &n_groups) {
+    int maxCode = 0;
+    for(const int &q : group) {
+        if(q != NA_INTEGER) {
+            if(q < 0) {
+                return "Group codes must not be negative";
+            }
+            maxCode = std::max(maxCode, q);
+        }
+    }
+    if(maxCode == 0) {
+        return "No cell belongs to a group";
+    }
+    n_groups = maxCode;
+    return "";
+}
+
+// Columns [colStart, colStart + n) bucketed by group, as column indices relative to colStart
+void GroupBlockCells(const Rcpp::IntegerVector &group, const std::size_t &colStart, const std::size_t &n,
+                     const std::size_t &n_groups, std::vector<int> &cellPtr, std::vector<int> &cells) {
+    cellPtr.assign(n_groups + 1, 0);
+    for(std::size_t c = 0; c < n; c++) {
+        int q = group[colStart + c];
+        if(q != NA_INTEGER && q > 0) {
+            cellPtr[q]++;
+        }
+    }
+    for(std::size_t q = 0; q < n_groups; q++) {
+        cellPtr[q + 1] += cellPtr[q];
+    }
+    cells.resize(cellPtr[n_groups]);
+    std::vector<int> pos(cellPtr.begin(), cellPtr.end() - 1);
+    for(std::size_t c = 0; c < n; c++) {
+        int q = group[colStart + c];
+        if(q != NA_INTEGER && q > 0) {
+            cells[pos[q - 1]++] = c;
+        }
+    }
+}
+
+// Row map (-1 for rows left out) of 1-based gene indices, every row when genes is empty;
+// returns an error message, empty on success
+std::string GetRowMap(const Rcpp::IntegerVector &genes, const std::size_t &n_rows, std::vector<int> &selected,
+                      std::vector<int> &rowMap) {
+    rowMap.assign(n_rows, -1);
+    selected.clear();
+    if(genes.size() == 0) {
+        for(std::size_t r = 0; r < n_rows; r++) {
+            selected.push_back(r);
+        }
+    }
+    for(const int &gene : genes) {
+        if(gene == NA_INTEGER || gene < 1 || gene > (int)n_rows) {
+            return "Gene indices must be between 1 and the number of rows";
+        }
+        selected.push_back(gene - 1);
+    }
+    for(std::size_t g = 0; g < selected.size(); g++) {
+        if(rowMap[selected[g]] >= 0) {
+            return "Gene indices must be unique";
+        }
+        rowMap[selected[g]] = g;
+    }
+    return "";
+}
+
+// Adds the columns [colStart, colStart + n) of a CSC matrix (or block) to the group sums
+template <typename P, typename I>
+void AccumulateGroups(const P *p, const I *i, const double *x, const std::size_t &colStart, const std::size_t &n,
+                      const Rcpp::IntegerVector &group, const std::size_t &n_groups, const std::vector<int> &rowMap,
+                      const std::size_t &n_selected, const double &scaleFactor, std::vector<double> &sum, std::vector<int> &nnz) {
+    std::vector<int> cellPtr;
+    std::vector<int> cells;
+    GroupBlockCells(group, colStart, n, n_groups, cellPtr, cells);
+    com::bioturing::GroupSumWorker<P, I> sumWorker(p, i, x, rowMap, n_selected, cellPtr, cells, scaleFactor, sum.data(), nnz.data());
+    RcppParallel::parallelFor(0, n_groups, sumWorker, 1);
+}
+
+// Shape and feature names of a sparse matrix group; returns an error message, empty on success
+std::string ReadH5Shape(com::bioturing::Hdf5Util &oHdf5Util, HighFive::File *file, const std::string &groupName, const std::string &caller,
+                        std::size_t &n_rows, std::size_t &n_cols, Rcpp::CharacterVector &features) {
+    try {
+        std::vector<unsigned int> shape;
+        file->getDataSet(groupName + "/shape").read(shape);
+        n_rows = shape[0];
+        n_cols = shape[1];
+        std::string featureSlot = groupName + "/" + oHdf5Util.GetFeatureSlot(file, groupName);
+        if(file->exist(featureSlot) == true) {
+            com::bioturing::H5StringPool pool;
+            pool.Read(file->getDataSet(featureSlot));
+            features = pool.ToCharacterVector();
+        }
+    } catch(HighFive::Exception& err) {
+        return caller + " HDF5 format, error=" + err.what();
+    }
+    return "";
+}
+
+// Group sums over every column block of a sparse matrix group; returns an error message, empty on success
+std::string AccumulateGroupsH5(HighFive::File *file, const std::string &groupName, const Rcpp::IntegerVector &group,
+                               const std::size_t &n_groups, const std::vector<int> &rowMap, const std::size_t &n_selected,
+                               const double &scaleFactor, std::vector<double> &sum, std::vector<int> &nnz) {
+    try {
+        com::bioturing::H5Prefetcher prefetcher(file, groupName, 1 << 22);
+        prefetcher.Start();
+        com::bioturing::H5ColumnBlock block;
+        while(prefetcher.Next(block) == true) {
+            AccumulateGroups(block.p.data(), block.i.data(), block.x.data(), block.col_start, block.n_cols,
+                             group, n_groups, rowMap, n_selected, scaleFactor, sum, nnz);
+        }
+    } catch(std::exception &err) {
+        return err.what();
+    }
+    return "";
+}
+
+Rcpp::IntegerVector GetGroupSize(const Rcpp::IntegerVector &group, const std::size_t &n_groups) {
+    Rcpp::IntegerVector size(n_groups);
+    for(const int &q : group) {
+        if(q != NA_INTEGER && q > 0) {
+            size[q - 1]++;
+        }
+    }
+    return size;
+}
+
+// Names of the selected rows, NULL without names
+SEXP GetSelectedNames(SEXP names, const std::vector<int> &selected) {
+    if(Rf_isNull(names) == true) {
+        return R_NilValue;
+    }
+    Rcpp::CharacterVector allNames(names);
+    Rcpp::CharacterVector selectedNames(selected.size());
+    for(std::size_t g = 0; g < selected.size(); g++) {
+        selectedNames[g] = allNames[selected[g]];
+    }
+    return selectedNames;
+}
+
+// list(sum, nnz, mean, size) of the accumulated outputs, genes x groups
+Rcpp::List GetAggregateResult(const std::size_t &n_rows, const std::size_t &n_groups, const Rcpp::IntegerVector &group,
+                              const std::vector<double> &sum, const std::vector<int> &nnz, SEXP rownames) {
+    Rcpp::IntegerVector size = GetGroupSize(group, n_groups);
+    Rcpp::NumericMatrix sumMat(n_rows, n_groups);
+    Rcpp::IntegerMatrix nnzMat(n_rows, n_groups);
+    Rcpp::NumericMatrix meanMat(n_rows, n_groups);
+    for(std::size_t q = 0; q < n_groups; q++) {
+        for(std::size_t r = 0; r < n_rows; r++) {
+            std::size_t idx = q * n_rows + r;
+            sumMat[idx] = sum[idx];
+            nnzMat[idx] = nnz[idx];
+            meanMat[idx] = (size[q] > 0) ? sum[idx] / size[q] : NA_REAL;
+        }
+    }
+    Rcpp::List dimnames = Rcpp::List::create(rownames, R_NilValue);
+    sumMat.attr("dimnames") = dimnames;
+    nnzMat.attr("dimnames") = dimnames;
+    meanMat.attr("dimnames") = dimnames;
+
+    return Rcpp::List::create(
+        Rcpp::Named("sum") = sumMat,
+        Rcpp::Named("nnz") = nnzMat,
+        Rcpp::Named("mean") = meanMat,
+        Rcpp::Named("size") = size
+    );
+}
+
+// list(avg.exp, pct.exp, size) of the accumulated outputs, genes x groups
+Rcpp::List GetGroupExpressionResult(const std::size_t &n_selected, const std::size_t &n_groups, const Rcpp::IntegerVector &group,
+                                    const std::vector<double> &sum, const std::vector<int> &nnz, SEXP rownames) {
+    Rcpp::IntegerVector size = GetGroupSize(group, n_groups);
+    Rcpp::NumericMatrix avgExp(n_selected, n_groups);
+    Rcpp::NumericMatrix pctExp(n_selected, n_groups);
+    for(std::size_t q = 0; q < n_groups; q++) {
+        for(std::size_t g = 0; g < n_selected; g++) {
+            std::size_t idx = q * n_selected + g;
+            avgExp[idx] = (size[q] > 0) ? sum[idx] / size[q] : NA_REAL;
+            pctExp[idx] = (size[q] > 0) ? 100.0 * nnz[idx] / size[q] : NA_REAL;
+        }
+    }
+    Rcpp::List dimnames = Rcpp::List::create(rownames, R_NilValue);
+    avgExp.attr("dimnames") = dimnames;
+    pctExp.attr("dimnames") = dimnames;
+
+    return Rcpp::List::create(
+        Rcpp::Named("avg.exp") = avgExp,
+        Rcpp::Named("pct.exp") = pctExp,
+        Rcpp::Named("size") = size
+    );
+}
+
+//' AggregateSpMt
+//'
+//' Pseudobulk aggregation: sums, nonzero counts and means of every gene over the cells of
+//' each group, in one pass over the nonzero values. Groups are aggregated in parallel.
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param group An integer vector of 1-based group codes (e.g. factor codes), one per cell.
+//'        0 or NA leaves a cell out
+//' @return A list of sum, nnz and mean (genes x groups matrices) and size (cells per group)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List AggregateSpMt(const Rcpp::S4 &mat, const Rcpp::IntegerVector &group) {
+    com::bioturing::CscView input(mat);
+    std::size_t n_rows = input.n_rows;
+    if((std::size_t)group.size() != (std::size_t)input.n_cols) {
+        ::Rf_error("group must have one code per column");
+    }
+    std::size_t n_groups = 0;
+    std::string error = GetNumGroups(group, n_groups);
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+
+    std::vector<int> selected;
+    std::vector<int> rowMap;
+    GetRowMap(Rcpp::IntegerVector(0), n_rows, selected, rowMap);
+    std::vector<double> sum(n_rows * n_groups, 0);
+    std::vector<int> nnz(n_rows * n_groups, 0);
+    AccumulateGroups(input.p, input.i, input.x, 0, input.n_cols, group, n_groups, rowMap, n_rows, 0, sum, nnz);
+
+    return GetAggregateResult(n_rows, n_groups, group, sum, nnz, input.dimnames[0]);
+}
+
+//' AggregateH5
+//'
+//' Pseudobulk aggregation of a sparse matrix group, read block-wise so the matrix is never
+//' loaded in memory. Same result as AggregateSpMt
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group)
+//' @param group An integer vector of 1-based group codes, one per cell. 0 or NA leaves a cell out
+//' @return A list of sum, nnz and mean (genes x groups matrices) and size (cells per group)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List AggregateH5(const std::string &filePath, const std::string &groupName, const Rcpp::IntegerVector &group) {
+    std::size_t n_groups = 0;
+    std::string error = GetNumGroups(group, n_groups);
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::size_t n_rows = 0;
+    std::size_t n_cols = 0;
+    Rcpp::CharacterVector features;
+    error = ReadH5Shape(oHdf5Util, file, groupName, "AggregateH5", n_rows, n_cols, features);
+    if(error.empty() == true && (std::size_t)group.size() != n_cols) {
+        error = "group must have one code per column";
+    }
+    if(error.empty() == false) {
+        oHdf5Util.Close(file);
+        ::Rf_error(error.c_str());
+    }
+
+    std::vector<int> selected;
+    std::vector<int> rowMap;
+    GetRowMap(Rcpp::IntegerVector(0), n_rows, selected, rowMap);
+    std::vector<double> sum(n_rows * n_groups, 0);
+    std::vector<int> nnz(n_rows * n_groups, 0);
+    error = AccumulateGroupsH5(file, groupName, group, n_groups, rowMap, n_rows, 0, sum, nnz);
+    oHdf5Util.Close(file);
+
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    return GetAggregateResult(n_rows, n_groups, group, sum, nnz, features.size() > 0 ? (SEXP)features : R_NilValue);
+}
+
+//' GroupExpressionSpMt
+//'
+//' Average expression and percent of expressing cells of the selected genes in every group
+//' (e.g. cluster), both from one parallel pass over the nonzero values. With logScale the
+//' averages are taken on the log1p scale of library-size normalized values, computed on the
+//' fly from counts so that no log-normalized matrix is needed.
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param group An integer vector of 1-based group codes, one per cell. 0 or NA leaves a cell out
+//' @param genes 1-based row indices of the genes to use. Default uses every gene
+//' @param logScale Average log1p(x / library size * scaleFactor) instead of x. Default FALSE
+//' @param scaleFactor Total count each cell is normalized to with logScale. Default 10000
+//' @return A list of avg.exp and pct.exp (genes x groups matrices) and size (cells per group)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List GroupExpressionSpMt(const Rcpp::S4 &mat, const Rcpp::IntegerVector &group,
+                               const Rcpp::IntegerVector &genes = Rcpp::IntegerVector(0), const bool &logScale = false,
+                               const double &scaleFactor = 10000) {
+    com::bioturing::CscView input(mat);
+    if((std::size_t)group.size() != (std::size_t)input.n_cols) {
+        ::Rf_error("group must have one code per column");
+    }
+    if(logScale == true && scaleFactor <= 0) {
+        ::Rf_error("scaleFactor must be positive");
+    }
+    std::size_t n_groups = 0;
+    std::string error = GetNumGroups(group, n_groups);
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+
+    std::vector<int> selected;
+    std::vector<int> rowMap;
+    error = GetRowMap(genes, input.n_rows, selected, rowMap);
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    std::size_t n_selected = selected.size();
+    std::vector<double> sum(n_selected * n_groups, 0);
+    std::vector<int> nnz(n_selected * n_groups, 0);
+    AccumulateGroups(input.p, input.i, input.x, 0, input.n_cols, group, n_groups, rowMap, n_selected,
+                     logScale ? scaleFactor : 0, sum, nnz);
+
+    return GetGroupExpressionResult(n_selected, n_groups, group, sum, nnz, GetSelectedNames(input.dimnames[0], selected));
+}
+
+//' GroupExpressionH5
+//'
+//' Average expression and percent of expressing cells of a sparse matrix group, read
+//' block-wise so the matrix is never loaded in memory. Same result as GroupExpressionSpMt
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group)
+//' @param group An integer vector of 1-based group codes, one per cell. 0 or NA leaves a cell out
+//' @param genes 1-based row indices of the genes to use. Default uses every gene
+//' @param logScale Average log1p(x / library size * scaleFactor) instead of x. Default FALSE
+//' @param scaleFactor Total count each cell is normalized to with logScale. Default 10000
+//' @return A list of avg.exp and pct.exp (genes x groups matrices) and size (cells per group)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List GroupExpressionH5(const std::string &filePath, const std::string &groupName, const Rcpp::IntegerVector &group,
+                             const Rcpp::IntegerVector &genes = Rcpp::IntegerVector(0), const bool &logScale = false,
+                             const double &scaleFactor = 10000) {
+    if(logScale == true && scaleFactor <= 0) {
+        ::Rf_error("scaleFactor must be positive");
+    }
+    std::size_t n_groups = 0;
+    std::string error = GetNumGroups(group, n_groups);
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::size_t n_rows = 0;
+    std::size_t n_cols = 0;
+    Rcpp::CharacterVector features;
+    std::vector<int> selected;
+    std::vector<int> rowMap;
+    error = ReadH5Shape(oHdf5Util, file, groupName, "GroupExpressionH5", n_rows, n_cols, features);
+    if(error.empty() == true && (std::size_t)group.size() != n_cols) {
+        error = "group must have one code per column";
+    }
+    if(error.empty() == true) {
+        error = GetRowMap(genes, n_rows, selected, rowMap);
+    }
+    if(error.empty() == false) {
+        oHdf5Util.Close(file);
+        ::Rf_error(error.c_str());
+    }
+
+    std::size_t n_selected = selected.size();
+    std::vector<double> sum(n_selected * n_groups, 0);
+    std::vector<int> nnz(n_selected * n_groups, 0);
+    error = AccumulateGroupsH5(file, groupName, group, n_groups, rowMap, n_selected, logScale ? scaleFactor : 0, sum, nnz);
+    oHdf5Util.Close(file);
+
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    SEXP rownames = GetSelectedNames(features.size() > 0 ? (SEXP)features : R_NilValue, selected);
+    return GetGroupExpressionResult(n_selected, n_groups, group, sum, nnz, rownames);
+}
@@ -0,0 +1,74 @@
+#ifndef AGGREGATE_UTIL
+#define AGGREGATE_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Preprocess.h"
+
+namespace com {
+namespace bioturing {
+
+// Per-gene sums and nonzero counts over the cells of every group, for the rows
+// selected by rowMap (>= 0). The cells of group q are the columns
+// cells[cellPtr[q] .. cellPtr[q + 1]) of p, and group q owns the outputs
+// [q * n_selected, (q + 1) * n_selected), so groups run in parallel and add to
+// the totals of previous blocks without any join. With scaleFactor > 0 the values
+// are library-size normalized and log1p-transformed on the fly, as NormalizeLogScale does.
+template <typename P, typename I>
+struct GroupSumWorker : public RcppParallel::Worker
+{
+    const P *p;
+    const I *i;
+    const double *x;
+    const std::vector<int> &rowMap;
+    const std::size_t n_selected;
+    const std::vector<int> &cellPtr;
+    const std::vector<int> &cells;
+    const double scaleFactor;
+
+    double *sum;
+    int *nnz;
+
+    GroupSumWorker(const P *p, const I *i, const double *x, const std::vector<int> &rowMap, const std::size_t &n_selected,
+                   const std::vector<int> &cellPtr, const std::vector<int> &cells, const double &scaleFactor, double *sum, int *nnz)
+        : p(p), i(i), x(x), rowMap(rowMap), n_selected(n_selected), cellPtr(cellPtr), cells(cells), scaleFactor(scaleFactor),
+          sum(sum), nnz(nnz) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t q = begin; q < end; q++) {
+            double *groupSum = sum + q * n_selected;
+            int *groupNnz = nnz + q * n_selected;
+            for(int e = cellPtr[q]; e < cellPtr[q + 1]; e++) {
+                int c = cells[e];
+                double factor = 0;
+                if(scaleFactor > 0) {
+                    double libSize = 0;
+                    for(P k = p[c]; k < p[c + 1]; k++) {
+                        libSize += x[k];
+                    }
+                    factor = (libSize > 0) ? scaleFactor / libSize : 0;
+                }
+                for(P k = p[c]; k < p[c + 1]; k++) {
+                    int g = rowMap[i[k]];
+                    if(g >= 0 && x[k] != 0) {
+                        groupSum[g] += (scaleFactor > 0) ? std::log1p(x[k] * factor) : x[k];
+                        groupNnz[g]++;
+                    }
+                }
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::List AggregateSpMt(const Rcpp::S4 &mat, const Rcpp::IntegerVector &group);
+Rcpp::List AggregateH5(const std::string &filePath, const std::string &groupName, const Rcpp::IntegerVector &group);
+Rcpp::List GroupExpressionSpMt(const Rcpp::S4 &mat, const Rcpp::IntegerVector &group, const Rcpp::IntegerVector &genes,
+                               const bool &logScale, const double &scaleFactor);
+Rcpp::List GroupExpressionH5(const std::string &filePath, const std::string &groupName, const Rcpp::IntegerVector &group,
+                             const Rcpp::IntegerVector &genes, const bool &logScale, const double &scaleFactor);
+
+#endif //AGGREGATE_UTIL
@@ -138,3 +138,28 @@ arma::uvec FastRandVector(int num) {
     std::random_shuffle(result.begin(), result.end());
     return result;
 }
+
+// Same result as R's make.unique: later duplicates get sep + 1, 2, ... skipping names already taken
+void MakeUnique(std::vector<std::string> &names, const std::string &sep) {
+    std::unordered_set<std::string> original(names.begin(), names.end());
+    if(original.size() == names.size()) {
+        return;
+    }
+
+    std::unordered_set<std::string> used;
+    std::unordered_map<std::string, int> counter;
+    for(std::string &name : names) {
+        if(used.insert(name).second) {
+            continue;
+        }
+
+        int &cnt = counter[name];
+        std::string candidate;
+        do {
+            candidate = name + sep + std::to_string(++cnt);
+        } while(original.count(candidate) > 0 || used.count(candidate) > 0);
+
+        used.insert(candidate);
+        name = candidate;
+    }
+}
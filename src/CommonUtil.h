@@ -8,6 +8,7 @@
 #include <RcppArmadillo.h>
 #include <cmath>
 #include <unordered_map>
+#include <unordered_set>
 #include <fstream>
 #include <string>
 
@@ -23,5 +24,6 @@ void PerformRIndex(const int &i, const int &total, int &new_i);
 void PerformRMultiIndex(const int &start, const int &total_start, int &new_start, const int &end, const int &total_end, int &new_end);
 arma::uvec FastDiffVector(const arma::uvec& a, const arma::uvec& b);
 arma::uvec FastRandVector(int num);
+void MakeUnique(std::vector<std::string> &names, const std::string &sep);
 
 #endif //COMMON_MATRIX_UTIL
@@ -0,0 +1,187 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "DimRedUtil.h"
+
+// Products with the implicitly centered and scaled matrix Z = D (A - mean 1^T), genes x cells,
+// A being the selected genes of a CSC matrix. Matrices on the cell side are kept transposed
+// (l x n_cols) so that every cell reads and writes one contiguous column.
+class ScaledSpMtOperator {
+public:
+    ScaledSpMtOperator(const com::bioturing::CscView &input_, const std::vector<int> &rowMap_,
+                       const std::vector<double> &mean_, const std::vector<double> &invSd_)
+        : input(input_), rowMap(rowMap_), mean(mean_), invSd(invSd_) {}
+
+    // Z * Q, with Q given as qt (l x n_cols); returns n_selected x l
+    arma::mat Mult(const arma::mat &qt) const {
+        std::size_t n_selected = mean.size();
+        std::size_t n_dims = qt.n_rows;
+        com::bioturing::SpMtMultWorker multWorker(input, rowMap, n_selected, qt.memptr(), n_dims);
+        RcppParallel::parallelReduce(0, input.n_cols, multWorker);
+
+        std::vector<double> qSum(n_dims, 0);
+        for(std::size_t c = 0; c < qt.n_cols; c++) {
+            for(std::size_t j = 0; j < n_dims; j++) {
+                qSum[j] += qt(j, c);
+            }
+        }
+
+        arma::mat y(n_selected, n_dims);
+        for(std::size_t g = 0; g < n_selected; g++) {
+            for(std::size_t j = 0; j < n_dims; j++) {
+                y(g, j) = invSd[g] * (multWorker.yt[g * n_dims + j] - mean[g] * qSum[j]);
+            }
+        }
+        return y;
+    }
+
+    // Z^T * P, with P n_selected x l; returns the transposed result (l x n_cols)
+    arma::mat TransMult(const arma::mat &p) const {
+        std::size_t n_selected = mean.size();
+        std::size_t n_dims = p.n_cols;
+        arma::mat pt(n_dims, n_selected);
+        std::vector<double> offset(n_dims, 0);
+        for(std::size_t g = 0; g < n_selected; g++) {
+            for(std::size_t j = 0; j < n_dims; j++) {
+                pt(j, g) = invSd[g] * p(g, j);
+                offset[j] += mean[g] * pt(j, g);
+            }
+        }
+
+        arma::mat wt(n_dims, input.n_cols);
+        com::bioturing::SpMtTransMultWorker transWorker(input, rowMap, pt.memptr(), offset.data(), n_dims, wt.memptr());
+        RcppParallel::parallelFor(0, input.n_cols, transWorker);
+        return wt;
+    }
+
+private:
+    const com::bioturing::CscView &input;
+    const std::vector<int> &rowMap;
+    const std::vector<double> &mean;
+    const std::vector<double> &invSd;
+};
+
+//' RandomizedPca
+//'
+//' PCA of the cells of a sparse log-normalized matrix by randomized SVD with power iterations.
+//' Genes are centered and scaled implicitly inside the sparse products, so the dense scaled
+//' matrix is never built and memory stays O(nnz + cells x components). Unlike a scaled.data
+//' matrix, values are not clipped.
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param genes 1-based row indices of the genes to use. Default uses every gene
+//' @param nComponents Number of components. Default 50
+//' @param center Center the genes. Default TRUE
+//' @param scale Scale the genes to unit variance. Default TRUE
+//' @param nIter Number of power iterations. Default 2
+//' @param oversample Extra dimensions of the random projection. Default 10
+//' @return A list of cell.embeddings (cells x components), gene.loadings (genes x components) and sdev
+//' @export
+// [[Rcpp::export]]
+Rcpp::List RandomizedPca(const Rcpp::S4 &mat, const Rcpp::IntegerVector &genes = Rcpp::IntegerVector(0), const int &nComponents = 50,
+                         const bool &center = true, const bool &scale = true, const int &nIter = 2, const int &oversample = 10) {
+    com::bioturing::CscView input(mat);
+    std::size_t n_rows = input.n_rows;
+    std::size_t n_cols = input.n_cols;
+
+    std::vector<int> rowMap(n_rows, -1);
+    std::vector<int> selected;
+    if(genes.size() == 0) {
+        for(std::size_t r = 0; r < n_rows; r++) {
+            selected.push_back(r);
+        }
+    }
+    for(const int &gene : genes) {
+        if(gene < 1 || gene > (int)n_rows) {
+            ::Rf_error("Gene indices must be between 1 and the number of rows");
+        }
+        selected.push_back(gene - 1);
+    }
+    for(std::size_t g = 0; g < selected.size(); g++) {
+        if(rowMap[selected[g]] >= 0) {
+            ::Rf_error("Gene indices must be unique");
+        }
+        rowMap[selected[g]] = g;
+    }
+
+    std::size_t n_selected = selected.size();
+    std::size_t n_components = std::max(nComponents, 1);
+    if(n_components > std::min(n_selected, n_cols)) {
+        ::Rf_error("nComponents must not exceed the number of genes or cells");
+    }
+    std::size_t n_dims = std::min(n_components + std::max(oversample, 0), std::min(n_selected, n_cols));
+
+    com::bioturing::GeneStatsWorker<int, int> statsWorker(input.p, input.i, input.x, n_rows);
+    RcppParallel::parallelReduce(0, n_cols, statsWorker);
+    std::vector<double> mean(n_selected, 0);
+    std::vector<double> invSd(n_selected, 1);
+    for(std::size_t g = 0; g < n_selected; g++) {
+        std::size_t r = selected[g];
+        double m = statsWorker.sum[r] / n_cols;
+        if(center == true) {
+            mean[g] = m;
+        }
+        // Without centering, genes are scaled by their root mean square like base::scale
+        if(scale == true && n_cols > 1) {
+            double var = (statsWorker.sumSq[r] - n_cols * mean[g] * (2 * m - mean[g])) / (n_cols - 1);
+            double sd = std::sqrt(std::max(var, 0.0));
+            invSd[g] = (sd > 0) ? 1 / sd : 0;
+        }
+    }
+
+    // Range finder: Q spans Z * Omega, refined by power iterations re-orthonormalized each half step
+    ScaledSpMtOperator op(input, rowMap, mean, invSd);
+    arma::mat omegaT = arma::randn(n_dims, n_cols);
+    arma::mat q, r;
+    arma::qr_econ(q, r, op.Mult(omegaT));
+    for(int it = 0; it < nIter; it++) {
+        arma::mat w;
+        arma::qr_econ(w, r, op.TransMult(q).t());
+        arma::mat wt = w.t();
+        arma::qr_econ(q, r, op.Mult(wt));
+    }
+
+    // B = Q^T Z is l x n_cols, exactly the transposed product
+    arma::mat b = op.TransMult(q);
+    arma::mat u, v;
+    arma::vec s;
+    arma::svd_econ(u, s, v, b);
+
+    arma::mat loadings = q * u.cols(0, n_components - 1);
+    arma::mat embeddings = v.cols(0, n_components - 1);
+    Rcpp::NumericVector sdev(n_components);
+    for(std::size_t j = 0; j < n_components; j++) {
+        embeddings.col(j) *= s(j);
+        sdev[j] = s(j) / std::sqrt(std::max<double>(n_cols - 1, 1));
+    }
+
+    Rcpp::NumericMatrix cellEmbeddings(n_cols, n_components, embeddings.begin());
+    Rcpp::NumericMatrix geneLoadings(n_selected, n_components, loadings.begin());
+    Rcpp::CharacterVector pcNames(n_components);
+    for(std::size_t j = 0; j < n_components; j++) {
+        pcNames[j] = "PC" + std::to_string(j + 1);
+    }
+    SEXP rownames = input.dimnames[0];
+    Rcpp::CharacterVector selectedNames;
+    if(Rf_isNull(rownames) == false) {
+        Rcpp::CharacterVector allNames(rownames);
+        selectedNames = Rcpp::CharacterVector(n_selected);
+        for(std::size_t g = 0; g < n_selected; g++) {
+            selectedNames[g] = allNames[selected[g]];
+        }
+    }
+    cellEmbeddings.attr("dimnames") = Rcpp::List::create(input.dimnames[1], pcNames);
+    geneLoadings.attr("dimnames") = Rcpp::List::create(selectedNames.size() > 0 ? (SEXP)selectedNames : R_NilValue, pcNames);
+
+    return Rcpp::List::create(
+        Rcpp::Named("cell.embeddings") = cellEmbeddings,
+        Rcpp::Named("gene.loadings") = geneLoadings,
+        Rcpp::Named("sdev") = sdev
+    );
+}
@@ -0,0 +1,93 @@
+#ifndef DIM_RED_UTIL
+#define DIM_RED_UTIL
+
+#include "Preprocess.h"
+
+namespace com {
+namespace bioturing {
+
+// Y = A * Q over the selected genes of a CSC matrix, where Q is given transposed
+// (l x n_cols, one contiguous column per cell) and Y is accumulated transposed
+// (l x n_selected) in thread-local buffers joined by parallelReduce. Centering and
+// scaling are applied by the caller on the small result.
+struct SpMtMultWorker : public RcppParallel::Worker
+{
+    const CscView &input;
+    const std::vector<int> &rowMap;
+    const double *qt;
+    const std::size_t n_dims;
+    std::vector<double> yt;
+
+    SpMtMultWorker(const CscView &input, const std::vector<int> &rowMap, const std::size_t &n_selected,
+                   const double *qt, const std::size_t &n_dims)
+        : input(input), rowMap(rowMap), qt(qt), n_dims(n_dims), yt(n_selected * n_dims, 0) {}
+
+    SpMtMultWorker(const SpMtMultWorker &worker, RcppParallel::Split)
+        : input(worker.input), rowMap(worker.rowMap), qt(worker.qt), n_dims(worker.n_dims), yt(worker.yt.size(), 0) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t c = begin; c < end; c++) {
+            const double *q = qt + c * n_dims;
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                int g = rowMap[input.i[k]];
+                if(g < 0) {
+                    continue;
+                }
+                double *y = yt.data() + g * n_dims;
+                for(std::size_t j = 0; j < n_dims; j++) {
+                    y[j] += input.x[k] * q[j];
+                }
+            }
+        }
+    }
+
+    void join(const SpMtMultWorker &worker) {
+        for(std::size_t k = 0; k < yt.size(); k++) {
+            yt[k] += worker.yt[k];
+        }
+    }
+};
+
+// W = Z^T * P for the implicitly scaled matrix Z = D (A - mean 1^T), with D P given
+// transposed (l x n_selected) as pt and offset = mean^T D P. Each cell writes its own
+// contiguous column of wt (l x n_cols).
+struct SpMtTransMultWorker : public RcppParallel::Worker
+{
+    const CscView &input;
+    const std::vector<int> &rowMap;
+    const double *pt;
+    const double *offset;
+    const std::size_t n_dims;
+    double *wt;
+
+    SpMtTransMultWorker(const CscView &input, const std::vector<int> &rowMap, const double *pt, const double *offset,
+                        const std::size_t &n_dims, double *wt)
+        : input(input), rowMap(rowMap), pt(pt), offset(offset), n_dims(n_dims), wt(wt) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t c = begin; c < end; c++) {
+            double *w = wt + c * n_dims;
+            for(std::size_t j = 0; j < n_dims; j++) {
+                w[j] = -offset[j];
+            }
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                int g = rowMap[input.i[k]];
+                if(g < 0) {
+                    continue;
+                }
+                const double *row = pt + g * n_dims;
+                for(std::size_t j = 0; j < n_dims; j++) {
+                    w[j] += input.x[k] * row[j];
+                }
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::List RandomizedPca(const Rcpp::S4 &mat, const Rcpp::IntegerVector &genes, const int &nComponents, const bool &center,
+                         const bool &scale, const int &nIter, const int &oversample);
+
+#endif //DIM_RED_UTIL
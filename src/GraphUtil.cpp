@@ -0,0 +1,180 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "GraphUtil.h"
+
+//' ComputeSnn
+//'
+//' Shared nearest neighbour graph of a kNN result, weighted by the Jaccard index of the
+//' neighbour sets. Overlaps are counted in parallel from reverse neighbour lists for the
+//' lower triangle only, which is then mirrored (as symmatl does) into a symmetric matrix.
+//'
+//' @param knnIndex An integer matrix, points x k, of 1-based neighbour indices (NA allowed)
+//' @param prune Edges with a Jaccard index below this number are dropped. Default 0.0666667 (1/15)
+//' @return A symmetric sparse matrix (dgCMatrix), points x points
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ComputeSnn(const Rcpp::IntegerMatrix &knnIndex, const double &prune = 0.0666667) {
+    std::size_t n = knnIndex.nrow();
+    std::size_t k = knnIndex.ncol();
+
+    std::vector<int> nnPtr(n + 1, 0);
+    std::vector<int> nnIdx;
+    std::vector<int> neighbors;
+    for(std::size_t i = 0; i < n; i++) {
+        neighbors.clear();
+        for(std::size_t j = 0; j < k; j++) {
+            int idx = knnIndex[j * n + i];
+            if(idx == NA_INTEGER) {
+                continue;
+            }
+            if(idx < 1 || idx > (int)n) {
+                ::Rf_error("Neighbour indices must be between 1 and the number of points");
+            }
+            neighbors.push_back(idx - 1);
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        nnIdx.insert(nnIdx.end(), neighbors.begin(), neighbors.end());
+        nnPtr[i + 1] = nnIdx.size();
+    }
+
+    // revIdx[revPtr[m] .. revPtr[m + 1]) lists the points having m as a neighbour, ascending
+    std::vector<int> revPtr(n + 1, 0);
+    for(const int &m : nnIdx) {
+        revPtr[m + 1]++;
+    }
+    for(std::size_t m = 0; m < n; m++) {
+        revPtr[m + 1] += revPtr[m];
+    }
+    std::vector<int> revIdx(nnIdx.size());
+    std::vector<int> revPos(revPtr.begin(), revPtr.end() - 1);
+    for(std::size_t i = 0; i < n; i++) {
+        for(int k = nnPtr[i]; k < nnPtr[i + 1]; k++) {
+            revIdx[revPos[nnIdx[k]]++] = i;
+        }
+    }
+
+    std::vector<std::vector<int>> lowerRows(n);
+    std::vector<std::vector<double>> lowerValues(n);
+    com::bioturing::SnnWorker snnWorker(nnPtr, nnIdx, revPtr, revIdx, prune, lowerRows, lowerValues);
+    RcppParallel::parallelFor(0, n, snnWorker, 64);
+
+    // Column c = mirrored entries (c, r) of the lower columns r < c, then lower column c
+    std::vector<std::size_t> colCount(n, 0);
+    for(std::size_t c = 0; c < n; c++) {
+        colCount[c] += lowerRows[c].size();
+        for(const int &r : lowerRows[c]) {
+            if(r != (int)c) {
+                colCount[r]++;
+            }
+        }
+    }
+    Rcpp::IntegerVector p(n + 1);
+    p[0] = 0;
+    for(std::size_t c = 0; c < n; c++) {
+        p[c + 1] = p[c] + colCount[c];
+    }
+
+    Rcpp::IntegerVector i(p[n]);
+    Rcpp::NumericVector x(p[n]);
+    std::vector<int> pos(p.begin(), p.end() - 1);
+    for(std::size_t c = 0; c < n; c++) {
+        for(std::size_t e = 0; e < lowerRows[c].size(); e++) {
+            int r = lowerRows[c][e];
+            i[pos[c]] = r;
+            x[pos[c]++] = lowerValues[c][e];
+            if(r != (int)c) {
+                i[pos[r]] = c;
+                x[pos[r]++] = lowerValues[c][e];
+            }
+        }
+    }
+
+    std::string klass = "dgCMatrix";
+    Rcpp::S4 snn(klass);
+    snn.slot("i") = i;
+    snn.slot("p") = p;
+    snn.slot("x") = x;
+    snn.slot("Dim") = Rcpp::IntegerVector::create(n, n);
+    return snn;
+}
+
+//' LeidenClustering
+//'
+//' Leiden community detection optimizing modularity with a resolution parameter on a
+//' symmetric weighted adjacency matrix (e.g. the SNN graph). Random starts run concurrently
+//' and the partition of highest modularity is kept.
+//'
+//' @param graph A symmetric sparse matrix (dgCMatrix)
+//' @param resolution Resolution parameter, higher values give more clusters. Default 0.8
+//' @param nStarts Number of random starts. Default 10
+//' @param nIterations Number of Leiden iterations per start. Default 2
+//' @param randomness Randomness of the refinement step. Default 0.01
+//' @param seed Random seed, start s using seed + s. Default 1
+//' @return A list of membership (1-based cluster labels, cluster 1 being the largest),
+//'         modularity of the membership and modularity of every start
+//' @export
+// [[Rcpp::export]]
+Rcpp::List LeidenClustering(const Rcpp::S4 &graph, const double &resolution = 0.8, const int &nStarts = 10, const int &nIterations = 2,
+                            const double &randomness = 0.01, const int &seed = 1) {
+    Rcpp::IntegerVector dims = graph.slot("Dim");
+    Rcpp::IntegerVector p = graph.slot("p");
+    Rcpp::IntegerVector i = graph.slot("i");
+    Rcpp::NumericVector x = graph.slot("x");
+    if(dims[0] != dims[1]) {
+        ::Rf_error("graph must be a square adjacency matrix");
+    }
+    if(randomness <= 0) {
+        ::Rf_error("randomness must be positive");
+    }
+
+    com::bioturing::WeightedGraph weightedGraph;
+    weightedGraph.n = dims[1];
+    weightedGraph.p.assign(p.begin(), p.end());
+    weightedGraph.i.assign(i.begin(), i.end());
+    weightedGraph.x.assign(x.begin(), x.end());
+    weightedGraph.ComputeStrength();
+
+    std::size_t n_starts = std::max(nStarts, 1);
+    std::vector<std::vector<int>> memberships(n_starts);
+    std::vector<double> qualities(n_starts, 0);
+    com::bioturing::LeidenStartWorker startWorker(weightedGraph, resolution, randomness, std::max(nIterations, 1), seed,
+                                                  memberships, qualities);
+    RcppParallel::parallelFor(0, n_starts, startWorker, 1);
+
+    std::size_t best = std::max_element(qualities.begin(), qualities.end()) - qualities.begin();
+    std::vector<int> &membership = memberships[best];
+    std::size_t n_clusters = com::bioturing::RenumberLabels(membership);
+
+    // Label clusters by decreasing size, ties by first appearance
+    std::vector<std::size_t> sizes(n_clusters, 0);
+    for(const int &label : membership) {
+        sizes[label]++;
+    }
+    std::vector<int> order(n_clusters);
+    for(std::size_t c = 0; c < n_clusters; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](const int &a, const int &b) { return sizes[a] > sizes[b]; });
+    std::vector<int> rank(n_clusters);
+    for(std::size_t c = 0; c < n_clusters; c++) {
+        rank[order[c]] = c + 1;
+    }
+
+    Rcpp::IntegerVector labels(membership.size());
+    for(std::size_t v = 0; v < membership.size(); v++) {
+        labels[v] = rank[membership[v]];
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("membership") = labels,
+        Rcpp::Named("modularity") = qualities[best],
+        Rcpp::Named("starts") = Rcpp::wrap(qualities)
+    );
+}
@@ -0,0 +1,451 @@
+#ifndef GRAPH_UTIL
+#define GRAPH_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+#include "Hdf5Util.h"
+
+namespace com {
+namespace bioturing {
+
+// Lower triangle of the shared nearest neighbour graph. For point i, every point
+// j >= i sharing a neighbour m with i is found through the reverse lists of its
+// neighbours; sorting the hits gives |N(i) & N(j)| as run lengths, weighted by
+// Jaccard |N(i) & N(j)| / |N(i) | N(j)| and pruned below prune. Column i is
+// written to rows[i] / values[i] only, so columns are filled in parallel.
+struct SnnWorker : public RcppParallel::Worker
+{
+    const std::vector<int> &nnPtr;
+    const std::vector<int> &nnIdx;
+    const std::vector<int> &revPtr;
+    const std::vector<int> &revIdx;
+    const double prune;
+    std::vector<std::vector<int>> &rows;
+    std::vector<std::vector<double>> &values;
+
+    SnnWorker(const std::vector<int> &nnPtr, const std::vector<int> &nnIdx, const std::vector<int> &revPtr,
+              const std::vector<int> &revIdx, const double &prune,
+              std::vector<std::vector<int>> &rows, std::vector<std::vector<double>> &values)
+        : nnPtr(nnPtr), nnIdx(nnIdx), revPtr(revPtr), revIdx(revIdx), prune(prune), rows(rows), values(values) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::vector<int> hits;
+        for(std::size_t i = begin; i < end; i++) {
+            hits.clear();
+            for(int k = nnPtr[i]; k < nnPtr[i + 1]; k++) {
+                int m = nnIdx[k];
+                for(int r = revPtr[m]; r < revPtr[m + 1]; r++) {
+                    if(revIdx[r] >= (int)i) {
+                        hits.push_back(revIdx[r]);
+                    }
+                }
+            }
+            std::sort(hits.begin(), hits.end());
+
+            int size_i = nnPtr[i + 1] - nnPtr[i];
+            for(std::size_t h = 0; h < hits.size(); ) {
+                std::size_t next = h + 1;
+                while(next < hits.size() && hits[next] == hits[h]) {
+                    next++;
+                }
+                int j = hits[h];
+                double overlap = next - h;
+                double jaccard = overlap / (size_i + (nnPtr[j + 1] - nnPtr[j]) - overlap);
+                if(jaccard >= prune) {
+                    rows[i].push_back(j);
+                    values[i].push_back(jaccard);
+                }
+                h = next;
+            }
+        }
+    }
+};
+
+// Undirected weighted graph as a symmetric CSC adjacency; a self-loop is stored once
+struct WeightedGraph {
+    std::size_t n;
+    std::vector<int> p;
+    std::vector<int> i;
+    std::vector<double> x;
+    std::vector<double> strength;
+    double total;
+
+    void ComputeStrength() {
+        strength.assign(n, 0);
+        total = 0;
+        for(std::size_t c = 0; c < n; c++) {
+            for(int k = p[c]; k < p[c + 1]; k++) {
+                strength[c] += x[k];
+            }
+            total += strength[c];
+        }
+    }
+};
+
+// Renumber labels to 0 .. K - 1 in order of first appearance and return K
+inline std::size_t RenumberLabels(std::vector<int> &labels) {
+    std::vector<int> newLabel(labels.size(), -1);
+    std::size_t n_labels = 0;
+    for(int &label : labels) {
+        if(newLabel[label] < 0) {
+            newLabel[label] = n_labels++;
+        }
+        label = newLabel[label];
+    }
+    return n_labels;
+}
+
+// Modularity with resolution: sum over communities of in_c / 2m - resolution * (tot_c / 2m)^2
+inline double GetModularity(const WeightedGraph &graph, const std::vector<int> &membership, const double &resolution) {
+    if(graph.total <= 0) {
+        return 0;
+    }
+    std::vector<double> in(graph.n, 0);
+    std::vector<double> tot(graph.n, 0);
+    for(std::size_t c = 0; c < graph.n; c++) {
+        tot[membership[c]] += graph.strength[c];
+        for(int k = graph.p[c]; k < graph.p[c + 1]; k++) {
+            if(membership[graph.i[k]] == membership[c]) {
+                in[membership[c]] += graph.x[k];
+            }
+        }
+    }
+    double quality = 0;
+    for(std::size_t c = 0; c < graph.n; c++) {
+        quality += in[c] / graph.total - resolution * (tot[c] / graph.total) * (tot[c] / graph.total);
+    }
+    return quality;
+}
+
+// One run of the Leiden algorithm (Traag et al. 2019) optimizing modularity with a
+// resolution parameter: fast local moving, refinement within communities, and
+// aggregation of the refined partition, repeated until every aggregate node is its own
+// community. Each run owns its random generator, so runs are executed concurrently.
+class LeidenRun {
+public:
+    LeidenRun(const WeightedGraph &graph_, const double &resolution_, const double &randomness_, const int &seed)
+        : graph(graph_), resolution(resolution_), randomness(randomness_), rng(seed) {}
+
+    // membership: partition of the original graph, refined in place
+    void Run(const int &nIterations, std::vector<int> &membership) {
+        for(int it = 0; it < nIterations; it++) {
+            WeightedGraph aggregate;
+            const WeightedGraph *current = &graph;
+            std::vector<int> nodeOf(graph.n);
+            for(std::size_t v = 0; v < graph.n; v++) {
+                nodeOf[v] = v;
+            }
+            std::vector<int> partition(membership);
+            RenumberLabels(partition);
+
+            while(true) {
+                MoveNodesFast(*current, partition);
+                std::size_t n_communities = RenumberLabels(partition);
+                for(std::size_t v = 0; v < graph.n; v++) {
+                    membership[v] = partition[nodeOf[v]];
+                }
+                if(n_communities == current->n) {
+                    break;
+                }
+
+                // Aggregate the refined partition, or the partition itself when refinement keeps singletons
+                std::vector<int> refined = Refine(*current, partition);
+                std::size_t n_refined = RenumberLabels(refined);
+                if(n_refined == current->n) {
+                    refined = partition;
+                    n_refined = n_communities;
+                }
+
+                std::vector<int> aggregatePartition(n_refined);
+                for(std::size_t v = 0; v < current->n; v++) {
+                    aggregatePartition[refined[v]] = partition[v];
+                }
+                for(std::size_t v = 0; v < graph.n; v++) {
+                    nodeOf[v] = refined[nodeOf[v]];
+                }
+                WeightedGraph next = Aggregate(*current, refined, n_refined);
+                aggregate = std::move(next);
+                current = &aggregate;
+                partition.swap(aggregatePartition);
+            }
+        }
+    }
+
+private:
+    std::vector<int> GetRandomOrder(const std::size_t &n) {
+        std::vector<int> order(n);
+        for(std::size_t v = 0; v < n; v++) {
+            order[v] = v;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        return order;
+    }
+
+    // Queue-based local moving: only neighbours of moved nodes are visited again
+    void MoveNodesFast(const WeightedGraph &g, std::vector<int> &partition) {
+        std::vector<double> commTot(g.n, 0);
+        std::vector<int> commSize(g.n, 0);
+        for(std::size_t v = 0; v < g.n; v++) {
+            commTot[partition[v]] += g.strength[v];
+            commSize[partition[v]]++;
+        }
+        std::vector<int> emptyComms;
+        for(std::size_t c = 0; c < g.n; c++) {
+            if(commSize[c] == 0) {
+                emptyComms.push_back(c);
+            }
+        }
+
+        std::vector<int> order = GetRandomOrder(g.n);
+        std::deque<int> queue(order.begin(), order.end());
+        std::vector<char> inQueue(g.n, 1);
+        std::vector<double> neighWeight(g.n, 0);
+        std::vector<char> seen(g.n, 0);
+        std::vector<int> neighComms;
+
+        while(queue.empty() == false) {
+            int v = queue.front();
+            queue.pop_front();
+            inQueue[v] = 0;
+            int cv = partition[v];
+
+            neighComms.assign(1, cv);
+            seen[cv] = 1;
+            for(int k = g.p[v]; k < g.p[v + 1]; k++) {
+                int u = g.i[k];
+                if(u == v) {
+                    continue;
+                }
+                int c = partition[u];
+                if(seen[c] == 0) {
+                    seen[c] = 1;
+                    neighComms.push_back(c);
+                }
+                neighWeight[c] += g.x[k];
+            }
+
+            commTot[cv] -= g.strength[v];
+            if(--commSize[cv] == 0) {
+                emptyComms.push_back(cv);
+            }
+
+            int best = cv;
+            double bestGain = neighWeight[cv] - resolution * g.strength[v] * commTot[cv] / g.total;
+            for(const int &c : neighComms) {
+                double gain = neighWeight[c] - resolution * g.strength[v] * commTot[c] / g.total;
+                if(gain > bestGain) {
+                    best = c;
+                    bestGain = gain;
+                }
+            }
+            if(bestGain < 0) {
+                while(commSize[emptyComms.back()] > 0) {
+                    emptyComms.pop_back();
+                }
+                best = emptyComms.back();
+            }
+
+            commTot[best] += g.strength[v];
+            commSize[best]++;
+            for(const int &c : neighComms) {
+                neighWeight[c] = 0;
+                seen[c] = 0;
+            }
+
+            if(best != cv) {
+                partition[v] = best;
+                for(int k = g.p[v]; k < g.p[v + 1]; k++) {
+                    int u = g.i[k];
+                    if(inQueue[u] == 0 && partition[u] != best) {
+                        inQueue[u] = 1;
+                        queue.push_back(u);
+                    }
+                }
+            }
+        }
+    }
+
+    // Merge singletons into well-connected subcommunities of their community, picking
+    // among non-negative gains with probability proportional to exp(gain / randomness)
+    std::vector<int> Refine(const WeightedGraph &g, const std::vector<int> &partition) {
+        std::vector<int> refined(g.n);
+        std::vector<double> refTot(g.strength);
+        std::vector<int> refSize(g.n, 1);
+        std::vector<double> commTot(g.n, 0);
+        std::vector<double> extEdge(g.n, 0);
+        for(std::size_t v = 0; v < g.n; v++) {
+            refined[v] = v;
+            commTot[partition[v]] += g.strength[v];
+            for(int k = g.p[v]; k < g.p[v + 1]; k++) {
+                if(g.i[k] != (int)v && partition[g.i[k]] == partition[v]) {
+                    extEdge[v] += g.x[k];
+                }
+            }
+        }
+        std::vector<double> refExt(extEdge);
+
+        std::vector<double> neighWeight(g.n, 0);
+        std::vector<char> seen(g.n, 0);
+        std::vector<int> neighComms;
+        std::vector<double> probs;
+        std::vector<int> order = GetRandomOrder(g.n);
+        for(const int &v : order) {
+            int rv = refined[v];
+            double totC = commTot[partition[v]];
+            if(refSize[rv] > 1 || extEdge[v] < resolution * g.strength[v] * (totC - g.strength[v]) / g.total) {
+                continue;
+            }
+
+            neighComms.assign(1, rv);
+            seen[rv] = 1;
+            for(int k = g.p[v]; k < g.p[v + 1]; k++) {
+                int u = g.i[k];
+                if(u == v || partition[u] != partition[v]) {
+                    continue;
+                }
+                int r = refined[u];
+                if(seen[r] == 0) {
+                    seen[r] = 1;
+                    neighComms.push_back(r);
+                }
+                neighWeight[r] += g.x[k];
+            }
+
+            // v leaves its singleton, which then has no weight
+            refTot[rv] = 0;
+            refSize[rv] = 0;
+            refExt[rv] = 0;
+            double maxGain = 0;
+            probs.assign(neighComms.size(), -1);
+            for(std::size_t c = 0; c < neighComms.size(); c++) {
+                int r = neighComms[c];
+                bool connected = (r == rv) || refExt[r] >= resolution * refTot[r] * (totC - refTot[r]) / g.total;
+                double gain = neighWeight[r] - resolution * g.strength[v] * refTot[r] / g.total;
+                if(connected == true && gain >= 0) {
+                    probs[c] = gain;
+                    maxGain = std::max(maxGain, gain);
+                }
+            }
+            double sum = 0;
+            for(double &prob : probs) {
+                prob = (prob >= 0) ? std::exp((prob - maxGain) / randomness) : 0;
+                sum += prob;
+            }
+            int chosen = rv;
+            double draw = std::uniform_real_distribution<double>(0, sum)(rng);
+            for(std::size_t c = 0; c < neighComms.size(); c++) {
+                if(probs[c] > 0) {
+                    chosen = neighComms[c];
+                    if(draw < probs[c]) {
+                        break;
+                    }
+                    draw -= probs[c];
+                }
+            }
+
+            refTot[chosen] += g.strength[v];
+            refSize[chosen]++;
+            refExt[chosen] += extEdge[v] - 2 * neighWeight[chosen];
+            refined[v] = chosen;
+            for(const int &r : neighComms) {
+                neighWeight[r] = 0;
+                seen[r] = 0;
+            }
+        }
+        return refined;
+    }
+
+    // Graph of the communities of labels: edge weights are summed, internal weight becomes a self-loop
+    WeightedGraph Aggregate(const WeightedGraph &g, const std::vector<int> &labels, const std::size_t &n_labels) {
+        std::vector<int> memberPtr(n_labels + 1, 0);
+        for(const int &label : labels) {
+            memberPtr[label + 1]++;
+        }
+        for(std::size_t c = 0; c < n_labels; c++) {
+            memberPtr[c + 1] += memberPtr[c];
+        }
+        std::vector<int> members(g.n);
+        std::vector<int> memberPos(memberPtr.begin(), memberPtr.end() - 1);
+        for(std::size_t v = 0; v < g.n; v++) {
+            members[memberPos[labels[v]]++] = v;
+        }
+
+        WeightedGraph aggregate;
+        aggregate.n = n_labels;
+        aggregate.p.assign(1, 0);
+        std::vector<double> weight(n_labels, 0);
+        std::vector<char> seen(n_labels, 0);
+        std::vector<int> touched;
+        for(std::size_t c = 0; c < n_labels; c++) {
+            touched.clear();
+            for(int m = memberPtr[c]; m < memberPtr[c + 1]; m++) {
+                int v = members[m];
+                for(int k = g.p[v]; k < g.p[v + 1]; k++) {
+                    int r = labels[g.i[k]];
+                    if(seen[r] == 0) {
+                        seen[r] = 1;
+                        touched.push_back(r);
+                    }
+                    weight[r] += g.x[k];
+                }
+            }
+            std::sort(touched.begin(), touched.end());
+            for(const int &r : touched) {
+                aggregate.i.push_back(r);
+                aggregate.x.push_back(weight[r]);
+                weight[r] = 0;
+                seen[r] = 0;
+            }
+            aggregate.p.push_back(aggregate.i.size());
+        }
+        aggregate.ComputeStrength();
+        return aggregate;
+    }
+
+    const WeightedGraph &graph;
+    const double resolution;
+    const double randomness;
+    std::mt19937 rng;
+};
+
+// Independent Leiden runs, start s seeded with seed + s, executed concurrently
+struct LeidenStartWorker : public RcppParallel::Worker
+{
+    const WeightedGraph &graph;
+    const double resolution;
+    const double randomness;
+    const int nIterations;
+    const int seed;
+    std::vector<std::vector<int>> &memberships;
+    std::vector<double> &qualities;
+
+    LeidenStartWorker(const WeightedGraph &graph, const double &resolution, const double &randomness, const int &nIterations,
+                      const int &seed, std::vector<std::vector<int>> &memberships, std::vector<double> &qualities)
+        : graph(graph), resolution(resolution), randomness(randomness), nIterations(nIterations), seed(seed),
+          memberships(memberships), qualities(qualities) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t s = begin; s < end; s++) {
+            std::vector<int> membership(graph.n);
+            for(std::size_t v = 0; v < graph.n; v++) {
+                membership[v] = v;
+            }
+            LeidenRun run(graph, resolution, randomness, seed + s);
+            run.Run(nIterations, membership);
+            qualities[s] = GetModularity(graph, membership, resolution);
+            memberships[s].swap(membership);
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::S4 ComputeSnn(const Rcpp::IntegerMatrix &knnIndex, const double &prune);
+Rcpp::List LeidenClustering(const Rcpp::S4 &graph, const double &resolution, const int &nStarts, const int &nIterations,
+                            const double &randomness, const int &seed);
+
+#endif //GRAPH_UTIL
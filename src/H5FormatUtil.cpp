@@ -0,0 +1,119 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "H5FormatUtil.h"
+
+// R passes 1-based cell indices
+std::vector<unsigned int> GetZeroBasedCells(const Rcpp::IntegerVector &cells) {
+    std::vector<unsigned int> arrCells;
+    arrCells.reserve(cells.size());
+    for(const int &cell : cells) {
+        if(cell < 1) {
+            ::Rf_error("Cell indices must be positive");
+        }
+        arrCells.push_back(cell - 1);
+    }
+    return arrCells;
+}
+
+//' ReadH5AD
+//'
+//' Read X or a layer of an AnnData (.h5ad) file as a genes x cells dgCMatrix
+//'
+//' @param filePath A string (h5ad path)
+//' @param layer Layer name. Default "" reads X
+//' @param cells 1-based cell (obs) indices to read. Default reads every cell
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ReadH5AD(const std::string &filePath, const std::string &layer = "", const Rcpp::IntegerVector &cells = Rcpp::IntegerVector(0)) {
+    com::bioturing::AnnDataUtil oAnnDataUtil(filePath);
+    HighFive::File *file = oAnnDataUtil.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open h5ad file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+    Rcpp::S4 mat = oAnnDataUtil.ReadMatrix(file, layer, GetZeroBasedCells(cells));
+    oAnnDataUtil.Close(file);
+    return mat;
+}
+
+//' WriteH5AD
+//'
+//' Write a genes x cells dgCMatrix as X (csr_matrix) or a layer of an AnnData (.h5ad) file
+//'
+//' @param filePath A string (h5ad path)
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param layer Layer name. Default "" writes X
+//' @export
+// [[Rcpp::export]]
+void WriteH5AD(const std::string &filePath, const Rcpp::S4 &mat, const std::string &layer = "") {
+    com::bioturing::AnnDataUtil oAnnDataUtil(filePath);
+    HighFive::File *file = oAnnDataUtil.Open(-1);
+    oAnnDataUtil.WriteMatrix(file, mat, layer);
+    oAnnDataUtil.Close(file);
+}
+
+//' ImportH5ADToH5
+//'
+//' Copy X or a layer of an AnnData (.h5ad) file into a group of a HDF5 file in the bioturing layout
+//'
+//' @param h5adPath A string (h5ad path)
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group)
+//' @param layer Layer name. Default "" imports X
+//' @export
+// [[Rcpp::export]]
+void ImportH5ADToH5(const std::string &h5adPath, const std::string &filePath, const std::string &groupName, const std::string &layer = "") {
+    com::bioturing::AnnDataUtil oAnnDataUtil(h5adPath);
+    HighFive::File *file = oAnnDataUtil.Open(1);
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *outFile = oHdf5Util.Open(-1);
+    oAnnDataUtil.ImportToGroup(file, outFile, groupName, layer, 1 << 22);
+    oHdf5Util.Close(outFile);
+    oAnnDataUtil.Close(file);
+}
+
+//' ReadLoom
+//'
+//' Read the matrix or a layer of a loom file as a genes x cells dgCMatrix
+//'
+//' @param filePath A string (loom path)
+//' @param layer Layer name. Default "" reads the main matrix
+//' @param cells 1-based cell (column) indices to read. Default reads every cell
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ReadLoom(const std::string &filePath, const std::string &layer = "", const Rcpp::IntegerVector &cells = Rcpp::IntegerVector(0)) {
+    com::bioturing::LoomUtil oLoomUtil(filePath);
+    HighFive::File *file = oLoomUtil.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open loom file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+    Rcpp::S4 mat = oLoomUtil.ReadMatrix(file, layer, GetZeroBasedCells(cells), 1024);
+    oLoomUtil.Close(file);
+    return mat;
+}
+
+//' WriteLoom
+//'
+//' Write a genes x cells dgCMatrix as the matrix or a layer of a loom file
+//'
+//' @param filePath A string (loom path)
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param layer Layer name. Default "" writes the main matrix
+//' @export
+// [[Rcpp::export]]
+void WriteLoom(const std::string &filePath, const Rcpp::S4 &mat, const std::string &layer = "") {
+    com::bioturing::LoomUtil oLoomUtil(filePath);
+    HighFive::File *file = oLoomUtil.Open(-1);
+    oLoomUtil.WriteMatrix(file, mat, layer, 1024);
+    oLoomUtil.Close(file);
+}
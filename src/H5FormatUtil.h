@@ -0,0 +1,805 @@
+#ifndef H5_FORMAT_UTIL
+#define H5_FORMAT_UTIL
+
+#include "Hdf5Util.h"
+
+namespace com {
+namespace bioturing {
+
+inline bool ReadStringAttribute(const hid_t &objId, const std::string &attName, std::string &value) {
+    if(H5Aexists(objId, attName.c_str()) <= 0) {
+        return false;
+    }
+
+    hid_t attr = H5Aopen(objId, attName.c_str(), H5P_DEFAULT);
+    hid_t type = H5Aget_type(attr);
+    bool ok = false;
+    if(H5Tget_class(type) == H5T_STRING) {
+        if(H5Tis_variable_str(type) > 0) {
+            hid_t memType = H5Tcopy(H5T_C_S1);
+            H5Tset_size(memType, H5T_VARIABLE);
+            char *buffer = nullptr;
+            if(H5Aread(attr, memType, &buffer) >= 0 && buffer != nullptr) {
+                value = buffer;
+                H5free_memory(buffer);
+                ok = true;
+            }
+            H5Tclose(memType);
+        } else {
+            std::string buffer(H5Tget_size(type), '\0');
+            if(H5Aread(attr, type, &buffer[0]) >= 0) {
+                value = buffer.substr(0, buffer.find('\0'));
+                ok = true;
+            }
+        }
+    }
+    H5Tclose(type);
+    H5Aclose(attr);
+    return ok;
+}
+
+inline bool ReadIntArrayAttribute(const hid_t &objId, const std::string &attName, std::vector<long long> &values) {
+    if(H5Aexists(objId, attName.c_str()) <= 0) {
+        return false;
+    }
+
+    hid_t attr = H5Aopen(objId, attName.c_str(), H5P_DEFAULT);
+    hid_t space = H5Aget_space(attr);
+    values.resize(H5Sget_simple_extent_npoints(space));
+    bool ok = H5Aread(attr, H5T_NATIVE_LLONG, values.data()) >= 0;
+    H5Sclose(space);
+    H5Aclose(attr);
+    return ok;
+}
+
+inline void WriteStringAttribute(const hid_t &objId, const std::string &attName, const std::string &value) {
+    if(H5Aexists(objId, attName.c_str()) > 0) {
+        H5Adelete(objId, attName.c_str());
+    }
+
+    hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, H5T_VARIABLE);
+    H5Tset_cset(type, H5T_CSET_UTF8);
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr = H5Acreate2(objId, attName.c_str(), type, space, H5P_DEFAULT, H5P_DEFAULT);
+    const char *buffer = value.c_str();
+    H5Awrite(attr, type, &buffer);
+    H5Aclose(attr);
+    H5Sclose(space);
+    H5Tclose(type);
+}
+
+inline void WriteStringArrayAttribute(const hid_t &objId, const std::string &attName, const std::vector<std::string> &values) {
+    if(H5Aexists(objId, attName.c_str()) > 0) {
+        H5Adelete(objId, attName.c_str());
+    }
+
+    hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, H5T_VARIABLE);
+    H5Tset_cset(type, H5T_CSET_UTF8);
+    hsize_t dims[1] = {values.size()};
+    hid_t space = H5Screate_simple(1, dims, nullptr);
+    hid_t attr = H5Acreate2(objId, attName.c_str(), type, space, H5P_DEFAULT, H5P_DEFAULT);
+    std::vector<const char*> buffer;
+    for(const std::string &value : values) {
+        buffer.push_back(value.c_str());
+    }
+    H5Awrite(attr, type, buffer.data());
+    H5Aclose(attr);
+    H5Sclose(space);
+    H5Tclose(type);
+}
+
+inline void WriteIntArrayAttribute(const hid_t &objId, const std::string &attName, const std::vector<long long> &values) {
+    if(H5Aexists(objId, attName.c_str()) > 0) {
+        H5Adelete(objId, attName.c_str());
+    }
+
+    hsize_t dims[1] = {values.size()};
+    hid_t space = H5Screate_simple(1, dims, nullptr);
+    hid_t attr = H5Acreate2(objId, attName.c_str(), H5T_NATIVE_LLONG, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, H5T_NATIVE_LLONG, values.data());
+    H5Aclose(attr);
+    H5Sclose(space);
+}
+
+inline bool IsH5Group(HighFive::File *file, const std::string &path) {
+    hid_t obj = H5Oopen(file->getId(), path.c_str(), H5P_DEFAULT);
+    if(obj < 0) {
+        return false;
+    }
+    bool isGroup = (H5Iget_type(obj) == H5I_GROUP);
+    H5Oclose(obj);
+    return isGroup;
+}
+
+// Consecutive runs [first, last] of a cell index list, so each run is one hyperslab read
+inline void GetIndexRuns(const std::vector<unsigned int> &cells, std::vector<std::pair<unsigned int, unsigned int>> &runs) {
+    runs.clear();
+    for(std::size_t k = 0; k < cells.size(); k++) {
+        if(runs.size() > 0 && runs.back().second + 1 == cells[k]) {
+            runs.back().second = cells[k];
+        } else {
+            runs.push_back(std::make_pair(cells[k], cells[k]));
+        }
+    }
+}
+
+// AnnData (.h5ad): X and layers/<name> are cells x genes, stored as a csr_matrix
+// or csc_matrix group or a dense dataset; obs/var are dataframes whose index
+// dataset is named by their "_index" attribute. Matrices are exchanged with R
+// as genes x cells dgCMatrix, which is exactly the CSR of X.
+class AnnDataUtil : public Hdf5Util {
+public:
+    AnnDataUtil(const std::string &file_name_) : Hdf5Util(file_name_) {}
+
+    std::string GetMatrixPath(const std::string &layer) {
+        return (layer.size() == 0) ? "X" : "layers/" + layer;
+    }
+
+    void ReadNames(HighFive::File *file, const std::string &frameName, std::vector<std::string> &names) {
+        if(file->exist(frameName) == false) {
+            names.clear();
+            return;
+        }
+
+        if(IsH5Group(file, frameName) == false) {
+            std::stringstream ostr;
+            ostr << "Legacy compound " << frameName << " is not supported, please re-save with anndata >= 0.7";
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+
+        HighFive::Group frame = file->getGroup(frameName);
+        std::string indexName = "_index";
+        ReadStringAttribute(frame.getId(), "_index", indexName);
+        ReadDatasetVector(file, frameName, indexName, names);
+    }
+
+    // Cells (obs) x genes (var) of a matrix: the shape attribute of a sparse group, the dataspace
+    // of a dense dataset. Files without a shape fall back to the sizes of the obs/var indexes
+    void GetMatrixShape(HighFive::File *file, const std::string &path, std::size_t &n_obs, std::size_t &n_var) {
+        std::vector<long long> shape;
+        if(IsH5Group(file, path) == true) {
+            HighFive::Group matrix = file->getGroup(path);
+            if(ReadIntArrayAttribute(matrix.getId(), "shape", shape) == false) {
+                ReadIntArrayAttribute(matrix.getId(), "h5sparse_shape", shape);
+            }
+        } else {
+            std::vector<std::size_t> dims = file->getDataSet(path).getSpace().getDimensions();
+            shape.assign(dims.begin(), dims.end());
+        }
+
+        if(shape.size() == 2) {
+            n_obs = shape[0];
+            n_var = shape[1];
+        }
+    }
+
+    // Read the obs/var indexes and check them against the shape of the matrix at path;
+    // a missing index gets generated names. Returns an error message, empty on success
+    std::string ReadMatrixNames(HighFive::File *file, const std::string &path, std::vector<std::string> &arrObs, std::vector<std::string> &arrVar) {
+        ReadNames(file, "obs", arrObs);
+        ReadNames(file, "var", arrVar);
+        std::size_t n_obs = arrObs.size();
+        std::size_t n_var = arrVar.size();
+        GetMatrixShape(file, path, n_obs, n_var);
+
+        std::vector<std::pair<std::vector<std::string>*, std::size_t>> arrNames = {{&arrObs, n_obs}, {&arrVar, n_var}};
+        for(std::size_t k = 0; k < arrNames.size(); k++) {
+            std::vector<std::string> &names = *arrNames[k].first;
+            std::size_t n = arrNames[k].second;
+            if(names.size() == 0) {
+                names.resize(n);
+                for(std::size_t r = 0; r < n; r++) {
+                    names[r] = (k == 0 ? "c" : "g") + std::to_string(r + 1);
+                }
+            }
+            if(names.size() != n) {
+                std::stringstream ostr;
+                ostr << (k == 0 ? "obs" : "var") << " has " << names.size() << " names but " << path << " has " << n;
+                return ostr.str();
+            }
+        }
+        return "";
+    }
+
+    // cells are 0-based indices into obs; empty reads every cell
+    Rcpp::S4 ReadMatrix(HighFive::File *file, const std::string &layer, const std::vector<unsigned int> &cells) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read h5ad, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string path = GetMatrixPath(layer);
+        Rcpp::S4 mat;
+        try {
+            if(file->exist(path) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist matrix :" << path;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            std::vector<std::string> arrObs, arrVar;
+            std::string error = ReadMatrixNames(file, path, arrObs, arrVar);
+            if(error.empty() == false) {
+                Close(file);
+                ::Rf_error(error.c_str());
+            }
+
+            std::vector<unsigned int> arrCells(cells);
+            if(arrCells.size() == 0) {
+                arrCells.resize(arrObs.size());
+                for(unsigned int c = 0; c < arrCells.size(); c++) {
+                    arrCells[c] = c;
+                }
+            }
+
+            for(const unsigned int &c : arrCells) {
+                if(c >= arrObs.size()) {
+                    std::stringstream ostr;
+                    ostr << "Cell index out of range :" << (c + 1);
+                    ::Rf_error(ostr.str().c_str());
+                    Close(file);
+                    throw;
+                }
+            }
+
+            std::vector<std::string> arrCellNames;
+            arrCellNames.reserve(arrCells.size());
+            for(const unsigned int &c : arrCells) {
+                arrCellNames.push_back(arrObs[c]);
+            }
+
+            if(IsH5Group(file, path) == false) {
+                return ReadDenseCells(file, path, arrVar, arrCells, arrCellNames);
+            }
+
+            HighFive::Group matrix = file->getGroup(path);
+            std::string encoding;
+            if(ReadStringAttribute(matrix.getId(), "encoding-type", encoding) == false) {
+                ReadStringAttribute(matrix.getId(), "h5sparse_format", encoding);
+                encoding += "_matrix";
+            }
+
+            if(encoding == "csr_matrix") {
+                return ReadCSRCells(file, path, arrVar, arrCells, arrCellNames);
+            }
+
+            if(encoding == "csc_matrix") {
+                return ReadCSCCells(file, path, arrObs.size(), arrVar, arrCells, arrCellNames);
+            }
+
+            std::stringstream ostr;
+            ostr << "Unsupported h5ad matrix encoding :" << encoding;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ReadMatrix h5ad format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+        return mat;
+    }
+
+    // Writes a genes x cells dgCMatrix as the csr_matrix X (or layer) plus obs/var indexes
+    void WriteMatrix(HighFive::File *file, const Rcpp::S4 &mat, const std::string &layer) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not write h5ad, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string path = GetMatrixPath(layer);
+        try {
+            if(file->exist(path) == true) {
+                std::stringstream ostr;
+                ostr << "Existing matrix :" << path;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::IntegerVector dims = mat.slot("Dim");
+            Rcpp::List dimnames = mat.slot("Dimnames");
+
+            HighFive::Group matrix = file->createGroup(path);
+            WriteStringAttribute(matrix.getId(), "encoding-type", "csr_matrix");
+            WriteStringAttribute(matrix.getId(), "encoding-version", "0.1.0");
+            WriteIntArrayAttribute(matrix.getId(), "shape", {(long long)dims[1], (long long)dims[0]});
+
+            // The R slots are written as they are: CSC of genes x cells is CSR of cells x genes
+            HighFive::DataSet datasetIndptr = file->createDataSet<int>(path + "/indptr", HighFive::DataSpace({(std::size_t)p.size()}));
+            datasetIndptr.write(p.begin());
+            HighFive::DataSet datasetIndices = file->createDataSet<int>(path + "/indices", HighFive::DataSpace({(std::size_t)i.size()}));
+            if(i.size() > 0) {
+                datasetIndices.write(i.begin());
+            }
+            HighFive::DataSet datasetData = file->createDataSet<double>(path + "/data", HighFive::DataSpace({(std::size_t)x.size()}));
+            if(x.size() > 0) {
+                datasetData.write(x.begin());
+            }
+
+            if(file->exist("obs") == false && Rf_isNull(dimnames[1]) == false) {
+                WriteFrame(file, "obs", Rcpp::as<std::vector<std::string>>(dimnames[1]));
+            }
+            if(file->exist("var") == false && Rf_isNull(dimnames[0]) == false) {
+                WriteFrame(file, "var", Rcpp::as<std::vector<std::string>>(dimnames[0]));
+            }
+
+            WriteStringAttribute(file->getId(), "encoding-type", "anndata");
+            WriteStringAttribute(file->getId(), "encoding-version", "0.1.0");
+            file->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "WriteMatrix h5ad format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+    }
+
+    // Copy a csr_matrix X into the group layout of outFile block by block, no full matrix in memory
+    void ImportToGroup(HighFive::File *file, HighFive::File *outFile, const std::string &groupName, const std::string &layer, const std::size_t &blockSize) {
+        if(file == nullptr || outFile == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not import h5ad, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string path = GetMatrixPath(layer);
+        try {
+            if(outFile->exist(groupName) == true) {
+                std::stringstream ostr;
+                ostr << "Existing group :" << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                Close(outFile);
+                throw;
+            }
+
+            std::string encoding;
+            if(IsH5Group(file, path) == true) {
+                ReadStringAttribute(file->getGroup(path).getId(), "encoding-type", encoding);
+            }
+
+            std::vector<std::string> arrObs, arrVar;
+            std::string error = ReadMatrixNames(file, path, arrObs, arrVar);
+            if(error.empty() == false) {
+                Close(file);
+                Close(outFile);
+                ::Rf_error(error.c_str());
+            }
+
+            if(encoding != "csr_matrix") {
+                // CSC or dense X needs a transpose, go through memory
+                std::vector<unsigned int> arrCells;
+                Rcpp::S4 mat = ReadMatrix(file, layer, arrCells);
+                WriteSpMtFromS4(outFile, mat, groupName);
+                return;
+            }
+
+            std::vector<unsigned int> arrDims = {(unsigned int)arrVar.size(), (unsigned int)arrObs.size()};
+            std::size_t nnz = GetDatasetSize(file, path, "data");
+            outFile->createGroup(groupName);
+            HighFive::DataSet datasetDim = outFile->createDataSet<unsigned int>(groupName + "/shape", HighFive::DataSpace::From(arrDims));
+            datasetDim.write(arrDims);
+
+            std::vector<unsigned int> arrIndptr;
+            ReadDatasetVector<unsigned int>(file, path, "indptr", arrIndptr);
+            HighFive::DataSet datasetIndptr = outFile->createDataSet<unsigned int>(groupName + "/indptr", HighFive::DataSpace::From(arrIndptr));
+            datasetIndptr.write(arrIndptr);
+
+            HighFive::DataSet srcIndices = file->getDataSet(path + "/indices");
+            HighFive::DataSet srcData = file->getDataSet(path + "/data");
+            HighFive::DataSet datasetIndices = outFile->createDataSet<unsigned int>(groupName + "/indices", HighFive::DataSpace({nnz}));
+            HighFive::DataSet datasetData = outFile->createDataSet<double>(groupName + "/data", HighFive::DataSpace({nnz}));
+            // Whole cells per block, so the gene indices of every cell can be sorted
+            std::vector<unsigned int> blockIndices;
+            std::vector<double> blockData;
+            unsigned int n_obs = arrObs.size();
+            for(unsigned int startCell = 0; startCell < n_obs;) {
+                unsigned int endCell = NextColumnBlock(arrIndptr, startCell, n_obs, blockSize);
+                std::size_t start = arrIndptr[startCell];
+                std::size_t count = arrIndptr[endCell] - start;
+                if(count > 0) {
+                    blockIndices.resize(count);
+                    blockData.resize(count);
+                    srcIndices.select({start}, {count}).read(blockIndices.data());
+                    srcData.select({start}, {count}).read(blockData.data());
+                    for(unsigned int c = startCell; c < endCell; c++) {
+                        SortIndexRun(blockIndices.data() + (arrIndptr[c] - start), blockData.data() + (arrIndptr[c] - start),
+                                     arrIndptr[c + 1] - arrIndptr[c]);
+                    }
+                    const unsigned int *indicesData = blockIndices.data();
+                    const double *valuesData = blockData.data();
+                    datasetIndices.select({start}, {count}).write(indicesData);
+                    datasetData.select({start}, {count}).write(valuesData);
+                }
+                startCell = endCell;
+            }
+
+            HighFive::DataSet datasetRowNames = outFile->createDataSet<std::string>(groupName + "/features", HighFive::DataSpace::From(arrVar));
+            datasetRowNames.write(arrVar);
+            HighFive::DataSet datasetColNames = outFile->createDataSet<std::string>(groupName + "/barcodes", HighFive::DataSpace::From(arrObs));
+            datasetColNames.write(arrObs);
+            outFile->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ImportToGroup h5ad format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            Close(outFile);
+            throw;
+        }
+    }
+
+private:
+    // scipy does not require sorted indices within a row of a csr_matrix, dgCMatrix does
+    template <typename I, typename X>
+    static void SortIndexRun(I *indices, X *values, const std::size_t &count) {
+        if(std::is_sorted(indices, indices + count) == true) {
+            return;
+        }
+        std::vector<std::pair<I, X>> run(count);
+        for(std::size_t k = 0; k < count; k++) {
+            run[k] = std::make_pair(indices[k], values[k]);
+        }
+        std::sort(run.begin(), run.end(), [](const std::pair<I, X> &a, const std::pair<I, X> &b) { return a.first < b.first; });
+        for(std::size_t k = 0; k < count; k++) {
+            indices[k] = run[k].first;
+            values[k] = run[k].second;
+        }
+    }
+
+    void WriteFrame(HighFive::File *file, const std::string &frameName, const std::vector<std::string> &names) {
+        HighFive::Group frame = file->createGroup(frameName);
+        WriteStringAttribute(frame.getId(), "encoding-type", "dataframe");
+        WriteStringAttribute(frame.getId(), "encoding-version", "0.2.0");
+        WriteStringAttribute(frame.getId(), "_index", "_index");
+        WriteStringArrayAttribute(frame.getId(), "column-order", std::vector<std::string>());
+
+        HighFive::DataSet datasetIndex = file->createDataSet<std::string>(frameName + "/_index", HighFive::DataSpace::From(names));
+        datasetIndex.write(names);
+        WriteStringAttribute(datasetIndex.getId(), "encoding-type", "string-array");
+        WriteStringAttribute(datasetIndex.getId(), "encoding-version", "0.2.0");
+    }
+
+    // Rows of X are cells, so every requested cell is a contiguous slice of indices/data
+    Rcpp::S4 ReadCSRCells(HighFive::File *file, const std::string &path, const std::vector<std::string> &arrVar,
+                          const std::vector<unsigned int> &arrCells, const std::vector<std::string> &arrCellNames) {
+        std::vector<long long> arrIndptr;
+        ReadDatasetVector<long long>(file, path, "indptr", arrIndptr);
+
+        Rcpp::IntegerVector p(arrCells.size() + 1);
+        for(std::size_t c = 0; c < arrCells.size(); c++) {
+            p[c + 1] = p[c] + (int)(arrIndptr[arrCells[c] + 1] - arrIndptr[arrCells[c]]);
+        }
+
+        Rcpp::IntegerVector i(p[arrCells.size()]);
+        Rcpp::NumericVector x(p[arrCells.size()]);
+        HighFive::DataSet datasetIndices = file->getDataSet(path + "/indices");
+        HighFive::DataSet datasetData = file->getDataSet(path + "/data");
+        std::vector<std::pair<unsigned int, unsigned int>> runs;
+        GetIndexRuns(arrCells, runs);
+
+        std::size_t offset = 0;
+        for(const std::pair<unsigned int, unsigned int> &run : runs) {
+            std::size_t start = arrIndptr[run.first];
+            std::size_t count = arrIndptr[run.second + 1] - start;
+            if(count > 0) {
+                datasetIndices.select({start}, {count}).read(i.begin() + offset);
+                datasetData.select({start}, {count}).read(x.begin() + offset);
+            }
+            offset += count;
+        }
+        for(std::size_t c = 0; c < arrCells.size(); c++) {
+            SortIndexRun(i.begin() + p[c], x.begin() + p[c], p[c + 1] - p[c]);
+        }
+
+        return BuildDgCMatrix(i, p, x, arrVar.size(), arrCells.size(), arrVar, arrCellNames);
+    }
+
+    // Columns of X are genes: read everything, keep requested cells and transpose
+    Rcpp::S4 ReadCSCCells(HighFive::File *file, const std::string &path, const std::size_t &n_obs, const std::vector<std::string> &arrVar,
+                          const std::vector<unsigned int> &arrCells, const std::vector<std::string> &arrCellNames) {
+        std::vector<unsigned int> arrIndptr, arrIndices;
+        std::vector<double> arrData;
+        ReadDatasetVector<unsigned int>(file, path, "indptr", arrIndptr);
+        ReadDatasetVector<unsigned int>(file, path, "indices", arrIndices);
+        ReadDatasetVector<double>(file, path, "data", arrData);
+
+        // Old cell index -> position in the output, -1 when not requested
+        std::vector<int> cellPos(n_obs, -1);
+        for(std::size_t c = 0; c < arrCells.size(); c++) {
+            cellPos[arrCells[c]] = c;
+        }
+
+        std::size_t n_var = arrVar.size();
+        Rcpp::IntegerVector p(arrCells.size() + 1);
+        for(std::size_t k = 0; k < arrIndices.size(); k++) {
+            if(cellPos[arrIndices[k]] >= 0) {
+                p[cellPos[arrIndices[k]] + 1]++;
+            }
+        }
+        for(std::size_t c = 0; c < arrCells.size(); c++) {
+            p[c + 1] += p[c];
+        }
+
+        Rcpp::IntegerVector i(p[arrCells.size()]);
+        Rcpp::NumericVector x(p[arrCells.size()]);
+        std::vector<int> next(p.begin(), p.end() - 1);
+        for(std::size_t g = 0; g < n_var; g++) {
+            for(unsigned int k = arrIndptr[g]; k < arrIndptr[g + 1]; k++) {
+                int c = cellPos[arrIndices[k]];
+                if(c < 0) {
+                    continue;
+                }
+                int pos = next[c]++;
+                i[pos] = g;
+                x[pos] = arrData[k];
+            }
+        }
+
+        return BuildDgCMatrix(i, p, x, n_var, arrCells.size(), arrVar, arrCellNames);
+    }
+
+    // Dense cells x genes X: read runs of cell rows and keep nonzeros
+    Rcpp::S4 ReadDenseCells(HighFive::File *file, const std::string &path, const std::vector<std::string> &arrVar,
+                            const std::vector<unsigned int> &arrCells, const std::vector<std::string> &arrCellNames) {
+        HighFive::DataSet datasetX = file->getDataSet(path);
+        std::size_t n_var = arrVar.size();
+        std::vector<std::pair<unsigned int, unsigned int>> runs;
+        GetIndexRuns(arrCells, runs);
+
+        std::vector<int> p(1, 0);
+        std::vector<int> i;
+        std::vector<double> x;
+        std::vector<double> buffer;
+        for(const std::pair<unsigned int, unsigned int> &run : runs) {
+            std::size_t count = run.second - run.first + 1;
+            buffer.resize(count * n_var);
+            datasetX.select({run.first, 0}, {count, n_var}).read(buffer.data());
+            for(std::size_t c = 0; c < count; c++) {
+                const double *row = buffer.data() + c * n_var;
+                for(std::size_t g = 0; g < n_var; g++) {
+                    if(row[g] != 0) {
+                        i.push_back(g);
+                        x.push_back(row[g]);
+                    }
+                }
+                p.push_back(i.size());
+            }
+        }
+
+        return BuildDgCMatrix(Rcpp::IntegerVector(i.begin(), i.end()), Rcpp::IntegerVector(p.begin(), p.end()),
+                              Rcpp::NumericVector(x.begin(), x.end()), n_var, arrCells.size(), arrVar, arrCellNames);
+    }
+};
+
+// Loom: /matrix and /layers/<name> are dense genes x cells datasets, gene
+// names live in /row_attrs/Gene and cell names in /col_attrs/CellID.
+class LoomUtil : public Hdf5Util {
+public:
+    LoomUtil(const std::string &file_name_) : Hdf5Util(file_name_) {}
+
+    std::string GetMatrixPath(const std::string &layer) {
+        return (layer.size() == 0) ? "matrix" : "layers/" + layer;
+    }
+
+    // cells are 0-based column indices; empty reads every cell
+    Rcpp::S4 ReadMatrix(HighFive::File *file, const std::string &layer, const std::vector<unsigned int> &cells, const std::size_t &blockCells) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read loom, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string path = GetMatrixPath(layer);
+        Rcpp::S4 mat;
+        try {
+            if(file->exist(path) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist matrix :" << path;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            HighFive::DataSet datasetX = file->getDataSet(path);
+            std::vector<std::size_t> dims = datasetX.getSpace().getDimensions();
+            std::size_t n_genes = dims[0];
+            std::size_t n_cells = dims[1];
+
+            std::vector<std::string> arrGenes, arrCellIds;
+            ReadAttrNames(file, "row_attrs", "Gene", n_genes, "g", arrGenes);
+            ReadAttrNames(file, "col_attrs", "CellID", n_cells, "c", arrCellIds);
+
+            std::vector<unsigned int> arrCells(cells);
+            if(arrCells.size() == 0) {
+                arrCells.resize(n_cells);
+                for(unsigned int c = 0; c < n_cells; c++) {
+                    arrCells[c] = c;
+                }
+            }
+
+            std::vector<std::string> arrCellNames;
+            arrCellNames.reserve(arrCells.size());
+            for(const unsigned int &c : arrCells) {
+                if(c >= n_cells) {
+                    std::stringstream ostr;
+                    ostr << "Cell index out of range :" << (c + 1);
+                    ::Rf_error(ostr.str().c_str());
+                    Close(file);
+                    throw;
+                }
+                arrCellNames.push_back(arrCellIds[c]);
+            }
+
+            // Split long runs so one hyperslab stays within genes x blockCells values
+            std::vector<std::pair<unsigned int, unsigned int>> runs, blocks;
+            GetIndexRuns(arrCells, runs);
+            for(const std::pair<unsigned int, unsigned int> &run : runs) {
+                for(std::size_t first = run.first; first <= run.second; first += blockCells) {
+                    blocks.push_back(std::make_pair(first, std::min<std::size_t>(run.second, first + blockCells - 1)));
+                }
+            }
+
+            std::vector<int> p(1, 0);
+            std::vector<int> i;
+            std::vector<double> x;
+            std::vector<double> buffer;
+            for(const std::pair<unsigned int, unsigned int> &block : blocks) {
+                std::size_t count = block.second - block.first + 1;
+                buffer.resize(n_genes * count);
+                if(n_genes > 0) {
+                    datasetX.select({0, block.first}, {n_genes, count}).read(buffer.data());
+                }
+                for(std::size_t c = 0; c < count; c++) {
+                    for(std::size_t g = 0; g < n_genes; g++) {
+                        double value = buffer[g * count + c];
+                        if(value != 0) {
+                            i.push_back(g);
+                            x.push_back(value);
+                        }
+                    }
+                    p.push_back(i.size());
+                }
+            }
+
+            return BuildDgCMatrix(Rcpp::IntegerVector(i.begin(), i.end()), Rcpp::IntegerVector(p.begin(), p.end()),
+                                  Rcpp::NumericVector(x.begin(), x.end()), n_genes, arrCells.size(), arrGenes, arrCellNames);
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ReadMatrix loom format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+        return mat;
+    }
+
+    // Writes a genes x cells dgCMatrix densely, blockCells columns at a time
+    void WriteMatrix(HighFive::File *file, const Rcpp::S4 &mat, const std::string &layer, const std::size_t &blockCells) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not write loom, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string path = GetMatrixPath(layer);
+        try {
+            if(file->exist(path) == true) {
+                std::stringstream ostr;
+                ostr << "Existing matrix :" << path;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::IntegerVector dims = mat.slot("Dim");
+            Rcpp::List dimnames = mat.slot("Dimnames");
+            std::size_t n_genes = dims[0];
+            std::size_t n_cells = dims[1];
+
+            if(layer.size() > 0 && file->exist("layers") == false) {
+                file->createGroup("layers");
+            }
+
+            // HDF5 rejects chunks with a zero dimension, so an empty matrix is stored contiguous
+            HighFive::DataSetCreateProps props;
+            if(n_genes > 0 && n_cells > 0) {
+                props.add(HighFive::Chunking(std::vector<hsize_t>{std::min<hsize_t>(n_genes, 64), std::min<hsize_t>(n_cells, 64)}));
+                props.add(HighFive::Deflate(2));
+            }
+            HighFive::DataSet datasetX = file->createDataSet<double>(path, HighFive::DataSpace({n_genes, n_cells}), props);
+
+            std::vector<double> buffer;
+            for(std::size_t first = 0; n_genes > 0 && first < n_cells; first += blockCells) {
+                std::size_t count = std::min(blockCells, n_cells - first);
+                buffer.assign(n_genes * count, 0);
+                for(std::size_t c = 0; c < count; c++) {
+                    for(int k = p[first + c]; k < p[first + c + 1]; k++) {
+                        buffer[(std::size_t)i[k] * count + c] = x[k];
+                    }
+                }
+                datasetX.select({0, first}, {n_genes, count}).write(buffer.data());
+            }
+
+            if(layer.size() == 0) {
+                WriteAttrNames(file, "row_attrs", "Gene", dimnames[0], n_genes, "g");
+                WriteAttrNames(file, "col_attrs", "CellID", dimnames[1], n_cells, "c");
+                WriteStringAttribute(file->getId(), "LOOM_SPEC_VERSION", "3.0.0");
+                if(file->exist("layers") == false) {
+                    file->createGroup("layers");
+                }
+                if(file->exist("row_graphs") == false) {
+                    file->createGroup("row_graphs");
+                }
+                if(file->exist("col_graphs") == false) {
+                    file->createGroup("col_graphs");
+                }
+            }
+            file->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "WriteMatrix loom format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+    }
+
+private:
+    void ReadAttrNames(HighFive::File *file, const std::string &groupName, const std::string &attrName, const std::size_t &n, const std::string &prefix, std::vector<std::string> &names) {
+        if(file->exist(groupName + "/" + attrName) == true) {
+            ReadDatasetVector(file, groupName, attrName, names);
+            return;
+        }
+
+        names.resize(n);
+        for(std::size_t k = 0; k < n; k++) {
+            names[k] = prefix + std::to_string(k + 1);
+        }
+    }
+
+    void WriteAttrNames(HighFive::File *file, const std::string &groupName, const std::string &attrName, SEXP dimnames, const std::size_t &n, const std::string &prefix) {
+        std::vector<std::string> names;
+        if(Rf_isNull(dimnames) == false) {
+            names = Rcpp::as<std::vector<std::string>>(dimnames);
+        } else {
+            names.resize(n);
+            for(std::size_t k = 0; k < n; k++) {
+                names[k] = prefix + std::to_string(k + 1);
+            }
+        }
+
+        if(file->exist(groupName) == false) {
+            file->createGroup(groupName);
+        }
+        HighFive::DataSet datasetNames = file->createDataSet<std::string>(groupName + "/" + attrName, HighFive::DataSpace::From(names));
+        datasetNames.write(names);
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+#endif //H5_FORMAT_UTIL
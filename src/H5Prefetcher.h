@@ -0,0 +1,224 @@
+#ifndef H5_PREFETCHER
+#define H5_PREFETCHER
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <highfive/H5File.hpp>
+
+namespace com {
+namespace bioturing {
+
+// The HDF5 library shipped by Rhdf5lib is not built thread-safe: every call
+// made while a prefetcher is running must hold this mutex.
+inline std::mutex &GetH5LibraryMutex() {
+    static std::mutex h5Mutex;
+    return h5Mutex;
+}
+
+// A run of consecutive columns of a CSC group. p is rebased so that p[0] == 0
+// and the columns are [col_start, col_start + n_cols).
+struct H5ColumnBlock {
+    std::size_t col_start;
+    std::size_t n_cols;
+    std::vector<unsigned int> p;
+    std::vector<unsigned int> i;
+    std::vector<double> x;
+};
+
+// Reads the columns of a CSC group on a dedicated I/O thread. At most queueSize
+// blocks of about blockEntries nonzeros wait in the queue, so with the default
+// of two the next block is read and decompressed while the caller works on the
+// current one. Blocks handed back by Next() are recycled; a caller passing an
+// empty block each time only costs new allocations. The caller must not touch
+// the file until Stop(). Start() and Next() report HDF5 errors as
+// std::runtime_error and leave the file open: the caller closes it.
+class H5Prefetcher {
+public:
+    H5Prefetcher(HighFive::File *file_, const std::string &groupName_, const std::size_t &blockEntries_,
+                 const std::size_t &queueSize_ = 2) {
+        file = file_;
+        groupName = groupName_;
+        blockEntries = std::max<std::size_t>(blockEntries_, 1);
+        queueSize = std::max<std::size_t>(queueSize_, 1);
+        n_rows = 0;
+        n_cols = 0;
+        col_offset = 0;
+        stopping = false;
+        finished = false;
+    }
+
+    ~H5Prefetcher() {
+        Stop();
+    }
+
+    // Read shape and indptr of [colBegin, colEnd) on the calling thread, plan
+    // the blocks and start the I/O thread. colEnd = 0 means every column.
+    void Start(std::size_t colBegin = 0, std::size_t colEnd = 0) {
+        Stop();
+        try {
+            std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+            std::vector<unsigned int> shape;
+            file->getDataSet(groupName + "/shape").read(shape);
+            if(shape.size() != 2) {
+                throw std::runtime_error("shape of " + groupName + " must have 2 entries");
+            }
+            n_rows = shape[0];
+            n_cols = shape[1];
+            if(colEnd == 0 || colEnd > n_cols) {
+                colEnd = n_cols;
+            }
+            colBegin = std::min(colBegin, colEnd);
+            file->getDataSet(groupName + "/indptr").select({colBegin}, {colEnd - colBegin + 1}).read(indptr);
+        } catch (std::exception& err) {
+            throw std::runtime_error(std::string("H5Prefetcher HDF5 format, error=") + err.what());
+        }
+
+        col_offset = colBegin;
+        blockStarts.clear();
+        for(std::size_t c = 0; c < indptr.size() - 1; ) {
+            blockStarts.push_back(c);
+            std::size_t end = c + 1;
+            while(end < indptr.size() - 1 && indptr[end + 1] - indptr[c] <= blockEntries) {
+                end++;
+            }
+            c = end;
+        }
+        blockStarts.push_back(indptr.size() - 1);
+
+        ready.clear();
+        pool.clear();
+        error.clear();
+        stopping = false;
+        finished = blockStarts.size() == 1;
+        if(finished == false) {
+            worker = std::thread(&H5Prefetcher::Run, this);
+        }
+    }
+
+    // Wait for the next block and swap it into block; the previous contents
+    // of block, if any, go back to the pool. Returns false once every block was consumed.
+    bool Next(H5ColumnBlock &block) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(block.p.capacity() > 0) {
+            pool.push_back(H5ColumnBlock());
+            std::swap(pool.back(), block);
+            cond.notify_all();
+        }
+
+        cond.wait(lock, [this] { return ready.empty() == false || finished || error.empty() == false; });
+        if(error.empty() == false) {
+            std::string message = error;
+            lock.unlock();
+            Stop();
+            throw std::runtime_error(message);
+        }
+
+        if(ready.empty() == true) {
+            return false;
+        }
+
+        std::swap(block, ready.front());
+        ready.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        if(worker.joinable() == true) {
+            worker.join();
+        }
+    }
+
+    std::size_t GetNumRows() const { return n_rows; }
+    std::size_t GetNumCols() const { return n_cols; }
+
+private:
+    void Run() {
+        std::size_t nBlocks = blockStarts.size() - 1;
+        for(std::size_t b = 0; b < nBlocks; b++) {
+            H5ColumnBlock block;
+            {
+                // Bounded by the blocks waiting in the queue, not by the pool: a caller that
+                // keeps the blocks it got does not starve the reader
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return stopping || ready.size() < queueSize; });
+                if(stopping == true) {
+                    return;
+                }
+                if(pool.empty() == false) {
+                    std::swap(block, pool.back());
+                    pool.pop_back();
+                }
+            }
+
+            std::size_t c0 = blockStarts[b];
+            std::size_t c1 = blockStarts[b + 1];
+            std::size_t start = indptr[c0];
+            std::size_t count = indptr[c1] - start;
+            block.col_start = col_offset + c0;
+            block.n_cols = c1 - c0;
+            block.p.resize(block.n_cols + 1);
+            for(std::size_t c = c0; c <= c1; c++) {
+                block.p[c - c0] = indptr[c] - start;
+            }
+            block.i.resize(count);
+            block.x.resize(count);
+
+            try {
+                if(count > 0) {
+                    std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+                    file->getDataSet(groupName + "/indices").select({start}, {count}).read(block.i.data());
+                    file->getDataSet(groupName + "/data").select({start}, {count}).read(block.x.data());
+                }
+            } catch (std::exception& err) {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = std::string("H5Prefetcher HDF5 format, error=") + err.what();
+                cond.notify_all();
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(H5ColumnBlock());
+            std::swap(ready.back(), block);
+            if(b + 1 == nBlocks) {
+                finished = true;
+            }
+            cond.notify_all();
+        }
+    }
+
+    HighFive::File *file;
+    std::string groupName;
+    std::size_t blockEntries;
+    std::size_t queueSize;
+    std::size_t n_rows;
+    std::size_t n_cols;
+    std::size_t col_offset;
+    std::vector<unsigned int> indptr;
+    std::vector<std::size_t> blockStarts;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<H5ColumnBlock> ready;
+    std::vector<H5ColumnBlock> pool;
+    std::string error;
+    bool stopping;
+    bool finished;
+};
+
+} // namespace bioturing
+} // namespace com
+
+#endif //H5_PREFETCHER
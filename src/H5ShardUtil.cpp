@@ -0,0 +1,112 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "H5ShardUtil.h"
+
+std::size_t GetShardThreads(const int &nThreads) {
+    if(nThreads > 0) {
+        return nThreads;
+    }
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+//' ShardH5
+//'
+//' Split a sparse matrix group into shard files of contiguous cell ranges plus a manifest
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group)
+//' @param manifestPath A string (HDF5 path of the manifest; shards are written next to it as
+//'        <manifest>.<outGroupName>.shard<k>.h5 and existing files are never overwritten)
+//' @param nShards Number of shards
+//' @param outGroupName Group name in the manifest and shard files. Default "bioturing"
+//' @export
+// [[Rcpp::export]]
+void ShardH5(const std::string &filePath, const std::string &groupName, const std::string &manifestPath, const int &nShards,
+             const std::string &outGroupName = "bioturing") {
+    if(nShards < 1) {
+        ::Rf_error("nShards must be positive");
+    }
+
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(manifestPath == filePath ? -1 : 1);
+    com::bioturing::H5ShardUtil oH5ShardUtil(manifestPath);
+    HighFive::File *manifest = (manifestPath == filePath) ? file : oH5ShardUtil.Open(-1);
+    oH5ShardUtil.WriteShards(file, groupName, manifest, outGroupName, nShards, 1 << 22);
+    if(manifest != file) {
+        oH5ShardUtil.Close(manifest);
+    }
+    oHdf5Util.Close(file);
+}
+
+//' ReadShardedH5
+//'
+//' Read a sharded matrix (or some of its shards) as a dgCMatrix, shards being read concurrently
+//'
+//' @param manifestPath A string (HDF5 path of the manifest)
+//' @param groupName A string (HDF5 group). Default "bioturing"
+//' @param shards 1-based shard indices to read. Default reads every shard
+//' @param nThreads Number of threads. Default 0 uses every core
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ReadShardedH5(const std::string &manifestPath, const std::string &groupName = "bioturing",
+                       const Rcpp::IntegerVector &shards = Rcpp::IntegerVector(0), const int &nThreads = 0) {
+    com::bioturing::H5ShardUtil oH5ShardUtil(manifestPath);
+    HighFive::File *manifest = oH5ShardUtil.Open(1);
+    if(manifest == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open manifest file :" << manifestPath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::vector<std::size_t> selected;
+    if(shards.size() == 0) {
+        std::size_t nShards = oH5ShardUtil.GetDatasetSize(manifest, groupName, "shard_files");
+        for(std::size_t k = 0; k < nShards; k++) {
+            selected.push_back(k);
+        }
+    }
+    for(const int &shard : shards) {
+        if(shard < 1) {
+            oH5ShardUtil.Close(manifest);
+            ::Rf_error("Shard indices must be positive");
+        }
+        selected.push_back(shard - 1);
+    }
+
+    Rcpp::S4 mat = oH5ShardUtil.ReadMatrix(manifest, groupName, selected, GetShardThreads(nThreads));
+    oH5ShardUtil.Close(manifest);
+    return mat;
+}
+
+//' ReadShardedSums
+//'
+//' Row or column sums of a sharded matrix, shards being scanned concurrently
+//'
+//' @param manifestPath A string (HDF5 path of the manifest)
+//' @param groupName A string (HDF5 group). Default "bioturing"
+//' @param margin 1 for row sums, 2 for column sums
+//' @param nThreads Number of threads. Default 0 uses every core
+//' @export
+// [[Rcpp::export]]
+Rcpp::NumericVector ReadShardedSums(const std::string &manifestPath, const std::string &groupName = "bioturing", const int &margin = 2,
+                                    const int &nThreads = 0) {
+    com::bioturing::H5ShardUtil oH5ShardUtil(manifestPath);
+    HighFive::File *manifest = oH5ShardUtil.Open(1);
+    if(manifest == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open manifest file :" << manifestPath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::vector<double> sumVec;
+    oH5ShardUtil.ReadSums(manifest, groupName, margin, GetShardThreads(nThreads), 1 << 22, sumVec);
+    oH5ShardUtil.Close(manifest);
+    return Rcpp::wrap(sumVec);
+}
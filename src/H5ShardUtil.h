@@ -0,0 +1,446 @@
+#ifndef H5_SHARD_UTIL
+#define H5_SHARD_UTIL
+
+#include "Hdf5Util.h"
+#include <atomic>
+
+namespace com {
+namespace bioturing {
+
+// One shard of a sharded matrix: columns [col_start, col_start + n_cols) and
+// nonzeros [nnz_start, nnz_start + nnz) of the global CSC
+struct ShardInfo {
+    std::string path;
+    std::size_t col_start;
+    std::size_t n_cols;
+    std::size_t nnz_start;
+    std::size_t nnz;
+};
+
+// Column reader for one shard file. When indices and data are contiguous,
+// unfiltered native arrays their bytes are read straight from the file with a
+// private stream, so shards are scanned in parallel without taking the HDF5
+// mutex; other layouts fall back to HDF5 reads under the mutex.
+class ShardColumnReader {
+public:
+    ShardColumnReader(const std::string &path_, const std::string &groupName_) {
+        path = path_;
+        groupName = groupName_;
+        file = nullptr;
+        raw = false;
+        offsetI = 0;
+        offsetX = 0;
+    }
+
+    ~ShardColumnReader() {
+        Close();
+    }
+
+    // Throws std::runtime_error; safe to call from any thread
+    void Open() {
+        std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+        try {
+            file = new HighFive::File(path, HighFive::File::ReadOnly);
+            file->getDataSet(groupName + "/indptr").read(indptr);
+
+            HighFive::DataSet datasetI = file->getDataSet(groupName + "/indices");
+            HighFive::DataSet datasetX = file->getDataSet(groupName + "/data");
+            haddr_t addrI = H5Dget_offset(datasetI.getId());
+            haddr_t addrX = H5Dget_offset(datasetX.getId());
+            hid_t typeI = H5Dget_type(datasetI.getId());
+            hid_t typeX = H5Dget_type(datasetX.getId());
+            bool nativeI = (H5Tequal(typeI, H5T_NATIVE_UINT) > 0) || (H5Tequal(typeI, H5T_NATIVE_INT) > 0);
+            bool nativeX = H5Tequal(typeX, H5T_NATIVE_DOUBLE) > 0;
+            H5Tclose(typeI);
+            H5Tclose(typeX);
+
+            raw = nativeI && nativeX && addrI != HADDR_UNDEF && addrX != HADDR_UNDEF;
+            if(raw == true) {
+                offsetI = addrI;
+                offsetX = addrX;
+                stream.open(path, std::ios::binary);
+                raw = stream.good();
+            }
+        } catch (HighFive::Exception& err) {
+            throw std::runtime_error(std::string("ShardColumnReader HDF5 format, file=") + path + ", error=" + err.what());
+        }
+    }
+
+    void Read(const std::size_t &start, const std::size_t &count, unsigned int *i, double *x) {
+        if(count == 0) {
+            return;
+        }
+
+        if(raw == true) {
+            stream.seekg(offsetI + start * sizeof(unsigned int));
+            stream.read(reinterpret_cast<char*>(i), count * sizeof(unsigned int));
+            stream.seekg(offsetX + start * sizeof(double));
+            stream.read(reinterpret_cast<char*>(x), count * sizeof(double));
+            if(stream.good() == false) {
+                throw std::runtime_error("ShardColumnReader can not read " + path);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+        try {
+            file->getDataSet(groupName + "/indices").select({start}, {count}).read(i);
+            file->getDataSet(groupName + "/data").select({start}, {count}).read(x);
+        } catch (HighFive::Exception& err) {
+            throw std::runtime_error(std::string("ShardColumnReader HDF5 format, file=") + path + ", error=" + err.what());
+        }
+    }
+
+    void Close() {
+        if(stream.is_open() == true) {
+            stream.close();
+        }
+        if(file != nullptr) {
+            std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+            delete file;
+            file = nullptr;
+        }
+    }
+
+    std::vector<unsigned int> indptr;
+
+private:
+    std::string path;
+    std::string groupName;
+    HighFive::File *file;
+    std::ifstream stream;
+    bool raw;
+    uint64_t offsetI;
+    uint64_t offsetX;
+};
+
+// Sharded layout: the manifest file holds <group>/shape, features, shard_files
+// (relative to the manifest), shard_cols and shard_nnz (global column and
+// nonzero offsets, N + 1 each). Shard k is a regular group of its own file
+// holding a contiguous range of cells, so shards can also be opened alone.
+class H5ShardUtil : public Hdf5Util {
+public:
+    H5ShardUtil(const std::string &file_name_) : Hdf5Util(file_name_) {}
+
+    // Split a group into nShards files of about equal nnz, streaming it block by block
+    void WriteShards(HighFive::File *file, const std::string &groupName, HighFive::File *manifest, const std::string &outGroupName,
+                     const std::size_t &nShards, const std::size_t &blockEntries) {
+        if(manifest->exist(outGroupName) == true) {
+            std::stringstream ostr;
+            ostr << "Existing group :" << outGroupName;
+            CloseFiles(file, manifest);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        // Shard files are never overwritten: they may belong to another group or manifest
+        for(std::size_t k = 0; k < nShards; k++) {
+            std::string shardPath = GetManifestDir() + GetShardFileName(outGroupName, k);
+            if(CheckFileExist(shardPath) == true) {
+                std::stringstream ostr;
+                ostr << "Existing shard file :" << shardPath;
+                CloseFiles(file, manifest);
+                ::Rf_error(ostr.str().c_str());
+                throw;
+            }
+        }
+
+        std::vector<std::string> shardFiles;
+        try {
+            std::vector<unsigned int> arrDims;
+            ReadDatasetVector<unsigned int>(file, groupName, "shape", arrDims);
+            std::vector<unsigned int> arrP;
+            ReadDatasetVector<unsigned int>(file, groupName, "indptr", arrP);
+            std::size_t n_cols = arrDims[1];
+            std::size_t nnz = arrP[n_cols];
+
+            // Cut where the running nnz passes each multiple of nnz / nShards
+            std::vector<unsigned int> shardCols(1, 0);
+            for(std::size_t k = 1; k < nShards; k++) {
+                std::size_t target = nnz * k / nShards;
+                std::size_t col = std::lower_bound(arrP.begin(), arrP.end(), target) - arrP.begin();
+                col = std::max<std::size_t>(std::min(col, n_cols), shardCols.back());
+                shardCols.push_back(col);
+            }
+            shardCols.push_back(n_cols);
+
+            H5StringPool oFeaturePool;
+            oFeaturePool.Read(file->getDataSet(groupName + "/" + GetFeatureSlot(file, groupName)));
+            std::vector<std::string> arrFeatures(oFeaturePool.size());
+            for(std::size_t r = 0; r < oFeaturePool.size(); r++) {
+                arrFeatures[r] = oFeaturePool.Get(r);
+            }
+            H5StringPool oBarcodePool;
+            if(file->exist(groupName + "/barcodes") == true) {
+                oBarcodePool.Read(file->getDataSet(groupName + "/barcodes"));
+            }
+
+            std::vector<unsigned int> shardNnz(1, 0);
+            for(std::size_t k = 0; k < nShards; k++) {
+                std::size_t c0 = shardCols[k];
+                std::size_t c1 = shardCols[k + 1];
+                std::string shardName = GetShardFileName(outGroupName, k);
+                shardNnz.push_back(arrP[c1]);
+
+                HighFive::File shardFile(GetManifestDir() + shardName, HighFive::File::Excl);
+                shardFiles.push_back(shardName);
+                shardFile.createGroup(outGroupName);
+
+                std::vector<unsigned int> shardDims = {arrDims[0], (unsigned int)(c1 - c0)};
+                WriteDatasetFromPtr<unsigned int>(&shardFile, outGroupName + "/shape", shardDims.data(), shardDims.size());
+                std::vector<unsigned int> shardP(arrP.begin() + c0, arrP.begin() + c1 + 1);
+                for(unsigned int &ptr : shardP) {
+                    ptr -= arrP[c0];
+                }
+                WriteDatasetFromPtr<unsigned int>(&shardFile, outGroupName + "/indptr", shardP.data(), shardP.size());
+
+                // Contiguous, unfiltered indices/data so ShardColumnReader can read them raw
+                std::size_t shardEntries = arrP[c1] - arrP[c0];
+                HighFive::DataSet datasetI = shardFile.createDataSet<unsigned int>(outGroupName + "/indices", HighFive::DataSpace(std::vector<size_t>{shardEntries}));
+                HighFive::DataSet datasetX = shardFile.createDataSet<double>(outGroupName + "/data", HighFive::DataSpace(std::vector<size_t>{shardEntries}));
+                if(c1 > c0) {
+                    H5Prefetcher oH5Prefetcher(file, groupName, blockEntries);
+                    oH5Prefetcher.Start(c0, c1);
+                    H5ColumnBlock block;
+                    while(oH5Prefetcher.Next(block) == true) {
+                        if(block.i.size() == 0) {
+                            continue;
+                        }
+                        std::size_t offset = arrP[block.col_start] - arrP[c0];
+                        std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+                        datasetI.select({offset}, {block.i.size()}).write(block.i.data());
+                        datasetX.select({offset}, {block.x.size()}).write(block.x.data());
+                    }
+                }
+
+                HighFive::DataSet datasetRowNames = shardFile.createDataSet<std::string>(outGroupName + "/features", HighFive::DataSpace::From(arrFeatures));
+                datasetRowNames.write(arrFeatures);
+                std::vector<std::string> arrColNames(c1 - c0);
+                for(std::size_t c = c0; c < c1; c++) {
+                    arrColNames[c - c0] = oBarcodePool.size() > 0 ? oBarcodePool.Get(c) : "col";
+                }
+                HighFive::DataSet datasetColNames = shardFile.createDataSet<std::string>(outGroupName + "/barcodes", HighFive::DataSpace::From(arrColNames));
+                datasetColNames.write(arrColNames);
+                shardFile.flush();
+            }
+
+            manifest->createGroup(outGroupName);
+            WriteDatasetFromPtr<unsigned int>(manifest, outGroupName + "/shape", arrDims.data(), arrDims.size());
+            HighFive::DataSet datasetRowNames = manifest->createDataSet<std::string>(outGroupName + "/features", HighFive::DataSpace::From(arrFeatures));
+            datasetRowNames.write(arrFeatures);
+            HighFive::DataSet datasetFiles = manifest->createDataSet<std::string>(outGroupName + "/shard_files", HighFive::DataSpace::From(shardFiles));
+            datasetFiles.write(shardFiles);
+            WriteDatasetFromPtr<unsigned int>(manifest, outGroupName + "/shard_cols", shardCols.data(), shardCols.size());
+            WriteDatasetFromPtr<unsigned int>(manifest, outGroupName + "/shard_nnz", shardNnz.data(), shardNnz.size());
+            manifest->flush();
+        } catch (std::exception& err) {
+            // HighFive errors and prefetcher errors
+            std::stringstream ostr;
+            ostr << "WriteShards HDF5 format, error=" << err.what() ;
+            for(const std::string &shardName : shardFiles) {
+                std::remove((GetManifestDir() + shardName).c_str());
+            }
+            CloseFiles(file, manifest);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+    }
+
+    std::vector<ShardInfo> ReadManifest(HighFive::File *manifest, const std::string &groupName) {
+        std::vector<std::string> shardFiles;
+        ReadDatasetVector(manifest, groupName, "shard_files", shardFiles);
+        std::vector<unsigned int> shardCols;
+        ReadDatasetVector<unsigned int>(manifest, groupName, "shard_cols", shardCols);
+        std::vector<unsigned int> shardNnz;
+        ReadDatasetVector<unsigned int>(manifest, groupName, "shard_nnz", shardNnz);
+
+        std::vector<ShardInfo> shards(shardFiles.size());
+        for(std::size_t k = 0; k < shards.size(); k++) {
+            shards[k].path = GetManifestDir() + shardFiles[k];
+            shards[k].col_start = shardCols[k];
+            shards[k].n_cols = shardCols[k + 1] - shardCols[k];
+            shards[k].nnz_start = shardNnz[k];
+            shards[k].nnz = shardNnz[k + 1] - shardNnz[k];
+        }
+        return shards;
+    }
+
+    // Run visit(shard, reader) for every shard on up to nThreads threads. visit must not call the R API.
+    // The manifest is closed before a shard error is raised.
+    template <typename F>
+    void ScanShards(HighFive::File *manifest, const std::vector<ShardInfo> &shards, const std::string &groupName, const std::size_t &nThreads, F visit) {
+        std::atomic<std::size_t> nextShard(0);
+        std::mutex errorMutex;
+        std::string error;
+        auto run = [&]() {
+            for(std::size_t k = nextShard++; k < shards.size(); k = nextShard++) {
+                try {
+                    ShardColumnReader reader(shards[k].path, groupName);
+                    reader.Open();
+                    visit(shards[k], reader);
+                } catch (std::exception& err) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    error = err.what();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for(std::size_t t = 1; t < std::min(nThreads, shards.size()); t++) {
+            workers.push_back(std::thread(run));
+        }
+        run();
+        for(std::thread &worker : workers) {
+            worker.join();
+        }
+
+        if(error.size() > 0) {
+            Close(manifest);
+            ::Rf_error(error.c_str());
+        }
+    }
+
+    // Whole matrix or the selected shards, each shard read concurrently into its slice of the R vectors
+    Rcpp::S4 ReadMatrix(HighFive::File *manifest, const std::string &groupName, const std::vector<std::size_t> &selected, const std::size_t &nThreads) {
+        std::vector<ShardInfo> allShards = ReadManifest(manifest, groupName);
+        std::vector<ShardInfo> shards;
+        for(const std::size_t &k : selected) {
+            if(k >= allShards.size()) {
+                Close(manifest);
+                ::Rf_error("Shard index out of range");
+            }
+            shards.push_back(allShards[k]);
+        }
+
+        // Rebase the selected shards onto the output matrix
+        std::size_t n_cols = 0;
+        std::size_t nnz = 0;
+        for(ShardInfo &shard : shards) {
+            shard.col_start = n_cols;
+            shard.nnz_start = nnz;
+            n_cols += shard.n_cols;
+            nnz += shard.nnz;
+        }
+
+        std::vector<unsigned int> arrDims;
+        ReadDatasetVector<unsigned int>(manifest, groupName, "shape", arrDims);
+        Rcpp::IntegerVector p(n_cols + 1);
+        Rcpp::IntegerVector i(nnz);
+        Rcpp::NumericVector x(nnz);
+        int *pPtr = p.begin();
+        unsigned int *iPtr = reinterpret_cast<unsigned int*>(i.begin());
+        double *xPtr = x.begin();
+        ScanShards(manifest, shards, groupName, nThreads, [&](const ShardInfo &shard, ShardColumnReader &reader) {
+            reader.Read(0, shard.nnz, iPtr + shard.nnz_start, xPtr + shard.nnz_start);
+            for(std::size_t c = 0; c < shard.n_cols; c++) {
+                pPtr[shard.col_start + c + 1] = shard.nnz_start + reader.indptr[c + 1];
+            }
+        });
+
+        Rcpp::CharacterVector colNames(n_cols);
+        H5StringPool oFeaturePool;
+        try {
+            for(const ShardInfo &shard : shards) {
+                HighFive::File shardFile(shard.path, HighFive::File::ReadOnly);
+                H5StringPool oBarcodePool;
+                oBarcodePool.Read(shardFile.getDataSet(groupName + "/barcodes"));
+                Rcpp::CharacterVector names = oBarcodePool.ToCharacterVector();
+                std::copy(names.begin(), names.end(), colNames.begin() + shard.col_start);
+            }
+            oFeaturePool.Read(manifest->getDataSet(groupName + "/features"));
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ReadShardedH5 HDF5 format, error=" << err.what() ;
+            Close(manifest);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string klass = "dgCMatrix";
+        Rcpp::S4 s(klass);
+        s.slot("i") = i;
+        s.slot("p") = p;
+        s.slot("x") = x;
+        s.slot("Dim") = Rcpp::IntegerVector::create(arrDims[0], n_cols);
+        s.slot("Dimnames") = Rcpp::List::create(oFeaturePool.ToCharacterVector(), colNames);
+        return s;
+    }
+
+    // Row (margin 1) or column (margin 2) sums, shards scanned concurrently block by block
+    void ReadSums(HighFive::File *manifest, const std::string &groupName, const int &margin, const std::size_t &nThreads,
+                  const std::size_t &blockEntries, std::vector<double> &sumVec) {
+        std::vector<unsigned int> arrDims;
+        ReadDatasetVector<unsigned int>(manifest, groupName, "shape", arrDims);
+        std::vector<ShardInfo> shards = ReadManifest(manifest, groupName);
+        std::vector<std::vector<double>> shardSums(shards.size());
+
+        ScanShards(manifest, shards, groupName, nThreads, [&](const ShardInfo &shard, ShardColumnReader &reader) {
+            std::size_t k = &shard - shards.data();
+            std::vector<double> &sums = shardSums[k];
+            sums.assign(margin == 1 ? arrDims[0] : shard.n_cols, 0);
+
+            std::vector<unsigned int> blockI;
+            std::vector<double> blockX;
+            for(std::size_t c0 = 0; c0 < shard.n_cols; ) {
+                std::size_t c1 = c0 + 1;
+                while(c1 < shard.n_cols && reader.indptr[c1 + 1] - reader.indptr[c0] <= blockEntries) {
+                    c1++;
+                }
+
+                std::size_t start = reader.indptr[c0];
+                std::size_t count = reader.indptr[c1] - start;
+                blockI.resize(count);
+                blockX.resize(count);
+                reader.Read(start, count, blockI.data(), blockX.data());
+                for(std::size_t c = c0; c < c1; c++) {
+                    for(std::size_t e = reader.indptr[c]; e < reader.indptr[c + 1]; e++) {
+                        sums[margin == 1 ? blockI[e - start] : c] += blockX[e - start];
+                    }
+                }
+                c0 = c1;
+            }
+        });
+
+        sumVec.assign(margin == 1 ? arrDims[0] : arrDims[1], 0);
+        for(std::size_t k = 0; k < shards.size(); k++) {
+            for(std::size_t e = 0; e < shardSums[k].size(); e++) {
+                sumVec[margin == 1 ? e : shards[k].col_start + e] += shardSums[k][e];
+            }
+        }
+    }
+
+private:
+    std::string GetManifestDir() {
+        std::size_t pos = file_name.find_last_of("/\\");
+        return (pos == std::string::npos) ? "" : file_name.substr(0, pos + 1);
+    }
+
+    // <manifest base>.<group>.shard<k>.h5, so groups of one manifest never share shard files
+    std::string GetShardFileName(const std::string &groupName, const std::size_t &k) {
+        std::size_t pos = file_name.find_last_of("/\\");
+        std::string base = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
+        std::size_t dot = base.find_last_of('.');
+        if(dot != std::string::npos && dot > 0) {
+            base = base.substr(0, dot);
+        }
+        std::string group = groupName;
+        for(char &ch : group) {
+            if(std::isalnum((unsigned char)ch) == 0 && ch != '-' && ch != '_') {
+                ch = '_';
+            }
+        }
+        return base + "." + group + ".shard" + std::to_string(k) + ".h5";
+    }
+
+    // Source and manifest may be the same file
+    void CloseFiles(HighFive::File *file, HighFive::File *manifest) {
+        if(manifest != file) {
+            Close(manifest);
+        }
+        Close(file);
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+#endif //H5_SHARD_UTIL
@@ -0,0 +1,192 @@
+#ifndef H5_STRING_POOL
+#define H5_STRING_POOL
+
+#include <Rcpp.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <highfive/H5DataSet.hpp>
+#include <H5Cpp.h>
+
+namespace com {
+namespace bioturing {
+
+// All strings of a 1-d HDF5 string dataset (barcodes, features) kept in one
+// contiguous buffer. Fixed-length datasets come in with a single read and no
+// per-string allocation; CHARSXPs are built straight from the buffer, and an
+// open-addressing index maps a name back to its position.
+class H5StringPool {
+public:
+    H5StringPool() {
+        cset = H5T_CSET_ASCII;
+    }
+
+    // Throws HighFive::Exception on HDF5 errors, like the HighFive reads it replaces
+    void Read(const HighFive::DataSet &dataset) {
+        buffer.clear();
+        offsets.clear();
+        lengths.clear();
+        slots.clear();
+
+        std::vector<size_t> dims = dataset.getSpace().getDimensions();
+        std::size_t n = dims.size() > 0 ? dims[0] : 0;
+        hid_t fileType = H5Dget_type(dataset.getId());
+        cset = H5Tget_cset(fileType);
+        bool isVariable = H5Tis_variable_str(fileType) > 0;
+        std::size_t strSize = H5Tget_size(fileType);
+        H5T_str_t strPad = H5Tget_strpad(fileType);
+        H5Tclose(fileType);
+
+        offsets.resize(n);
+        lengths.resize(n);
+        if(n == 0) {
+            return;
+        }
+
+        hid_t memType = H5Tcopy(H5T_C_S1);
+        H5Tset_cset(memType, cset);
+        herr_t status;
+        if(isVariable == false) {
+            H5Tset_size(memType, strSize);
+            H5Tset_strpad(memType, strPad);
+            buffer.resize(n * strSize);
+            status = H5Dread(dataset.getId(), memType, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer.data());
+            if(status >= 0) {
+                for(std::size_t k = 0; k < n; k++) {
+                    const char *str = buffer.data() + k * strSize;
+                    std::size_t len = 0;
+                    while(len < strSize && str[len] != '\0') {
+                        len++;
+                    }
+                    if(strPad == H5T_STR_SPACEPAD) {
+                        while(len > 0 && str[len - 1] == ' ') {
+                            len--;
+                        }
+                    }
+                    offsets[k] = k * strSize;
+                    lengths[k] = len;
+                }
+            }
+        } else {
+            H5Tset_size(memType, H5T_VARIABLE);
+            std::vector<char*> ptrs(n, nullptr);
+            status = H5Dread(dataset.getId(), memType, H5S_ALL, H5S_ALL, H5P_DEFAULT, ptrs.data());
+            if(status >= 0) {
+                std::size_t total = 0;
+                for(std::size_t k = 0; k < n; k++) {
+                    lengths[k] = ptrs[k] == nullptr ? 0 : std::strlen(ptrs[k]);
+                    offsets[k] = total;
+                    total += lengths[k];
+                }
+                buffer.resize(total);
+                for(std::size_t k = 0; k < n; k++) {
+                    std::memcpy(buffer.data() + offsets[k], ptrs[k], lengths[k]);
+                }
+
+                hid_t space = H5Dget_space(dataset.getId());
+                H5Dvlen_reclaim(memType, space, H5P_DEFAULT, ptrs.data());
+                H5Sclose(space);
+            }
+        }
+        H5Tclose(memType);
+
+        if(status < 0) {
+            HighFive::HDF5ErrMapper::ToException<HighFive::DataSetException>("Error reading string dataset");
+        }
+    }
+
+    std::size_t size() const {
+        return offsets.size();
+    }
+
+    const char *GetData(const std::size_t &k) const {
+        return buffer.data() + offsets[k];
+    }
+
+    std::size_t GetLength(const std::size_t &k) const {
+        return lengths[k];
+    }
+
+    std::string Get(const std::size_t &k) const {
+        return std::string(GetData(k), GetLength(k));
+    }
+
+    Rcpp::CharacterVector ToCharacterVector() const {
+        cetype_t encoding = (cset == H5T_CSET_UTF8) ? CE_UTF8 : CE_NATIVE;
+        Rcpp::CharacterVector names(size());
+        for(std::size_t k = 0; k < size(); k++) {
+            SET_STRING_ELT(names, k, ::Rf_mkCharLenCE(GetData(k), (int)GetLength(k), encoding));
+        }
+        return names;
+    }
+
+    // Position of name, or -1. The index is built on first use.
+    long Find(const char *name, const std::size_t &len) {
+        if(slots.size() == 0 && size() > 0) {
+            BuildIndex();
+        }
+        if(slots.size() == 0) {
+            return -1;
+        }
+
+        std::size_t mask = slots.size() - 1;
+        for(std::size_t slot = Hash(name, len) & mask; slots[slot] >= 0; slot = (slot + 1) & mask) {
+            std::size_t k = slots[slot];
+            if(lengths[k] == len && std::memcmp(GetData(k), name, len) == 0) {
+                return k;
+            }
+        }
+        return -1;
+    }
+
+    long Find(const std::string &name) {
+        return Find(name.data(), name.size());
+    }
+
+private:
+    static uint64_t Hash(const char *str, const std::size_t &len) {
+        uint64_t hash = 14695981039346656037ULL;
+        for(std::size_t k = 0; k < len; k++) {
+            hash ^= (unsigned char)str[k];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Load factor <= 0.5; duplicated names keep their first position
+    void BuildIndex() {
+        std::size_t capacity = 1;
+        while(capacity < 2 * size()) {
+            capacity <<= 1;
+        }
+        slots.assign(capacity, -1);
+
+        std::size_t mask = capacity - 1;
+        for(std::size_t k = 0; k < size(); k++) {
+            std::size_t slot = Hash(GetData(k), lengths[k]) & mask;
+            bool duplicated = false;
+            for(; slots[slot] >= 0; slot = (slot + 1) & mask) {
+                std::size_t other = slots[slot];
+                if(lengths[other] == lengths[k] && std::memcmp(GetData(other), GetData(k), lengths[k]) == 0) {
+                    duplicated = true;
+                    break;
+                }
+            }
+            if(duplicated == false) {
+                slots[slot] = k;
+            }
+        }
+    }
+
+    std::vector<char> buffer;
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> lengths;
+    std::vector<long> slots;
+    H5T_cset_t cset;
+};
+
+} // namespace bioturing
+} // namespace com
+
+#endif //H5_STRING_POOL
@@ -23,7 +23,9 @@
 #include "CommonUtil.h"
 #include "SparseMatrixUtil.h"
 #include "Hdf5Util.h"
+#include "H5Prefetcher.h"
 #include "chisq.h"
+#include "MarkerTable.h"
 
 using namespace Rcpp;
 using namespace arma;
@@ -388,9 +390,19 @@ std::vector<struct GeneResult> HarmonyTest(
     return res;
 }
 
+// Gene-major group of a H5 file: the transposed copy of a dual-layout group, or the group itself
+std::string GetGeneMajorGroup(
+        com::bioturing::Hdf5Util &oHdf5Util,
+        HighFive::File *file)
+{
+    std::string tGroupName = oHdf5Util.getTransposedGroupName(GROUP_NAME);
+    return file->exist(tGroupName) ? tGroupName : GROUP_NAME;
+}
+
 std::vector<struct GeneResult> HarmonyTest(
         com::bioturing::Hdf5Util &oHdf5Util,
         HighFive::File *file,
+        const std::string &groupName,
         const Rcpp::NumericVector &cluster,
         const std::array<int, 2> &total_cnt,
         int threshold)
@@ -402,7 +414,7 @@ std::vector<struct GeneResult> HarmonyTest(
             "Maybe the number of cells in one cluster is too small");
 
     std::vector<int> shape;
-    oHdf5Util.ReadDatasetVector<int>(file, GROUP_NAME, "shape", shape);
+    oHdf5Util.ReadDatasetVector<int>(file, groupName, "shape", shape);
 
     int n_genes = shape[1];
 
@@ -412,30 +424,35 @@ std::vector<struct GeneResult> HarmonyTest(
 
     std::vector<struct GeneResult> res(n_genes);
 
-    for (int i = 0; i < n_genes; ++i) {
-        std::vector<int> col_idx;
-        std::vector<double> g_exp;
-        oHdf5Util.ReadGeneExpH5(file, GROUP_NAME, i, col_idx,  g_exp);
-
-        std::vector<std::pair<double, int>> exp(col_idx.size());
-        std::array<int, 2> zero_cnt = {total_cnt[0], total_cnt[1]};
-
-        for (int k = 0; k < col_idx.size(); ++k) {
-            int idx = (int)cluster[col_idx[k]];
-            if (idx) {
-                exp[k] = {g_exp[k], idx - 1};
-                --zero_cnt[idx - 1];
+    // Genes arrive in blocks read on the I/O thread while the previous block is tested
+    com::bioturing::H5Prefetcher oH5Prefetcher(file, groupName, 1 << 22);
+    oH5Prefetcher.Start();
+    com::bioturing::H5ColumnBlock block;
+    while (oH5Prefetcher.Next(block)) {
+        for (std::size_t g = 0; g < block.n_cols; ++g) {
+            int i = block.col_start + g;
+            res[i].gene_id = i + 1;
+
+            std::vector<std::pair<double, int>> exp(block.p[g + 1] - block.p[g]);
+            std::array<int, 2> zero_cnt = {total_cnt[0], total_cnt[1]};
+
+            for (unsigned int k = block.p[g]; k < block.p[g + 1]; ++k) {
+                int idx = (int)cluster[block.i[k]];
+                if (idx) {
+                    exp[k - block.p[g]] = {block.x[k], idx - 1};
+                    --zero_cnt[idx - 1];
+                }
             }
-        }
 
-        ProcessGene(
-            std::move(exp),
-            total_cnt,
-            zero_cnt,
-            thres,
-            0,
-            res[i]
-        );
+            ProcessGene(
+                std::move(exp),
+                total_cnt,
+                zero_cnt,
+                thres,
+                0,
+                res[i]
+            );
+        }
     }
 
     return res;
@@ -445,60 +462,8 @@ DataFrame PostProcess(
         std::vector<struct GeneResult> &res,
         std::vector<std::string> &rownames)
 {
-    int n_gene = res.size();
-    std::vector<std::pair<double,int>> order(n_gene);
-
-    for (int i = 0; i < n_gene; ++i)
-        order[i] = std::make_pair(res[i].log_p_value, i);
-
-    std::sort(order.begin(), order.end());
-
-    std::vector<std::string> g_names(n_gene);
-    std::vector<int> g_id(n_gene);
-
-    std::vector<double> d_score(n_gene), ud_score(n_gene), log2_fc(n_gene);
-    std::vector<double> log10_pv(n_gene), perm_pv(n_gene), log10_adj_pv(n_gene);
-    std::vector<double> b_cnt(n_gene);
-
-    //Adjust p value
-    double prev = -std::numeric_limits<double>::infinity();
-    for(int i = 0; i < n_gene; ++i) {
-        double log_p = order[i].first  + log(n_gene) - log(i + 1);
-
-        if (log_p > 0)
-            log_p = 0;
-
-        if (log_p > prev)
-            prev = log_p;
-
-        log10_adj_pv[i] = prev * M_LOG10E;
-    }
-
-    for(int i = 0; i < n_gene; ++i) {
-        int k = order[i].second;
-
-        g_names[i]  = rownames[k];
-        g_id[i]     = res[k].gene_id;
-        d_score[i]  = res[k].d_score;
-        b_cnt[i]    = res[k].b_cnt;
-        log10_pv[i] = res[k].log_p_value * M_LOG10E;
-        perm_pv[i]  = res[k].perm_p_value;
-        ud_score[i] = res[k].ud_score;
-        log2_fc[i]  = res[k].log_fc * M_LOG2E;
-    }
-
     Rcout << "Done all" << std::endl;
-    return DataFrame::create(
-                    Named("Gene ID")                = wrap(g_id),
-                    Named("Gene Name")              = wrap(g_names),
-                    Named("Dissimilarity")          = wrap(d_score),
-                    Named("Bin count")              = wrap(b_cnt),
-                    Named("Log10 p value")          = wrap(log10_pv),
-                    Named("Perm p value")           = wrap(perm_pv),
-                    Named("Log10 adjusted p value") = wrap(log10_adj_pv),
-                    Named("Up-Down score")          = wrap(ud_score),
-                    Named("Log2 fold change")       = wrap(log2_fc)
-            );
+    return com::bioturing::BuildMarkerTable(res, rownames);
 }
 
 //' HarmonyMarker
@@ -553,13 +518,20 @@ DataFrame HarmonyMarkerH5(
     Rcout << "Group1 " << total_cnt[0]
           << "Group2 " << total_cnt[1] << std::endl;
 
-    std::vector<struct GeneResult> res
-        = HarmonyTest(oHdf5Util, file, cluster, total_cnt, threshold);
+    std::string groupName = GetGeneMajorGroup(oHdf5Util, file);
+    std::vector<struct GeneResult> res;
+    try {
+        res = HarmonyTest(oHdf5Util, file, groupName, cluster, total_cnt, threshold);
+    } catch (std::exception &err) {
+        // Threshold, size and prefetcher errors: close the file before passing them on
+        oHdf5Util.Close(file);
+        throw;
+    }
 
     Rcout << "Done calculate" << std::endl;
     std::vector<std::string> rownames;
     // Read the barcode slot since this is the transposed matrix
-    oHdf5Util.ReadDatasetVector<std::string>(file, GROUP_NAME,
+    oHdf5Util.ReadDatasetVector<std::string>(file, groupName,
                                             "barcodes", rownames);
     oHdf5Util.Close(file);
 
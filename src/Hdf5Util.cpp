@@ -68,6 +68,25 @@ arma::sp_mat ReadSpMtAsSPMat(const std::string &filePath, const std::string &gro
     return oHdf5Util.ReadSpMtAsArma(groupName);
 }
 
+//' ReadSpMtFromCache
+//'
+//' This function is used to read a sparse matrix from the binary CSC cache next to the HDF5 file
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @return A dgCMatrix, or NULL when the group has no binary cache
+//' @export
+// [[Rcpp::export]]
+SEXP ReadSpMtFromCache(const std::string &filePath, const std::string &groupName) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    std::string klass = "dgCMatrix";
+    Rcpp::S4 s(klass);
+    if(oHdf5Util.ReadSpMtCacheAsS4(groupName, s) == false) {
+        return R_NilValue;
+    }
+    return s;
+}
+
 //' ReadSpMtAsS4
 //'
 //' This function is used to read a sparse matrix from HDF5 file
@@ -94,29 +113,8 @@ Rcpp::S4 ReadSpMtAsS4(const std::string &filePath, const std::string &groupName)
 // [[Rcpp::export]]
 Rcpp::NumericVector ReadRowSumSpMt(const std::string &filePath, const std::string &groupName) {
     com::bioturing::Hdf5Util oHdf5Util(filePath);
-    HighFive::File *file = oHdf5Util.Open(1);
     std::vector<double> sumVec;
-
-    std::string datasetName = oHdf5Util.getRowsumDatasetName();
-    oHdf5Util.ReadDatasetVector<double>(file, groupName, datasetName, sumVec);
-    if(sumVec.size() == 0) {
-        arma::sp_mat mat = oHdf5Util.ReadSpMtAsArma(groupName);
-        if(mat.size() == 0) {
-            Rcpp::S4 s = oHdf5Util.ReadSpMtAsS4(file, groupName);
-            mat = Rcpp::as<arma::sp_mat>(s);
-        }
-
-        sumVec.resize(mat.n_rows);
-        for (int i= 0; i< mat.n_cols; i++)
-        {
-            for (arma::sp_mat::const_col_iterator cij = mat.begin_col(i); cij != mat.end_col(i); ++cij) {
-                sumVec[cij.row()] += (*cij);
-            }
-        }
-        oHdf5Util.WriteDatasetVector(file, groupName, datasetName, sumVec);
-    }
-
-    oHdf5Util.Close(file);
+    oHdf5Util.ReadSpMtSums(groupName, 1, sumVec);
     return Rcpp::wrap(sumVec);
 }
 
@@ -130,25 +128,8 @@ Rcpp::NumericVector ReadRowSumSpMt(const std::string &filePath, const std::strin
 // [[Rcpp::export]]
 Rcpp::NumericVector ReadColSumSpMt(const std::string &filePath, const std::string &groupName) {
     com::bioturing::Hdf5Util oHdf5Util(filePath);
-    HighFive::File *file = oHdf5Util.Open(1);
     std::vector<double> sumVec;
-
-    std::string datasetName = oHdf5Util.getColsumDatasetName();
-    oHdf5Util.ReadDatasetVector(file, groupName, datasetName, sumVec);
-    if(sumVec.size() == 0) {
-        arma::sp_mat mat = oHdf5Util.ReadSpMtAsArma(groupName);
-        if(mat.size() == 0) {
-            Rcpp::S4 s = oHdf5Util.ReadSpMtAsS4(file, groupName);
-            mat = Rcpp::as<arma::sp_mat>(s);
-        }
-
-        sumVec.resize(mat.n_cols);
-        com::bioturing::SumColumWorker<std::vector<double>> sumColWorker(&mat, sumVec);
-        RcppParallel::parallelFor(0, mat.n_cols, sumColWorker);
-        oHdf5Util.WriteDatasetVector(file, groupName, datasetName, sumVec);
-    }
-
-    oHdf5Util.Close(file);
+    oHdf5Util.ReadSpMtSums(groupName, 2, sumVec);
     return Rcpp::wrap(sumVec);
 }
 
@@ -205,21 +186,41 @@ Rcpp::StringVector GetListRootObjectNames(const std::string &filePath) {
 
 //' Read10XH5
 //'
-//' Get list triplet of SEXP
+//' Get list of dgCMatrix per group, split by genome and feature type for V3 files
 //'
 //' @param filePath A fiel path
 //' @param use_names Use names flag
 //' @param unique_features Unique features flag
+//' @param feature_types Feature types to load, e.g. "Gene Expression". Empty loads all
 //' @export
 // [[Rcpp::export]]
-Rcpp::List Read10XH5Content(const std::string &filePath, const bool &use_names, const bool &unique_features) {
+Rcpp::List Read10XH5Content(const std::string &filePath, const bool &use_names, const bool &unique_features, const Rcpp::CharacterVector &feature_types = Rcpp::CharacterVector(0)) {
     com::bioturing::Hdf5Util oHdf5Util(filePath);
     HighFive::File *file = oHdf5Util.Open(1);
-    Rcpp::List arrData = oHdf5Util.Read10XH5(file, filePath, use_names, unique_features);
+    std::vector<std::string> featureTypes = Rcpp::as<std::vector<std::string>>(feature_types);
+    Rcpp::List arrData = oHdf5Util.Read10XH5(file, filePath, use_names, unique_features, featureTypes);
     oHdf5Util.Close(file);
     return arrData;
 }
 
+//' Write10XH5
+//'
+//' Write a dgCMatrix in the 10x V3 H5 layout (group "matrix")
+//'
+//' @param filePath A file path
+//' @param mat A sparse matrix (dgCMatrix), features x cells
+//' @param feature_types Feature type of each row, e.g. "Gene Expression". Empty writes none
+//' @param genomes Genome of each row. Empty writes none
+//' @export
+// [[Rcpp::export]]
+void Write10XH5(const std::string &filePath, const Rcpp::S4 &mat, const Rcpp::CharacterVector &feature_types = Rcpp::CharacterVector(0),
+                const Rcpp::CharacterVector &genomes = Rcpp::CharacterVector(0)) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.Write10XH5(file, mat, "matrix", Rcpp::as<std::vector<std::string>>(feature_types), Rcpp::as<std::vector<std::string>>(genomes));
+    oHdf5Util.Close(file);
+}
+
 //' WriteRootDataset
 //'
 //' Write a string vector to root group
@@ -261,15 +262,15 @@ Rcpp::StringVector ReadRootDataset(const std::string &filePath, const std::strin
 //' @param groupName A string (HDF5 dataset)
 //' @export
 // [[Rcpp::export]]
-Rcpp::NumericVector ReadIntegerVector(const std::string &filePath,
+Rcpp::IntegerVector ReadIntegerVector(const std::string &filePath,
                                       const std::string &groupName,
                                       const std::string &datasetName) {
-    std::vector<int> dataVec;
     com::bioturing::Hdf5Util oHdf5Util(filePath);
     HighFive::File *file = oHdf5Util.Open(1);
-    oHdf5Util.ReadDatasetVector<int>(file, groupName, datasetName, dataVec);
+    Rcpp::IntegerVector dataVec(oHdf5Util.GetDatasetSize(file, groupName, datasetName));
+    oHdf5Util.ReadDatasetVector<int>(file, groupName, datasetName, dataVec.begin());
     oHdf5Util.Close(file);
-    return Rcpp::wrap(dataVec);
+    return dataVec;
 }
 
 //' ReadDoubleVector
@@ -283,10 +284,193 @@ Rcpp::NumericVector ReadIntegerVector(const std::string &filePath,
 Rcpp::NumericVector ReadDoubleVector(const std::string &filePath,
                                      const std::string &groupName,
                                      const std::string &datasetName) {
-    std::vector<double> dataVec;
     com::bioturing::Hdf5Util oHdf5Util(filePath);
     HighFive::File *file = oHdf5Util.Open(1);
-    oHdf5Util.ReadDatasetVector<double>(file, groupName, datasetName, dataVec);
+    Rcpp::NumericVector dataVec(oHdf5Util.GetDatasetSize(file, groupName, datasetName));
+    oHdf5Util.ReadDatasetVector<double>(file, groupName, datasetName, dataVec.begin());
+    oHdf5Util.Close(file);
+    return dataVec;
+}
+
+//' WriteSpMtAsDualLayout
+//'
+//' This function is used to write a sparse S4 matrix in both cell-major and gene-major layout
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @param mat A sparse matrix
+//' @export
+// [[Rcpp::export]]
+void WriteSpMtAsDualLayout(const std::string &filePath, const std::string &groupName, const Rcpp::S4 &mat) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.WriteSpMtDualLayout(file, mat, groupName);
+    oHdf5Util.Close(file);
+}
+
+//' WriteDualLayoutFromH5
+//'
+//' This function is used to add the gene-major layout to an existing HDF5 group, transposing out-of-core
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @param memLimitMb Memory budget of the transpose in MB
+//' @export
+// [[Rcpp::export]]
+void WriteDualLayoutFromH5(const std::string &filePath, const std::string &groupName, const double &memLimitMb = 1024) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.WriteDualLayoutFromH5(file, groupName, (std::size_t)(memLimitMb * 1024 * 1024));
+    oHdf5Util.Close(file);
+}
+
+//' WriteSpMtAsExtendible
+//'
+//' This function is used to write a sparse S4 matrix with extendible datasets, so cells can be appended later
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @param mat A sparse matrix
+//' @export
+// [[Rcpp::export]]
+void WriteSpMtAsExtendible(const std::string &filePath, const std::string &groupName, const Rcpp::S4 &mat) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.WriteSpMtExtendible(file, mat, groupName);
+    oHdf5Util.Close(file);
+}
+
+//' AppendSpMtToH5
+//'
+//' This function is used to append the cells of a sparse S4 matrix to a group written by WriteSpMtAsExtendible
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @param mat A sparse matrix, rows are matched to the stored features by name
+//' @export
+// [[Rcpp::export]]
+void AppendSpMtToH5(const std::string &filePath, const std::string &groupName, const Rcpp::S4 &mat) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.AppendSpMtFromS4(file, mat, groupName);
+    oHdf5Util.Close(file);
+}
+
+//' FilterSpMtH5
+//'
+//' This function is used to stream the filtered genes x cells of a sparse matrix group into a new group, block by block
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 dataset)
+//' @param outFilePath A string (HDF5 path of the output, may be filePath)
+//' @param outGroupName A string (HDF5 group of the output)
+//' @param genes Gene keep-mask. Default keeps every gene
+//' @param cells Cell keep-mask. Default keeps every cell
+//' @param minCells Minimum number of cells expressing a kept gene
+//' @param minGenes Minimum number of kept genes expressed in a kept cell
+//' @param notExpressed Values less than or equal to this are not expressed
+//' @return A list with the final gene and cell keep-masks
+//' @export
+// [[Rcpp::export]]
+Rcpp::List FilterSpMtH5(const std::string &filePath, const std::string &groupName, const std::string &outFilePath, const std::string &outGroupName,
+                        const Rcpp::LogicalVector &genes = Rcpp::LogicalVector(0), const Rcpp::LogicalVector &cells = Rcpp::LogicalVector(0),
+                        const double &minCells = 0, const double &minGenes = 0, const double &notExpressed = 0) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(outFilePath == filePath ? -1 : 1);
+    com::bioturing::Hdf5Util oOutHdf5Util(outFilePath);
+    HighFive::File *outFile = (outFilePath == filePath) ? file : oOutHdf5Util.Open(-1);
+
+    std::vector<unsigned int> arrDims;
+    oHdf5Util.ReadDatasetVector<unsigned int>(file, groupName, "shape", arrDims);
+    if((genes.size() > 0 && genes.size() != arrDims[0]) || (cells.size() > 0 && cells.size() != arrDims[1])) {
+        if(outFile != file) {
+            oOutHdf5Util.Close(outFile);
+        }
+        oHdf5Util.Close(file);
+        ::Rf_error("Keep-masks must have one entry per gene and per cell");
+    }
+
+    std::vector<char> geneKeep(arrDims[0], 1);
+    for(int r = 0; r < genes.size(); r++) {
+        geneKeep[r] = (genes[r] == TRUE);
+    }
+    std::vector<char> cellKeep(arrDims[1], 1);
+    for(int c = 0; c < cells.size(); c++) {
+        cellKeep[c] = (cells[c] == TRUE);
+    }
+
+    if(minCells > 0) {
+        std::vector<unsigned int> rowCounts;
+        try {
+            oHdf5Util.CountExpressedRows(file, groupName, notExpressed, rowCounts);
+        } catch (std::exception& err) {
+            std::string error = err.what();
+            if(outFile != file) {
+                oOutHdf5Util.Close(outFile);
+            }
+            oHdf5Util.Close(file);
+            ::Rf_error(error.c_str());
+        }
+        for(std::size_t r = 0; r < rowCounts.size(); r++) {
+            geneKeep[r] = geneKeep[r] && (rowCounts[r] >= minCells);
+        }
+    }
+
+    oHdf5Util.FilterSpMtToGroup(file, groupName, outFile, outGroupName, geneKeep, cellKeep, minGenes, notExpressed, 1 << 22);
+    if(outFile != file) {
+        oOutHdf5Util.Close(outFile);
+    }
+    oHdf5Util.Close(file);
+
+    return Rcpp::List::create(Rcpp::Named("genes") = Rcpp::LogicalVector(geneKeep.begin(), geneKeep.end()),
+                              Rcpp::Named("cells") = Rcpp::LogicalVector(cellKeep.begin(), cellKeep.end()));
+}
+
+//' MergeH5ToH5
+//'
+//' This function is used to column-bind the sparse matrix groups of several HDF5 files into one group, streaming each input
+//'
+//' @param filePaths HDF5 paths of the inputs
+//' @param groupNames Group of the matrix in each input
+//' @param prefixes Prefix added to the barcodes of each input
+//' @param outFilePath A string (HDF5 path of the output)
+//' @param outGroupName A string (HDF5 group of the output)
+//' @export
+// [[Rcpp::export]]
+void MergeH5ToH5(const std::vector<std::string> &filePaths, const std::vector<std::string> &groupNames, const std::vector<std::string> &prefixes,
+                 const std::string &outFilePath, const std::string &outGroupName) {
+    if(groupNames.size() != filePaths.size() || prefixes.size() != filePaths.size()) {
+        ::Rf_error("filePaths, groupNames and prefixes must have the same length");
+    }
+    if(std::find(filePaths.begin(), filePaths.end(), outFilePath) != filePaths.end()) {
+        ::Rf_error("outFilePath must differ from the input files");
+    }
+
+    com::bioturing::Hdf5Util oHdf5Util(outFilePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.MergeGroupsToGroup(filePaths, groupNames, prefixes, file, outGroupName, 1 << 22);
+    oHdf5Util.Close(file);
+}
+
+//' FederateH5ToH5
+//'
+//' This function is used to create a group reading the sparse matrix groups of several HDF5 files as one matrix, without copying their counts
+//'
+//' @param filePaths HDF5 paths of the inputs, absolute so the group can be opened from anywhere
+//' @param groupNames Group of the matrix in each input
+//' @param prefixes Prefix added to the barcodes of each input
+//' @param outFilePath A string (HDF5 path of the output)
+//' @param outGroupName A string (HDF5 group of the output)
+//' @export
+// [[Rcpp::export]]
+void FederateH5ToH5(const std::vector<std::string> &filePaths, const std::vector<std::string> &groupNames, const std::vector<std::string> &prefixes,
+                    const std::string &outFilePath, const std::string &outGroupName) {
+    if(groupNames.size() != filePaths.size() || prefixes.size() != filePaths.size() || filePaths.size() == 0) {
+        ::Rf_error("filePaths, groupNames and prefixes must have the same, non-zero length");
+    }
+
+    com::bioturing::Hdf5Util oHdf5Util(outFilePath);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    oHdf5Util.FederateGroups(filePaths, groupNames, prefixes, file, outGroupName);
     oHdf5Util.Close(file);
-    return Rcpp::wrap(dataVec);
 }
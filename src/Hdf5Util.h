@@ -12,10 +12,15 @@
 #include <RcppParallel.h>
 #include <cmath>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
 #include <fstream>
 #include <string>
 #include <boost/algorithm/string.hpp>
 #include "CommonUtil.h"
+#include "SpMtCache.h"
+#include "H5Prefetcher.h"
+#include "H5StringPool.h"
 #include <highfive/H5File.hpp>
 #include <highfive/H5Group.hpp>
 #include <H5Cpp.h>
@@ -47,6 +52,40 @@ struct SumColumWorker : public RcppParallel::Worker
     }
 };
 
+// One nonzero spilled to a bucket file while transposing out-of-core
+struct SpillEntry {
+    unsigned int row;
+    unsigned int col;
+    double value;
+};
+
+// Counting-sort transpose of a CSC matrix: p/i/x describe n_rows x n_cols,
+// t_p/t_i/t_x receive the CSC of the transpose (= CSR of the input)
+template <typename P, typename I, typename X>
+void TransposeCSC(const P &p, const I &i, const X &x, const unsigned int &n_rows, const unsigned int &n_cols,
+                  std::vector<unsigned int> &t_p, std::vector<unsigned int> &t_i, std::vector<double> &t_x) {
+    std::size_t nnz = p[n_cols];
+    t_p.assign(n_rows + 1, 0);
+    t_i.resize(nnz);
+    t_x.resize(nnz);
+
+    for (std::size_t k = 0; k < nnz; k++) {
+        t_p[i[k] + 1]++;
+    }
+    for (unsigned int r = 0; r < n_rows; r++) {
+        t_p[r + 1] += t_p[r];
+    }
+
+    std::vector<unsigned int> next(t_p.begin(), t_p.end() - 1);
+    for (unsigned int c = 0; c < n_cols; c++) {
+        for (std::size_t k = p[c]; k < (std::size_t)p[c + 1]; k++) {
+            unsigned int pos = next[i[k]]++;
+            t_i[pos] = c;
+            t_x[pos] = x[k];
+        }
+    }
+}
+
 class Hdf5Util {
 public:
     Hdf5Util(const std::string &file_name_) {
@@ -63,6 +102,12 @@ public:
         return "colsums";
     }
 
+    // Gene-major copy of a group, stored as the CSC of the transpose so every group reader can open it
+    std::string getTransposedGroupName(const std::string &groupName) {
+        return groupName + "/csr";
+    }
+
+    // Write datasetVec as groupName/datasetName, replacing a dataset already stored there
     template <typename T>
     void WriteDatasetVector(HighFive::File *file, const std::string &groupName, const std::string &datasetName, const std::vector<T> &datasetVec) {
         if(file == nullptr) {
@@ -73,30 +118,27 @@ public:
         }
 
         try {
-            if(file->exist(groupName) == true) {
+            if(file->exist(groupName) == false) {
                 std::stringstream ostr;
-                ostr << "Existing group :" << groupName;
-                ::Rf_error(ostr.str().c_str());
+                ostr << "Can not exist group :" << groupName;
                 Close(file);
+                ::Rf_error(ostr.str().c_str());
                 throw;
             }
 
-            if(file->exist(groupName + "/" + datasetName) == true) {
-                std::stringstream ostr;
-                ostr << "Existing dataset :" << datasetName << "in " << groupName;
-                ::Rf_error(ostr.str().c_str());
-                Close(file);
-                throw;
+            std::string datasetPath = groupName + "/" + datasetName;
+            if(file->exist(datasetPath) == true) {
+                H5Ldelete(file->getId(), datasetPath.c_str(), H5P_DEFAULT);
             }
 
-            HighFive::DataSet datasetGroup = file->createDataSet<T>(groupName, HighFive::DataSpace::From(datasetVec));
-            datasetGroup.write(datasetVec);
+            HighFive::DataSet dataset = file->createDataSet<T>(datasetPath, HighFive::DataSpace::From(datasetVec));
+            dataset.write(datasetVec);
             file->flush();
         } catch (HighFive::Exception& err) {
             std::stringstream ostr;
             ostr << "WriteVector HDF5 format, error=" << err.what() ;
-            ::Rf_error(ostr.str().c_str());
             Close(file);
+            ::Rf_error(ostr.str().c_str());
             throw;
         }
     }
@@ -268,6 +310,79 @@ public:
         }
     }
 
+    std::size_t GetDatasetSize(HighFive::File *file, const std::string &groupName, const std::string &datasetName) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read dataset size, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::size_t size = 0;
+        try {
+            if(file->exist(groupName + "/" + datasetName) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist dataset :" << datasetName << "in " << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            HighFive::DataSet datasetVec = file->getDataSet(groupName + "/" + datasetName);
+            std::vector<size_t> dims = datasetVec.getSpace().getDimensions();
+            size = dims.size() > 0 ? dims[0] : 0;
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "GetDatasetSize HDF5 format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+        return size;
+    }
+
+    // Create a 1-d dataset stored as T and fill it from caller-owned memory (e.g. an R vector)
+    template <typename T, typename V>
+    HighFive::DataSet WriteDatasetFromPtr(HighFive::File *file, const std::string &datasetPath, const V *vvec, const std::size_t &size) {
+        HighFive::DataSet dataset = file->createDataSet<T>(datasetPath, HighFive::DataSpace(std::vector<size_t>{size}));
+        if(size > 0) {
+            dataset.write(vvec);
+        }
+        return dataset;
+    }
+
+    // Read a whole dataset into caller-owned memory (e.g. an R vector), converting to T on the fly
+    template <typename T>
+    void ReadDatasetVector(HighFive::File *file, const std::string &groupName, const std::string &datasetName, T *vvec) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read dataset, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        try {
+            if(file->exist(groupName + "/" + datasetName) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist dataset :" << datasetName << "in " << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            HighFive::DataSet datasetVec = file->getDataSet(groupName + "/" + datasetName);
+            if(datasetVec.getSpace().getDimensions()[0] > 0) {
+                datasetVec.read(vvec);
+            }
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ReadDatatypeVector (T*) HDF5 format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+    }
+
     void ReadDatasetVector(HighFive::File *file, const std::string &groupName, const std::string &datasetName, std::vector<std::string> &vvec) {
         if(file == nullptr) {
             std::stringstream ostr;
@@ -627,8 +742,19 @@ public:
                 throw;
             }
 
-            arma::sp_mat mat = Rcpp::as<arma::sp_mat>(s);
-            if(mat.save(filePath) == true) {
+            Rcpp::IntegerVector p = s.slot("p");
+            Rcpp::IntegerVector i = s.slot("i");
+            Rcpp::NumericVector x = s.slot("x");
+            Rcpp::IntegerVector dims = s.slot("Dim");
+            Rcpp::List dimnames = s.slot("Dimnames");
+            std::vector<std::string> arrCacheRowNames, arrCacheColNames;
+            if(Rf_isNull(dimnames[0]) == false && Rf_isNull(dimnames[1]) == false) {
+                arrCacheRowNames = Rcpp::as<std::vector<std::string>>(dimnames[0]);
+                arrCacheColNames = Rcpp::as<std::vector<std::string>>(dimnames[1]);
+            }
+
+            SpMtCache oSpMtCache(filePath);
+            if(oSpMtCache.Write(p, i, x, dims[0], dims[1], arrCacheRowNames, arrCacheColNames) == true) {
                 if((file->exist(groupName + "/features") == true) && (file->exist(groupName + "/barcodes") == true)) {
                     return;
                 }
@@ -680,7 +806,9 @@ public:
     void WriteSpMtFromArma(const arma::sp_mat &mat, const std::string &groupName) {
         std::string filePath = GetH5FilePathOfGroupName(groupName);
         try {
-            mat.save(filePath);
+            std::vector<std::string> arrNoNames;
+            SpMtCache oSpMtCache(filePath);
+            oSpMtCache.Write(mat.col_ptrs, mat.row_indices, mat.values, mat.n_rows, mat.n_cols, arrNoNames, arrNoNames);
         } catch (HighFive::Exception& err) {
             std::stringstream ostr;
             ostr << "WriteSpMtFromArma HDF5 format, error=" << err.what() ;
@@ -707,33 +835,19 @@ public:
             }
 
             Rcpp::IntegerVector dims = mat.slot("Dim");
-            arma::urowvec i = Rcpp::as<arma::urowvec>(mat.slot("i"));
-            arma::urowvec p = Rcpp::as<arma::urowvec>(mat.slot("p"));
-            arma::vec x = Rcpp::as<arma::vec>(mat.slot("x"));
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::NumericVector x = mat.slot("x");
             Rcpp::List dim_names = mat.slot("Dimnames");
 
             // Write group name data
             file->createGroup(groupName);
 
-            // Write DIM data
-            std::vector<unsigned int> arrDims(dims.begin(), dims.end());
-            HighFive::DataSet datasetDim = file->createDataSet<unsigned int>(groupName + "/shape", HighFive::DataSpace::From(arrDims));
-            datasetDim.write(arrDims);
-
-            //Write i data
-            std::vector<unsigned int> arrI(i.begin(), i.end());
-            HighFive::DataSet datasetI = file->createDataSet<unsigned int>(groupName + "/indices", HighFive::DataSpace::From(arrI));
-            datasetI.write(arrI);
-
-            //Write p data
-            std::vector<unsigned int> arrP(p.begin(), p.end());
-            HighFive::DataSet datasetP = file->createDataSet<unsigned int>(groupName + "/indptr", HighFive::DataSpace::From(arrP));
-            datasetP.write(arrP);
-
-            //Write x data
-            std::vector<double> arrX(x.begin(), x.end());
-            HighFive::DataSet datasetX = file->createDataSet<double>(groupName + "/data", HighFive::DataSpace::From(arrX));
-            datasetX.write(arrX);
+            // Write DIM, i, p and x straight from the R vectors, HDF5 converting int to unsigned int
+            WriteDatasetFromPtr<unsigned int>(file, groupName + "/shape", dims.begin(), dims.size());
+            WriteDatasetFromPtr<unsigned int>(file, groupName + "/indices", i.begin(), i.size());
+            WriteDatasetFromPtr<unsigned int>(file, groupName + "/indptr", p.begin(), p.size());
+            WriteDatasetFromPtr<double>(file, groupName + "/data", x.begin(), x.size());
 
             //Write rownames data
             Rcpp::CharacterVector rownames = dim_names[0];
@@ -757,266 +871,1533 @@ public:
         }
     }
 
-    bool CheckFileExist(const std::string &file_path)
-    {
-        std::ifstream infile(file_path);
-        return infile.good();
-    }
-
-    arma::sp_mat ReadSpMtAsArma(const std::string &groupName) {
-        arma::sp_mat mat;
-        std::string filePath = GetH5FilePathOfGroupName(groupName);
-        if(CheckFileExist(filePath) == true)
-        {
-            mat.load(filePath);
-            return mat;
-        }
-        return mat;
-    }
-
-    Rcpp::S4 ReadSpMtAsS4(HighFive::File *file, const std::string &groupName) {
+    // Same layout as WriteSpMtFromS4, but indices/data/indptr/barcodes are chunked with an
+    // unlimited dimension so AppendSpMtFromS4 can add cells in place
+    void WriteSpMtExtendible(HighFive::File *file, const Rcpp::S4 &mat, const std::string &groupName) {
         if(file == nullptr) {
             std::stringstream ostr;
-            ostr << "Can not read sparse matrix, please open file :" << file_name;
+            ostr << "Can not write dataset, please open file :" << file_name;
             ::Rf_error(ostr.str().c_str());
             throw;
         }
 
-        std::string klass = "dgCMatrix";
-        Rcpp::S4 s(klass);
-
         try {
-            if(file->exist(groupName) == false) {
+            if(file->exist(groupName) == true) {
                 std::stringstream ostr;
-                ostr << "Can not exist group :" << groupName;
+                ostr << "Existing group :" << groupName;
                 ::Rf_error(ostr.str().c_str());
                 Close(file);
                 throw;
             }
 
-            std::string feature_slot;
-            if(file->exist(groupName + "/features") == true) {
-                if((file->exist(groupName + "/features/id") == true) || (file->exist(groupName + "/features/name") == true)) {
-                    feature_slot = "features/id";
-                    if(file->exist(groupName + "/" + feature_slot) == false) {
-                        feature_slot = "features/name";
-                    }
-                } else {
-                    feature_slot = "features";
-                }
-            } else {
-                feature_slot = "genes";
-                if(file->exist(groupName + "/" + feature_slot) == false) {
-                    feature_slot = "gene_names";
-                }
-            }
+            Rcpp::IntegerVector dims = mat.slot("Dim");
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::List dim_names = mat.slot("Dimnames");
+            std::vector<std::string> arrRowNames = Rcpp::as<std::vector<std::string>>(dim_names[0]);
+            std::vector<std::string> arrColNames = Rcpp::as<std::vector<std::string>>(dim_names[1]);
 
-            std::vector<std::string> arrDatasetName = {"data", "indices", "indptr", "shape", feature_slot};
-            for(const std::string &datasetName : arrDatasetName) {
-                if(file->exist(groupName + "/" + datasetName) == false) {
-                    std::stringstream ostr;
-                    ostr << "Can not exist dataset : " << datasetName << " in " << groupName;
-                    ::Rf_error(ostr.str().c_str());
-                    Close(file);
-                    throw;
-                }
+            file->createGroup(groupName);
+
+            std::vector<unsigned int> arrDims(dims.begin(), dims.end());
+            HighFive::DataSet datasetDim = file->createDataSet<unsigned int>(groupName + "/shape", HighFive::DataSpace::From(arrDims));
+            datasetDim.write(arrDims);
+
+            HighFive::DataSet datasetI = CreateExtendibleDataSet<unsigned int>(file, groupName + "/indices", i.size(), 1 << 16);
+            HighFive::DataSet datasetX = CreateExtendibleDataSet<double>(file, groupName + "/data", x.size(), 1 << 16);
+            if(i.size() > 0) {
+                datasetI.write(i.begin());
+                datasetX.write(x.begin());
             }
 
-            std::vector<int> arrDims;
-            ReadDatasetVector<int>(file, groupName, "shape", arrDims);
-            std::vector<int> arrIndices;
-            ReadDatasetVector<int>(file, groupName, "indices", arrIndices);
-            std::vector<int> arrIndptr;
-            ReadDatasetVector<int>(file, groupName, "indptr", arrIndptr);
-            std::vector<double> arrData;
-            ReadDatasetVector<double>(file, groupName, "data", arrData);
-            std::vector<std::string> arrFeature;
-            ReadDatasetVector(file, groupName, feature_slot, arrFeature);
-            std::vector<std::string> arrBarcode;
+            HighFive::DataSet datasetP = CreateExtendibleDataSet<unsigned int>(file, groupName + "/indptr", p.size(), 1 << 12);
+            datasetP.write(p.begin());
 
-            s.slot("p") = std::move(arrIndptr);
-            s.slot("i") = std::move(arrIndices);
-            s.slot("x") = std::move(arrData);
-            s.slot("Dim") = std::move(arrDims);
+            HighFive::DataSet datasetRowNames = file->createDataSet<std::string>(groupName + "/features", HighFive::DataSpace::From(arrRowNames));
+            datasetRowNames.write(arrRowNames);
 
-            if (file->exist(groupName + "/" + "barcodes")) {
-              ReadDatasetVector(file, groupName, "barcodes", arrBarcode);
-              s.slot("Dimnames") = Rcpp::List::create(arrFeature, arrBarcode);
-            } else{
-              arrBarcode.resize(arrDims[1], "col");
-              s.slot("Dimnames") = Rcpp::List::create(arrFeature, arrBarcode);
+            HighFive::DataSet datasetColNames = CreateExtendibleDataSet<std::string>(file, groupName + "/barcodes", arrColNames.size(), 1 << 12);
+            if(arrColNames.size() > 0) {
+                datasetColNames.write(arrColNames);
             }
-            return s;
+
+            file->flush();
         } catch (HighFive::Exception& err) {
             std::stringstream ostr;
-            ostr << "ReadSpMtAsS4 in HDF5 format, error=" << err.what();
+            ostr << "WriteSpMtExtendible HDF5 format, error=" << err.what() ;
             ::Rf_error(ostr.str().c_str());
             Close(file);
             throw;
         }
-
-        return s;
     }
 
-    Rcpp::List Read10XH5(HighFive::File *file, const std::string &filePath, const bool &use_names, const bool &unique_features) {
+    // Append the columns (cells) of mat to a group written by WriteSpMtExtendible. Rows are
+    // matched to the stored features by name and only the new bytes are written. indptr and
+    // barcodes grow before shape is rewritten, so readers take n_cols from shape and ignore
+    // what lies past it: an interrupted append leaves the old matrix readable.
+    void AppendSpMtFromS4(HighFive::File *file, const Rcpp::S4 &mat, const std::string &groupName) {
         if(file == nullptr) {
             std::stringstream ostr;
-            ostr << "Can not read dataset, please open file :" << file_name;
+            ostr << "Can not append dataset, please open file :" << file_name;
             ::Rf_error(ostr.str().c_str());
             throw;
         }
 
-        Environment pkg = Environment::namespace_env("Matrix");
-        Function fMatrix = pkg["sparseMatrix"];
-
-        Rcpp::List arrList = Rcpp::List::create();
         try {
-            std::vector<std::string> genomes;
-            GetListRootObjectNames(file, genomes);
+            if(file->exist(groupName) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist group :" << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
 
-            for(std::string &groupName : genomes) {
-                if(file->exist(groupName) == false) {
+            std::vector<std::string> arrDatasetName = {"indices", "data", "indptr", "barcodes"};
+            for(const std::string &datasetName : arrDatasetName) {
+                std::vector<size_t> maxDims = file->getDataSet(groupName + "/" + datasetName).getSpace().getMaxDimensions();
+                if(maxDims.size() != 1 || maxDims[0] != HighFive::DataSpace::UNLIMITED) {
                     std::stringstream ostr;
-                    ostr << "Can not exist group :" << groupName;
+                    ostr << "Dataset " << datasetName << " in " << groupName << " is not extendible, write the group with WriteSpMtAsExtendible";
                     ::Rf_error(ostr.str().c_str());
                     Close(file);
                     throw;
                 }
+            }
 
-                std::string feature_slot;
-                if(file->exist(groupName + "/features") == true) {
-                    ::Rf_warning("FORMAT_VERSION >= 3");
-                    feature_slot = "features/id";
-                    if(file->exist(groupName + "/" + feature_slot) == false) {
-                        feature_slot = "features/name";
-                    }
-                } else {
-                    ::Rf_warning("FORMAT_VERSION < 3");
-                    feature_slot = "genes";
-                    if(file->exist(groupName + "/" + feature_slot) == false) {
-                        feature_slot = "gene_names";
+            std::vector<unsigned int> arrDims;
+            ReadDatasetVector<unsigned int>(file, groupName, "shape", arrDims);
+            H5StringPool oFeaturePool;
+            oFeaturePool.Read(file->getDataSet(groupName + "/" + GetFeatureSlot(file, groupName)));
+
+            Rcpp::IntegerVector dims = mat.slot("Dim");
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::List dim_names = mat.slot("Dimnames");
+            std::vector<std::string> arrRowNames = Rcpp::as<std::vector<std::string>>(dim_names[0]);
+            std::vector<std::string> arrColNames = Rcpp::as<std::vector<std::string>>(dim_names[1]);
+
+            // Same features in the same order are mapped by position, so duplicated names are fine there
+            bool identity = (arrRowNames.size() == oFeaturePool.size());
+            for(std::size_t r = 0; r < arrRowNames.size() && identity == true; r++) {
+                identity = (oFeaturePool.Get(r) == arrRowNames[r]);
+            }
+
+            // Otherwise new row -> stored feature row by name, which needs unique names on both sides
+            std::vector<unsigned int> rowMap;
+            if(identity == false) {
+                long duplicate = -1;
+                for(std::size_t r = 0; r < oFeaturePool.size() && duplicate < 0; r++) {
+                    if(oFeaturePool.Find(oFeaturePool.GetData(r), oFeaturePool.GetLength(r)) != (long)r) {
+                        duplicate = r;
                     }
                 }
+                if(duplicate >= 0) {
+                    std::stringstream ostr;
+                    ostr << "Feature " << oFeaturePool.Get(duplicate) << " is duplicated in " << groupName << ", rows can not be matched by name";
+                    Close(file);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
 
-                std::vector<std::string> arrDatasetName = {"data", "indices", "indptr", "shape", feature_slot, "barcodes"};
-                for(const std::string &datasetName : arrDatasetName) {
-                    if(file->exist(groupName + "/" + datasetName) == false) {
+                rowMap.resize(arrRowNames.size());
+                std::vector<bool> matched(oFeaturePool.size(), false);
+                for(std::size_t r = 0; r < arrRowNames.size(); r++) {
+                    long pos = oFeaturePool.Find(arrRowNames[r]);
+                    if(pos < 0 || matched[pos] == true) {
                         std::stringstream ostr;
-                        ostr << "Can not exist dataset : " << datasetName << " in " << groupName;
-                        ::Rf_error(ostr.str().c_str());
+                        ostr << "Feature " << arrRowNames[r] << (pos < 0 ? " does not exist in " : " is duplicated in the rows appended to ") << groupName;
                         Close(file);
+                        ::Rf_error(ostr.str().c_str());
                         throw;
                     }
+                    matched[pos] = true;
+                    rowMap[r] = pos;
                 }
+            }
 
-                std::vector<int> arrDims;
-                ReadDatasetVector<int>(file, groupName, "shape", arrDims);
-                std::vector<int> arrIndices;
-                ReadDatasetVector<int>(file, groupName, "indices", arrIndices);
-                std::vector<int> arrIndptr;
-                ReadDatasetVector<int>(file, groupName, "indptr", arrIndptr);
-                std::vector<double> arrData;
-                ReadDatasetVector<double>(file, groupName, "data", arrData);
-                std::vector<std::string> arrFeature;
-                ReadDatasetVector(file, groupName, feature_slot, arrFeature);
-                std::vector<std::string> arrBarcode;
-                ReadDatasetVector(file, groupName, "barcodes", arrBarcode);
-
-                if (unique_features == true) {
-                    std::vector<std::string>::iterator it;
-                    it = std::unique (arrFeature.begin(), arrFeature.end());
-                    arrFeature.resize(std::distance(arrFeature.begin(),it));
+            std::size_t n_cols = arrDims[1];
+            std::size_t new_cols = dims[1];
+            std::size_t new_nnz = i.size();
+            HighFive::DataSet datasetP = file->getDataSet(groupName + "/indptr");
+            std::vector<unsigned int> lastPtr;
+            datasetP.select({n_cols}, {1}).read(lastPtr);
+            std::size_t nnz = lastPtr[0];
+
+            if(new_nnz > 0) {
+                HighFive::DataSet datasetI = file->getDataSet(groupName + "/indices");
+                HighFive::DataSet datasetX = file->getDataSet(groupName + "/data");
+                datasetI.resize({nnz + new_nnz});
+                datasetX.resize({nnz + new_nnz});
+                datasetX.select({nnz}, {new_nnz}).write(x.begin());
+                if(identity == true) {
+                    datasetI.select({nnz}, {new_nnz}).write(i.begin());
+                } else {
+                    std::vector<unsigned int> arrI(new_nnz);
+                    std::vector<double> arrX(x.begin(), x.end());
+                    for(std::size_t c = 0; c < new_cols; c++) {
+                        std::vector<std::pair<unsigned int, double>> column;
+                        for(int k = p[c]; k < p[c + 1]; k++) {
+                            column.push_back(std::make_pair(rowMap[i[k]], x[k]));
+                        }
+                        std::sort(column.begin(), column.end());
+                        for(std::size_t k = 0; k < column.size(); k++) {
+                            arrI[p[c] + k] = column[k].first;
+                            arrX[p[c] + k] = column[k].second;
+                        }
+                    }
+                    datasetI.select({nnz}, {new_nnz}).write(arrI);
+                    datasetX.select({nnz}, {new_nnz}).write(arrX);
                 }
+            }
 
-                std::vector<std::string> arrFeatureType;
-                if(file->exist(groupName + "/features/feature_type") == true) {
-                    ReadDatasetVector(file, groupName, "features/feature_type", arrFeatureType);
-                }
+            if(new_cols > 0) {
+                HighFive::DataSet datasetColNames = file->getDataSet(groupName + "/barcodes");
+                datasetColNames.resize({n_cols + new_cols});
+                datasetColNames.select({n_cols}, {new_cols}).write(arrColNames);
 
-                std::vector<std::string> arrFeatureGenome;
-                if(file->exist(groupName + "/features/genome") == true) {
-                    ReadDatasetVector(file, groupName, "features/genome", arrFeatureGenome);
+                std::vector<unsigned int> arrP(new_cols);
+                for(std::size_t c = 0; c < new_cols; c++) {
+                    arrP[c] = nnz + p[c + 1];
                 }
+                datasetP.resize({n_cols + new_cols + 1});
+                datasetP.select({n_cols + 1}, {new_cols}).write(arrP);
+            }
 
-                Rcpp::List arrFeatureGenomeList = Rcpp::List::create();
-                if(arrFeatureGenome.size() > 0) {
-                    std::vector<std::string>::iterator it;
-                    it = std::unique (arrFeatureGenome.begin(), arrFeatureGenome.end());
-                    arrFeatureGenome.resize(std::distance(arrFeatureGenome.begin(),it));
-
-                    std::map<std::string, std::vector<unsigned int>> arrFeatureGenomeMap;
-                    for(int i = 0; i < arrFeatureGenome.size(); i++) {
-                        std::vector<unsigned int> vecFeature;
-                        arrFeatureGenomeMap[arrFeatureGenome[i]] = vecFeature;
-                    }
-
-                    unsigned int jLoop = 0;
-                    for (const std::string & featureName : arrFeature)
-                    {
-                        std::vector<std::string> arrItem;
-                        boost::split(arrItem, featureName, boost::is_any_of(GENOME_SEPARATOR));
-                        arrFeatureGenomeMap[arrItem[0]].push_back(jLoop++);
-                    }
-
-                    for(int i = 0; i < arrFeatureGenome.size(); i++) {
-                        arrFeatureGenomeList[arrFeatureGenome[i]] = std::move(arrFeatureGenomeMap[arrFeatureGenome[i]]);
-                    }
-                }
+            arrDims[1] = n_cols + new_cols;
+            file->getDataSet(groupName + "/shape").write(arrDims);
+            file->flush();
 
-                std::transform(std::begin(arrIndices),std::end(arrIndices),std::begin(arrIndices),[](int x){return x+1;});
-                S4 mat = fMatrix(
-                  Named("i", arrIndices),
-                  Named("p", arrIndptr),
-                  Named("x", arrData),
-                  Named("dims", arrDims),
-                  Named("giveCsparse", false),
-                  Named("dimnames",
-                  Rcpp::List::create(arrFeature, arrBarcode))
-                );
-
-                arrList[groupName] = Rcpp::List::create(
-                  Named("mat") = mat,
-                  Named("feature_type") = arrFeatureType,
-                  Named("feature_genome") = arrFeatureGenomeList);
-            }
+            InvalidateCachedStats(file, groupName);
         } catch (HighFive::Exception& err) {
             std::stringstream ostr;
-            ostr << "Read10XH5 HDF5 format, error=" << err.what() ;
+            ostr << "AppendSpMtFromS4 HDF5 format, error=" << err.what() ;
             ::Rf_error(ostr.str().c_str());
             Close(file);
             throw;
         }
-
-        return arrList;
     }
 
-    HighFive::File *Open(const int &mode) {
-        HighFive::File *file = nullptr;
-        try {
-            int new_mode = HighFive::File::OpenOrCreate;
-            switch(mode) {
-            case -1:
-                new_mode = HighFive::File::OpenOrCreate;
-                break;
-            default:
-                new_mode = HighFive::File::ReadOnly;
-            break;
+    // Cells with a value above notExpressed, per gene (row), in one streaming pass
+    void CountExpressedRows(HighFive::File *file, const std::string &groupName, const double &notExpressed, std::vector<unsigned int> &rowCounts) {
+        H5Prefetcher oH5Prefetcher(file, groupName, 1 << 22);
+        oH5Prefetcher.Start();
+        rowCounts.assign(oH5Prefetcher.GetNumRows(), 0);
+
+        H5ColumnBlock block;
+        while(oH5Prefetcher.Next(block) == true) {
+            for(std::size_t k = 0; k < block.i.size(); k++) {
+                if(block.x[k] > notExpressed) {
+                    rowCounts[block.i[k]]++;
+                }
             }
-            file = new HighFive::File(file_name, new_mode);
-        } catch (HighFive::Exception& err) {
-            std::cerr << "Can not open HDF5 file, error=" << err.what() << std::endl;
         }
-        return file;
     }
 
-    void Close(HighFive::File *file) {
-        if(file != nullptr) {
-            delete file;
+    // Stream the kept genes x kept cells of groupName into a new (extendible) group of outFile, one
+    // block of about blockEntries nonzeros at a time. A cell in cellKeep is dropped when fewer than
+    // minGenes kept genes are above notExpressed; cellKeep is updated to the cells actually written.
+    void FilterSpMtToGroup(HighFive::File *file, const std::string &groupName, HighFive::File *outFile, const std::string &outGroupName,
+                           const std::vector<char> &geneKeep, std::vector<char> &cellKeep, const double &minGenes,
+                           const double &notExpressed, const std::size_t &blockEntries) {
+        if(file == nullptr || outFile == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not filter sparse matrix, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
         }
-    }
-
-private:
-    std::string file_name;
+
+        if(outFile->exist(outGroupName) == true) {
+            std::stringstream ostr;
+            ostr << "Existing group :" << outGroupName;
+            if(outFile != file) {
+                Close(outFile);
+            }
+            Close(file);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        try {
+            std::vector<unsigned int> arrDims;
+            ReadDatasetVector<unsigned int>(file, groupName, "shape", arrDims);
+            unsigned int n_rows = arrDims[0];
+            unsigned int n_cols = arrDims[1];
+
+            std::vector<int> rowMap(n_rows, -1);
+            unsigned int n_kept_rows = 0;
+            for(unsigned int r = 0; r < n_rows; r++) {
+                if(geneKeep[r] != 0) {
+                    rowMap[r] = n_kept_rows++;
+                }
+            }
+
+            outFile->createGroup(outGroupName);
+            HighFive::DataSet datasetI = CreateExtendibleDataSet<unsigned int>(outFile, outGroupName + "/indices", 0, 1 << 16);
+            HighFive::DataSet datasetX = CreateExtendibleDataSet<double>(outFile, outGroupName + "/data", 0, 1 << 16);
+
+            std::vector<unsigned int> arrP(1, 0);
+            std::vector<unsigned int> outI;
+            std::vector<double> outX;
+            std::size_t nnz = 0;
+            {
+                H5Prefetcher oH5Prefetcher(file, groupName, blockEntries);
+                oH5Prefetcher.Start();
+
+                H5ColumnBlock block;
+                while(oH5Prefetcher.Next(block) == true) {
+                    outI.clear();
+                    outX.clear();
+                    for(std::size_t c = 0; c < block.n_cols; c++) {
+                        std::size_t col = block.col_start + c;
+                        if(cellKeep[col] == 0) {
+                            continue;
+                        }
+
+                        std::size_t colStart = outI.size();
+                        unsigned int expressed = 0;
+                        for(unsigned int k = block.p[c]; k < block.p[c + 1]; k++) {
+                            if(rowMap[block.i[k]] >= 0) {
+                                outI.push_back(rowMap[block.i[k]]);
+                                outX.push_back(block.x[k]);
+                                expressed += (block.x[k] > notExpressed);
+                            }
+                        }
+
+                        if(expressed < minGenes) {
+                            outI.resize(colStart);
+                            outX.resize(colStart);
+                            cellKeep[col] = 0;
+                            continue;
+                        }
+                        arrP.push_back(nnz + outI.size());
+                    }
+
+                    if(outI.size() > 0) {
+                        std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+                        datasetI.resize({nnz + outI.size()});
+                        datasetX.resize({nnz + outX.size()});
+                        datasetI.select({nnz}, {outI.size()}).write(outI.data());
+                        datasetX.select({nnz}, {outX.size()}).write(outX.data());
+                        nnz += outI.size();
+                    }
+                }
+            }
+
+            HighFive::DataSet datasetP = CreateExtendibleDataSet<unsigned int>(outFile, outGroupName + "/indptr", arrP.size(), 1 << 12);
+            datasetP.write(arrP.data());
+
+            std::vector<unsigned int> outDims = {n_kept_rows, (unsigned int)(arrP.size() - 1)};
+            WriteDatasetFromPtr<unsigned int>(outFile, outGroupName + "/shape", outDims.data(), outDims.size());
+
+            H5StringPool oFeaturePool;
+            oFeaturePool.Read(file->getDataSet(groupName + "/" + GetFeatureSlot(file, groupName)));
+            std::vector<std::string> arrRowNames;
+            arrRowNames.reserve(n_kept_rows);
+            for(unsigned int r = 0; r < n_rows; r++) {
+                if(rowMap[r] >= 0) {
+                    arrRowNames.push_back(oFeaturePool.Get(r));
+                }
+            }
+            HighFive::DataSet datasetRowNames = outFile->createDataSet<std::string>(outGroupName + "/features", HighFive::DataSpace::From(arrRowNames));
+            datasetRowNames.write(arrRowNames);
+
+            std::vector<std::string> arrColNames;
+            arrColNames.reserve(arrP.size() - 1);
+            H5StringPool oBarcodePool;
+            if(file->exist(groupName + "/barcodes") == true) {
+                oBarcodePool.Read(file->getDataSet(groupName + "/barcodes"));
+            }
+            for(unsigned int c = 0; c < n_cols; c++) {
+                if(cellKeep[c] != 0) {
+                    arrColNames.push_back(oBarcodePool.size() > 0 ? oBarcodePool.Get(c) : "col");
+                }
+            }
+            HighFive::DataSet datasetColNames = CreateExtendibleDataSet<std::string>(outFile, outGroupName + "/barcodes", arrColNames.size(), 1 << 12);
+            if(arrColNames.size() > 0) {
+                datasetColNames.write(arrColNames);
+            }
+
+            outFile->flush();
+        } catch (std::exception& err) {
+            // HighFive errors and prefetcher errors
+            std::stringstream ostr;
+            ostr << "FilterSpMtToGroup HDF5 format, error=" << err.what() ;
+            if(outFile != file) {
+                Close(outFile);
+            }
+            Close(file);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+    }
+
+    // Column-bind the groups of several files into one extendible group of outFile. Features are
+    // unioned in first-seen order and each input's rows remapped onto the union; barcodes get the
+    // input's prefix. Inputs are streamed block by block and every output dataset (indptr and
+    // barcodes included) is extended per block, so memory does not grow with the total cell count.
+    void MergeGroupsToGroup(const std::vector<std::string> &filePaths, const std::vector<std::string> &groupNames,
+                            const std::vector<std::string> &prefixes, HighFive::File *outFile, const std::string &outGroupName,
+                            const std::size_t &blockEntries) {
+        if(outFile == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not merge sparse matrices, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        if(outFile->exist(outGroupName) == true) {
+            std::stringstream ostr;
+            ostr << "Existing group :" << outGroupName;
+            Close(outFile);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        HighFive::File *inFile = nullptr;
+        try {
+            std::vector<std::string> arrFeatures;
+            std::unordered_map<std::string, unsigned int> featureIndex;
+            std::vector<std::vector<unsigned int>> rowMaps(filePaths.size());
+            std::vector<bool> monotonic(filePaths.size(), true);
+            std::size_t totalNnz = 0;
+            for(std::size_t s = 0; s < filePaths.size(); s++) {
+                Hdf5Util oInputUtil(filePaths[s]);
+                inFile = oInputUtil.Open(1);
+                if(inFile == nullptr || inFile->exist(groupNames[s]) == false) {
+                    std::stringstream ostr;
+                    ostr << "Can not read group " << groupNames[s] << " in " << filePaths[s];
+                    Close(inFile);
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+
+                H5StringPool oFeaturePool;
+                oFeaturePool.Read(inFile->getDataSet(groupNames[s] + "/" + GetFeatureSlot(inFile, groupNames[s])));
+
+                // indptr is written as unsigned int, so the merged matrix must stay below 2^32 nonzeros
+                std::vector<unsigned int> arrDims;
+                inFile->getDataSet(groupNames[s] + "/shape").read(arrDims);
+                std::vector<unsigned int> lastPtr;
+                inFile->getDataSet(groupNames[s] + "/indptr").select({arrDims[1]}, {1}).read(lastPtr);
+                Close(inFile);
+                inFile = nullptr;
+                totalNnz += lastPtr[0];
+                if(totalNnz > std::numeric_limits<unsigned int>::max()) {
+                    std::stringstream ostr;
+                    ostr << "Merging " << groupNames[s] << " in " << filePaths[s] << " goes over "
+                         << std::numeric_limits<unsigned int>::max() << " nonzeros, the limit of a 32-bit indptr";
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+
+                rowMaps[s].resize(oFeaturePool.size());
+                for(std::size_t r = 0; r < oFeaturePool.size(); r++) {
+                    auto it = featureIndex.emplace(oFeaturePool.Get(r), arrFeatures.size());
+                    if(it.second == true) {
+                        arrFeatures.push_back(it.first->first);
+                    }
+                    rowMaps[s][r] = it.first->second;
+                    if(r > 0 && rowMaps[s][r] < rowMaps[s][r - 1]) {
+                        monotonic[s] = false;
+                    }
+                }
+
+                // Two rows of one input on the same union row would give a column repeated row indices
+                std::vector<unsigned int> sortedRows(rowMaps[s]);
+                std::sort(sortedRows.begin(), sortedRows.end());
+                auto duplicate = std::adjacent_find(sortedRows.begin(), sortedRows.end());
+                if(duplicate != sortedRows.end()) {
+                    std::stringstream ostr;
+                    ostr << "Feature " << arrFeatures[*duplicate] << " is duplicated in " << groupNames[s] << " of " << filePaths[s];
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+            }
+
+            outFile->createGroup(outGroupName);
+            HighFive::DataSet datasetI = CreateExtendibleDataSet<unsigned int>(outFile, outGroupName + "/indices", 0, 1 << 16);
+            HighFive::DataSet datasetX = CreateExtendibleDataSet<double>(outFile, outGroupName + "/data", 0, 1 << 16);
+            HighFive::DataSet datasetP = CreateExtendibleDataSet<unsigned int>(outFile, outGroupName + "/indptr", 1, 1 << 12);
+            HighFive::DataSet datasetColNames = CreateExtendibleDataSet<std::string>(outFile, outGroupName + "/barcodes", 0, 1 << 12);
+            std::vector<unsigned int> firstPtr(1, 0);
+            datasetP.write(firstPtr.data());
+
+            std::size_t nnz = 0;
+            std::size_t n_cols = 0;
+            std::vector<unsigned int> outI;
+            std::vector<double> outX;
+            std::vector<unsigned int> outP;
+            std::vector<std::string> outNames;
+            std::vector<std::pair<unsigned int, double>> column;
+            for(std::size_t s = 0; s < filePaths.size(); s++) {
+                Hdf5Util oInputUtil(filePaths[s]);
+                inFile = oInputUtil.Open(1);
+
+                H5StringPool oBarcodePool;
+                if(inFile->exist(groupNames[s] + "/barcodes") == true) {
+                    oBarcodePool.Read(inFile->getDataSet(groupNames[s] + "/barcodes"));
+                }
+
+                {
+                    H5Prefetcher oH5Prefetcher(inFile, groupNames[s], blockEntries);
+                    oH5Prefetcher.Start();
+
+                    H5ColumnBlock block;
+                    while(oH5Prefetcher.Next(block) == true) {
+                        outI.resize(block.i.size());
+                        outX.assign(block.x.begin(), block.x.end());
+                        for(std::size_t k = 0; k < block.i.size(); k++) {
+                            outI[k] = rowMaps[s][block.i[k]];
+                        }
+
+                        // A reordered feature set can unsort the rows of a column
+                        if(monotonic[s] == false) {
+                            for(std::size_t c = 0; c < block.n_cols; c++) {
+                                column.clear();
+                                for(unsigned int k = block.p[c]; k < block.p[c + 1]; k++) {
+                                    column.push_back(std::make_pair(outI[k], outX[k]));
+                                }
+                                std::sort(column.begin(), column.end());
+                                for(std::size_t k = 0; k < column.size(); k++) {
+                                    outI[block.p[c] + k] = column[k].first;
+                                    outX[block.p[c] + k] = column[k].second;
+                                }
+                            }
+                        }
+
+                        outP.resize(block.n_cols);
+                        outNames.resize(block.n_cols);
+                        for(std::size_t c = 0; c < block.n_cols; c++) {
+                            outP[c] = nnz + block.p[c + 1];
+                            std::size_t col = block.col_start + c;
+                            outNames[c] = prefixes[s] + (oBarcodePool.size() > 0 ? oBarcodePool.Get(col) : std::to_string(col + 1));
+                        }
+
+                        std::lock_guard<std::mutex> h5Lock(GetH5LibraryMutex());
+                        if(outI.size() > 0) {
+                            datasetI.resize({nnz + outI.size()});
+                            datasetX.resize({nnz + outX.size()});
+                            datasetI.select({nnz}, {outI.size()}).write(outI.data());
+                            datasetX.select({nnz}, {outX.size()}).write(outX.data());
+                        }
+                        datasetP.resize({n_cols + block.n_cols + 1});
+                        datasetP.select({n_cols + 1}, {block.n_cols}).write(outP.data());
+                        datasetColNames.resize({n_cols + block.n_cols});
+                        datasetColNames.select({n_cols}, {block.n_cols}).write(outNames);
+                        nnz += outI.size();
+                        n_cols += block.n_cols;
+                    }
+                }
+                Close(inFile);
+                inFile = nullptr;
+            }
+
+            HighFive::DataSet datasetRowNames = outFile->createDataSet<std::string>(outGroupName + "/features", HighFive::DataSpace::From(arrFeatures));
+            datasetRowNames.write(arrFeatures);
+
+            std::vector<unsigned int> outDims = {(unsigned int)arrFeatures.size(), (unsigned int)n_cols};
+            WriteDatasetFromPtr<unsigned int>(outFile, outGroupName + "/shape", outDims.data(), outDims.size());
+            outFile->flush();
+        } catch (std::exception& err) {
+            std::stringstream ostr;
+            ostr << "MergeGroupsToGroup HDF5 format, error=" << err.what() ;
+            Close(inFile);
+            Close(outFile);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+    }
+
+    // Build a federated group over sample groups that share one feature space. indices and data
+    // are HDF5 virtual datasets concatenating the samples' own datasets, so no counts are copied;
+    // only indptr (shifted by each sample's nnz offset), prefixed barcodes, shape and features are
+    // written. The manifest (sources, source_groups, source_cols) records where columns come from.
+    void FederateGroups(const std::vector<std::string> &filePaths, const std::vector<std::string> &groupNames,
+                        const std::vector<std::string> &prefixes, HighFive::File *outFile, const std::string &outGroupName) {
+        if(outFile == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not federate sparse matrices, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        if(outFile->exist(outGroupName) == true) {
+            std::stringstream ostr;
+            ostr << "Existing group :" << outGroupName;
+            Close(outFile);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        // Types of indices/data of the first input and the open input, released on every error path
+        hid_t indicesType = -1;
+        hid_t dataType = -1;
+        HighFive::File *inFile = nullptr;
+        try {
+            outFile->createGroup(outGroupName);
+            HighFive::DataSet datasetP = CreateExtendibleDataSet<unsigned int>(outFile, outGroupName + "/indptr", 1, 1 << 12);
+            HighFive::DataSet datasetColNames = CreateExtendibleDataSet<std::string>(outFile, outGroupName + "/barcodes", 0, 1 << 12);
+            std::vector<unsigned int> firstPtr(1, 0);
+            datasetP.write(firstPtr.data());
+
+            std::vector<std::string> arrFeatures;
+            std::vector<std::size_t> arrNnz(filePaths.size());
+            std::vector<unsigned int> arrColOffsets(1, 0);
+            std::size_t nnz = 0;
+            for(std::size_t s = 0; s < filePaths.size(); s++) {
+                Hdf5Util oInputUtil(filePaths[s]);
+                inFile = oInputUtil.Open(1);
+                if(inFile == nullptr || inFile->exist(groupNames[s]) == false) {
+                    std::stringstream ostr;
+                    ostr << "Can not read group " << groupNames[s] << " in " << filePaths[s];
+                    CloseTypes(indicesType, dataType);
+                    oInputUtil.Close(inFile);
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+
+                H5StringPool oFeaturePool;
+                oFeaturePool.Read(inFile->getDataSet(groupNames[s] + "/" + GetFeatureSlot(inFile, groupNames[s])));
+                bool sameFeatures = (s == 0) || (oFeaturePool.size() == arrFeatures.size());
+                for(std::size_t r = 0; r < oFeaturePool.size() && sameFeatures == true; r++) {
+                    if(s == 0) {
+                        arrFeatures.push_back(oFeaturePool.Get(r));
+                    } else {
+                        sameFeatures = (oFeaturePool.Get(r) == arrFeatures[r]);
+                    }
+                }
+
+                HighFive::DataSet sourceI = inFile->getDataSet(groupNames[s] + "/indices");
+                HighFive::DataSet sourceX = inFile->getDataSet(groupNames[s] + "/data");
+                hid_t sourceIType = H5Dget_type(sourceI.getId());
+                hid_t sourceXType = H5Dget_type(sourceX.getId());
+                bool sameTypes = true;
+                if(s == 0) {
+                    indicesType = sourceIType;
+                    dataType = sourceXType;
+                } else {
+                    sameTypes = (H5Tequal(indicesType, sourceIType) > 0) && (H5Tequal(dataType, sourceXType) > 0);
+                    H5Tclose(sourceIType);
+                    H5Tclose(sourceXType);
+                }
+
+                if(sameFeatures == false || sameTypes == false) {
+                    std::stringstream ostr;
+                    ostr << groupNames[s] << " in " << filePaths[s] << (sameFeatures ? " stores indices/data with other types than " : " has other features than ")
+                         << groupNames[0] << " in " << filePaths[0];
+                    CloseTypes(indicesType, dataType);
+                    oInputUtil.Close(inFile);
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+
+                // Only the columns counted by shape: indptr may be longer after an interrupted append.
+                // Read with HighFive directly so a failure reaches the catch below and is cleaned up
+                std::vector<unsigned int> arrDims;
+                inFile->getDataSet(groupNames[s] + "/shape").read(arrDims);
+                std::size_t n_cols = arrColOffsets.back();
+                std::size_t new_cols = arrDims[1];
+                std::vector<unsigned int> arrP;
+                inFile->getDataSet(groupNames[s] + "/indptr").select({0}, {new_cols + 1}).read(arrP);
+                arrNnz[s] = arrP[new_cols];
+
+                // indptr is stored as unsigned int, so the federated matrix must stay below 2^32 nonzeros
+                if(nnz + arrNnz[s] > std::numeric_limits<unsigned int>::max()) {
+                    std::stringstream ostr;
+                    ostr << "Federating " << groupNames[s] << " in " << filePaths[s] << " goes over "
+                         << std::numeric_limits<unsigned int>::max() << " nonzeros, the limit of a 32-bit indptr";
+                    CloseTypes(indicesType, dataType);
+                    oInputUtil.Close(inFile);
+                    Close(outFile);
+                    ::Rf_error(ostr.str().c_str());
+                    throw;
+                }
+
+                std::vector<std::string> outNames(new_cols);
+                H5StringPool oBarcodePool;
+                if(inFile->exist(groupNames[s] + "/barcodes") == true) {
+                    oBarcodePool.Read(inFile->getDataSet(groupNames[s] + "/barcodes"));
+                }
+                for(std::size_t c = 0; c < new_cols; c++) {
+                    arrP[c + 1] += nnz;
+                    outNames[c] = prefixes[s] + (oBarcodePool.size() > 0 ? oBarcodePool.Get(c) : std::to_string(c + 1));
+                }
+                oInputUtil.Close(inFile);
+                inFile = nullptr;
+
+                if(new_cols > 0) {
+                    datasetP.resize({n_cols + new_cols + 1});
+                    datasetP.select({n_cols + 1}, {new_cols}).write(arrP.data() + 1);
+                    datasetColNames.resize({n_cols + new_cols});
+                    datasetColNames.select({n_cols}, {new_cols}).write(outNames);
+                }
+                arrColOffsets.push_back(n_cols + new_cols);
+                nnz += arrNnz[s];
+            }
+
+            CreateVirtualConcat(outFile, outGroupName + "/indices", indicesType, filePaths, groupNames, "indices", arrNnz);
+            CreateVirtualConcat(outFile, outGroupName + "/data", dataType, filePaths, groupNames, "data", arrNnz);
+            CloseTypes(indicesType, dataType);
+
+            HighFive::DataSet datasetRowNames = outFile->createDataSet<std::string>(outGroupName + "/features", HighFive::DataSpace::From(arrFeatures));
+            datasetRowNames.write(arrFeatures);
+
+            std::vector<unsigned int> outDims = {(unsigned int)arrFeatures.size(), arrColOffsets.back()};
+            WriteDatasetFromPtr<unsigned int>(outFile, outGroupName + "/shape", outDims.data(), outDims.size());
+
+            HighFive::DataSet datasetSources = outFile->createDataSet<std::string>(outGroupName + "/sources", HighFive::DataSpace::From(filePaths));
+            datasetSources.write(filePaths);
+            HighFive::DataSet datasetSourceGroups = outFile->createDataSet<std::string>(outGroupName + "/source_groups", HighFive::DataSpace::From(groupNames));
+            datasetSourceGroups.write(groupNames);
+            WriteDatasetFromPtr<unsigned int>(outFile, outGroupName + "/source_cols", arrColOffsets.data(), arrColOffsets.size());
+
+            outFile->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "FederateGroups HDF5 format, error=" << err.what() ;
+            CloseTypes(indicesType, dataType);
+            Close(inFile);
+            Close(outFile);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+    }
+
+    // Drop everything derived from a group's matrix: row/column sums, the gene-major copy and the binary cache
+    void InvalidateCachedStats(HighFive::File *file, const std::string &groupName) {
+        std::vector<std::string> arrDerived = {getRowsumDatasetName(), getColsumDatasetName()};
+        for(const std::string &datasetName : arrDerived) {
+            if(file->exist(groupName + "/" + datasetName) == true) {
+                H5Ldelete(file->getId(), (groupName + "/" + datasetName).c_str(), H5P_DEFAULT);
+            }
+        }
+
+        std::string tGroupName = getTransposedGroupName(groupName);
+        if(file->exist(tGroupName) == true) {
+            H5Ldelete(file->getId(), tGroupName.c_str(), H5P_DEFAULT);
+        }
+        file->flush();
+
+        std::string cachePath = GetH5FilePathOfGroupName(groupName);
+        if(CheckFileExist(cachePath) == true) {
+            std::remove(cachePath.c_str());
+        }
+    }
+
+    void WriteSpMtDualLayout(HighFive::File *file, const Rcpp::S4 &mat, const std::string &groupName) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not write dataset, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        WriteSpMtFromS4(file, mat, groupName);
+
+        try {
+            Rcpp::IntegerVector dims = mat.slot("Dim");
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::List dim_names = mat.slot("Dimnames");
+
+            std::vector<unsigned int> arrIndptr;
+            std::vector<unsigned int> arrIndices;
+            std::vector<double> arrData;
+            TransposeCSC(p, i, x, (unsigned int)dims[0], (unsigned int)dims[1], arrIndptr, arrIndices, arrData);
+
+            std::string tGroupName = getTransposedGroupName(groupName);
+            CreateTransposedGroup(file, tGroupName, (unsigned int)dims[0], (unsigned int)dims[1], arrData.size());
+
+            HighFive::DataSet datasetI = file->getDataSet(tGroupName + "/indices");
+            datasetI.write(arrIndices);
+            HighFive::DataSet datasetP = file->getDataSet(tGroupName + "/indptr");
+            datasetP.write(arrIndptr);
+            HighFive::DataSet datasetX = file->getDataSet(tGroupName + "/data");
+            datasetX.write(arrData);
+
+            Rcpp::CharacterVector rownames = dim_names[0];
+            Rcpp::CharacterVector colnames = dim_names[1];
+            std::vector<std::string> arrRowNames(rownames.begin(), rownames.end());
+            std::vector<std::string> arrColNames(colnames.begin(), colnames.end());
+            WriteTransposedNames(file, tGroupName, arrRowNames, arrColNames);
+
+            file->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "WriteSpMtDualLayout HDF5 format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+    }
+
+    void WriteDualLayoutFromH5(HighFive::File *file, const std::string &groupName, const std::size_t &memLimit) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not write dataset, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string tGroupName = getTransposedGroupName(groupName);
+        std::string spillBase;
+        std::size_t n_spills = 0;
+        try {
+            if(file->exist(groupName) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist group :" << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            if(file->exist(tGroupName) == true) {
+                std::stringstream ostr;
+                ostr << "Existing group :" << tGroupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            std::vector<unsigned int> arrDims;
+            ReadDatasetVector<unsigned int>(file, groupName, "shape", arrDims);
+            std::vector<unsigned int> arrIndptr;
+            ReadDatasetVector<unsigned int>(file, groupName, "indptr", arrIndptr);
+
+            unsigned int n_rows = arrDims[0];
+            unsigned int n_cols = arrDims[1];
+            std::size_t nnz = arrIndptr[n_cols];
+            std::size_t blockEntries = std::max<std::size_t>(memLimit / (2 * (sizeof(unsigned int) + sizeof(double))), 1);
+
+            // Pass 1: count nonzeros per row, one column block at a time
+            std::vector<unsigned int> t_p(n_rows + 1, 0);
+            for (unsigned int start = 0; start < n_cols;) {
+                unsigned int end = NextColumnBlock(arrIndptr, start, n_cols, blockEntries);
+                if (arrIndptr[end] > arrIndptr[start]) {
+                    std::vector<unsigned int> arrIndices;
+                    ReadDatasetRangeVector<unsigned int>(file, groupName, "indices", arrIndptr[start], arrIndptr[end], arrIndices);
+                    for (const unsigned int &r : arrIndices) {
+                        t_p[r + 1]++;
+                    }
+                }
+                start = end;
+            }
+            for (unsigned int r = 0; r < n_rows; r++) {
+                t_p[r + 1] += t_p[r];
+            }
+
+            // Split rows into buckets whose transposed slice fits in memLimit
+            std::vector<unsigned int> bucketStart = {0};
+            // Pass 3 holds a bucket's spill entries and its transposed indices and values at once
+            std::size_t bucketEntries = std::max<std::size_t>(memLimit / (sizeof(SpillEntry) + sizeof(unsigned int) + sizeof(double)), 1);
+            for (unsigned int r = 0; r < n_rows; r++) {
+                if ((t_p[r + 1] - t_p[bucketStart.back()] > bucketEntries) && (r > bucketStart.back())) {
+                    bucketStart.push_back(r);
+                }
+            }
+            bucketStart.push_back(n_rows);
+            std::size_t n_buckets = bucketStart.size() - 1;
+
+            CreateTransposedGroup(file, tGroupName, n_rows, n_cols, nnz);
+            HighFive::DataSet datasetP = file->getDataSet(tGroupName + "/indptr");
+            datasetP.write(t_p);
+            HighFive::DataSet datasetI = file->getDataSet(tGroupName + "/indices");
+            HighFive::DataSet datasetX = file->getDataSet(tGroupName + "/data");
+
+            if (n_buckets == 1) {
+                std::vector<unsigned int> t_i(nnz);
+                std::vector<double> t_x(nnz);
+                std::vector<unsigned int> next(t_p.begin(), t_p.end() - 1);
+                for (unsigned int start = 0; start < n_cols;) {
+                    unsigned int end = NextColumnBlock(arrIndptr, start, n_cols, blockEntries);
+                    if (arrIndptr[end] > arrIndptr[start]) {
+                        std::vector<unsigned int> arrIndices;
+                        std::vector<double> arrData;
+                        ReadDatasetRangeVector<unsigned int>(file, groupName, "indices", arrIndptr[start], arrIndptr[end], arrIndices);
+                        ReadDatasetRangeVector<double>(file, groupName, "data", arrIndptr[start], arrIndptr[end], arrData);
+                        for (unsigned int c = start; c < end; c++) {
+                            for (unsigned int k = arrIndptr[c] - arrIndptr[start]; k < arrIndptr[c + 1] - arrIndptr[start]; k++) {
+                                unsigned int pos = next[arrIndices[k]]++;
+                                t_i[pos] = c;
+                                t_x[pos] = arrData[k];
+                            }
+                        }
+                    }
+                    start = end;
+                }
+                if (nnz > 0) {
+                    datasetI.write(t_i);
+                    datasetX.write(t_x);
+                }
+            } else {
+                // Pass 2: scatter nonzeros into one spill file per row bucket, in column order
+                std::vector<unsigned int> rowBucket(n_rows);
+                for (std::size_t b = 0; b < n_buckets; b++) {
+                    std::fill(rowBucket.begin() + bucketStart[b], rowBucket.begin() + bucketStart[b + 1], (unsigned int)b);
+                }
+
+                std::vector<std::ofstream> spills(n_buckets);
+                std::vector<std::vector<SpillEntry>> buffers(n_buckets);
+                const std::size_t spillBufferSize = 4096;
+                spillBase = GetSpillFileBase();
+                n_spills = n_buckets;
+                for (std::size_t b = 0; b < n_buckets; b++) {
+                    spills[b].open(GetSpillFilePath(spillBase, b), std::ios::out | std::ios::binary | std::ios::trunc);
+                    if (spills[b].is_open() == false) {
+                        throw std::runtime_error("Can not open spill file :" + GetSpillFilePath(spillBase, b));
+                    }
+                    buffers[b].reserve(spillBufferSize);
+                }
+
+                for (unsigned int start = 0; start < n_cols;) {
+                    unsigned int end = NextColumnBlock(arrIndptr, start, n_cols, blockEntries);
+                    if (arrIndptr[end] > arrIndptr[start]) {
+                        // Read with HighFive directly so a failure reaches the catch below and the spill files are removed
+                        std::size_t count = arrIndptr[end] - arrIndptr[start];
+                        std::vector<unsigned int> arrIndices(count);
+                        std::vector<double> arrData(count);
+                        file->getDataSet(groupName + "/indices").select({arrIndptr[start]}, {count}).read(arrIndices.data());
+                        file->getDataSet(groupName + "/data").select({arrIndptr[start]}, {count}).read(arrData.data());
+                        for (unsigned int c = start; c < end; c++) {
+                            for (unsigned int k = arrIndptr[c] - arrIndptr[start]; k < arrIndptr[c + 1] - arrIndptr[start]; k++) {
+                                unsigned int b = rowBucket[arrIndices[k]];
+                                buffers[b].push_back({arrIndices[k], c, arrData[k]});
+                                if (buffers[b].size() == spillBufferSize) {
+                                    spills[b].write(reinterpret_cast<const char *>(buffers[b].data()), buffers[b].size() * sizeof(SpillEntry));
+                                    if (spills[b].fail() == true) {
+                                        throw std::runtime_error("Can not write spill file :" + GetSpillFilePath(spillBase, b));
+                                    }
+                                    buffers[b].clear();
+                                }
+                            }
+                        }
+                    }
+                    start = end;
+                }
+
+                for (std::size_t b = 0; b < n_buckets; b++) {
+                    spills[b].write(reinterpret_cast<const char *>(buffers[b].data()), buffers[b].size() * sizeof(SpillEntry));
+                    spills[b].close();
+                    if (spills[b].fail() == true) {
+                        throw std::runtime_error("Can not write spill file :" + GetSpillFilePath(spillBase, b));
+                    }
+                    std::vector<SpillEntry>().swap(buffers[b]);
+                }
+
+                // Pass 3: place each bucket into its contiguous slice of the transposed datasets
+                for (std::size_t b = 0; b < n_buckets; b++) {
+                    std::size_t offset = t_p[bucketStart[b]];
+                    std::size_t count = t_p[bucketStart[b + 1]] - offset;
+                    std::string spillPath = GetSpillFilePath(spillBase, b);
+
+                    if (count > 0) {
+                        std::vector<SpillEntry> entries(count);
+                        std::ifstream spill(spillPath, std::ios::in | std::ios::binary);
+                        spill.read(reinterpret_cast<char *>(entries.data()), count * sizeof(SpillEntry));
+                        if (spill.is_open() == false || (std::size_t)spill.gcount() != count * sizeof(SpillEntry)) {
+                            throw std::runtime_error("Can not read spill file :" + spillPath);
+                        }
+                        spill.close();
+
+                        std::vector<unsigned int> t_i(count);
+                        std::vector<double> t_x(count);
+                        std::vector<std::size_t> next(bucketStart[b + 1] - bucketStart[b]);
+                        for (unsigned int r = bucketStart[b]; r < bucketStart[b + 1]; r++) {
+                            next[r - bucketStart[b]] = t_p[r] - offset;
+                        }
+                        for (const SpillEntry &entry : entries) {
+                            std::size_t pos = next[entry.row - bucketStart[b]]++;
+                            t_i[pos] = entry.col;
+                            t_x[pos] = entry.value;
+                        }
+
+                        datasetI.select({offset}, {count}).write(t_i);
+                        datasetX.select({offset}, {count}).write(t_x);
+                    }
+                    std::remove(spillPath.c_str());
+                }
+            }
+
+            std::string feature_slot = GetFeatureSlot(file, groupName);
+            std::vector<std::string> arrFeature;
+            ReadDatasetVector(file, groupName, feature_slot, arrFeature);
+            std::vector<std::string> arrBarcode;
+            if (file->exist(groupName + "/barcodes")) {
+                ReadDatasetVector(file, groupName, "barcodes", arrBarcode);
+            }
+            arrBarcode.resize(n_cols, "col");
+            WriteTransposedNames(file, tGroupName, arrFeature, arrBarcode);
+
+            file->flush();
+        } catch (std::exception& err) {
+            // HDF5 or spill file error: do not leave spill files or a partial transposed layout behind
+            for (std::size_t b = 0; b < n_spills; b++) {
+                std::remove(GetSpillFilePath(spillBase, b).c_str());
+            }
+            try {
+                if (file->exist(tGroupName) == true) {
+                    H5Ldelete(file->getId(), tGroupName.c_str(), H5P_DEFAULT);
+                }
+            } catch (HighFive::Exception&) {
+            }
+            Close(file);
+            std::stringstream ostr;
+            ostr << "WriteDualLayoutFromH5 error=" << err.what();
+            ::Rf_error(ostr.str().c_str());
+        }
+    }
+
+    bool CheckFileExist(const std::string &file_path)
+    {
+        std::ifstream infile(file_path);
+        return infile.good();
+    }
+
+    arma::sp_mat ReadSpMtAsArma(const std::string &groupName) {
+        arma::sp_mat mat;
+        std::string filePath = GetH5FilePathOfGroupName(groupName);
+        if(CheckFileExist(filePath) == true)
+        {
+            if(SpMtCache::IsCacheFile(filePath) == true) {
+                SpMtCache oSpMtCache(filePath);
+                if(oSpMtCache.Open() == true && oSpMtCache.CheckRowIndices() == true) {
+                    mat = oSpMtCache.ToArma();
+                }
+                return mat;
+            }
+
+            // Sidecar written by arma::sp_mat::save before the binary cache format
+            mat.load(filePath);
+            return mat;
+        }
+        return mat;
+    }
+
+    bool ReadSpMtCacheAsS4(const std::string &groupName, Rcpp::S4 &s) {
+        std::string filePath = GetH5FilePathOfGroupName(groupName);
+        if(SpMtCache::IsCacheFile(filePath) == false) {
+            return false;
+        }
+
+        SpMtCache oSpMtCache(filePath);
+        if(oSpMtCache.Open() == false || oSpMtCache.CheckRowIndices() == false) {
+            return false;
+        }
+
+        s = oSpMtCache.ToS4();
+        return true;
+    }
+
+    // Row (margin 1) or column (margin 2) sums streamed from the H5 group, the next block of
+    // columns being read on the I/O thread while the current one is summed
+    void StreamSpMtSums(HighFive::File *file, const std::string &groupName, const int &margin, std::vector<double> &sumVec) {
+        H5Prefetcher oH5Prefetcher(file, groupName, 1 << 22);
+        oH5Prefetcher.Start();
+        sumVec.assign(margin == 1 ? oH5Prefetcher.GetNumRows() : oH5Prefetcher.GetNumCols(), 0);
+
+        H5ColumnBlock block;
+        while(oH5Prefetcher.Next(block) == true) {
+            for(std::size_t c = 0; c < block.n_cols; c++) {
+                for(unsigned int k = block.p[c]; k < block.p[c + 1]; k++) {
+                    if(margin == 1) {
+                        sumVec[block.i[k]] += block.x[k];
+                    } else {
+                        sumVec[block.col_start + c] += block.x[k];
+                    }
+                }
+            }
+        }
+    }
+
+    // Row (margin 1) or column (margin 2) sums straight from the mapped cache, without building a matrix
+    bool ReadSpMtCacheSums(const std::string &groupName, const int &margin, std::vector<double> &sumVec) {
+        std::string filePath = GetH5FilePathOfGroupName(groupName);
+        if(SpMtCache::IsCacheFile(filePath) == false) {
+            return false;
+        }
+
+        SpMtCache oSpMtCache(filePath);
+        if(oSpMtCache.Open() == false) {
+            return false;
+        }
+
+        const int32_t *p = oSpMtCache.GetColPtr();
+        const int32_t *i = oSpMtCache.GetRowIndices();
+        const double *x = oSpMtCache.GetValues();
+        std::size_t n_rows = oSpMtCache.GetNumRows();
+        std::size_t n_cols = oSpMtCache.GetNumCols();
+        sumVec.assign((margin == 1) ? n_rows : n_cols, 0);
+        for(std::size_t c = 0; c < n_cols; c++) {
+            for(int32_t k = p[c]; k < p[c + 1]; k++) {
+                if(i[k] < 0 || (std::size_t)i[k] >= n_rows) {
+                    sumVec.clear();
+                    return false;
+                }
+                sumVec[(margin == 1) ? i[k] : c] += x[k];
+            }
+        }
+        return true;
+    }
+
+    // Row (margin 1) or column (margin 2) sums of a group: the stored rowsums/colsums when the
+    // group has them, otherwise computed from the binary cache or streamed from the group and then
+    // stored in it, so the next call reads them back
+    void ReadSpMtSums(const std::string &groupName, const int &margin, std::vector<double> &sumVec) {
+        HighFive::File *file = Open(1);
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not open HDF5 file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+        }
+
+        std::string datasetName = (margin == 1) ? getRowsumDatasetName() : getColsumDatasetName();
+        std::string error;
+        bool persist = false;
+        try {
+            if(file->exist(groupName) == false) {
+                error = "Can not exist group :" + groupName;
+            } else if(file->exist(groupName + "/" + datasetName) == true) {
+                file->getDataSet(groupName + "/" + datasetName).read(sumVec);
+            } else {
+                if(ReadSpMtCacheSums(groupName, margin, sumVec) == false) {
+                    StreamSpMtSums(file, groupName, margin, sumVec);
+                }
+                persist = true;
+            }
+        } catch (std::exception& err) {
+            error = std::string("ReadSpMtSums HDF5 format, error=") + err.what();
+        }
+        Close(file);
+        if(error.empty() == false) {
+            ::Rf_error(error.c_str());
+        }
+
+        // Keep the sums for the next call; a file that can not be opened for writing is only read
+        if(persist == true) {
+            file = Open(-1);
+            if(file != nullptr) {
+                WriteDatasetVector<double>(file, groupName, datasetName, sumVec);
+                Close(file);
+            }
+        }
+    }
+
+    Rcpp::S4 ReadSpMtAsS4(HighFive::File *file, const std::string &groupName) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read sparse matrix, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        std::string klass = "dgCMatrix";
+        Rcpp::S4 s(klass);
+
+        try {
+            if(file->exist(groupName) == false) {
+                std::stringstream ostr;
+                ostr << "Can not exist group :" << groupName;
+                ::Rf_error(ostr.str().c_str());
+                Close(file);
+                throw;
+            }
+
+            std::string feature_slot = GetFeatureSlot(file, groupName);
+
+            std::vector<std::string> arrDatasetName = {"data", "indices", "indptr", "shape", feature_slot};
+            for(const std::string &datasetName : arrDatasetName) {
+                if(file->exist(groupName + "/" + datasetName) == false) {
+                    std::stringstream ostr;
+                    ostr << "Can not exist dataset : " << datasetName << " in " << groupName;
+                    ::Rf_error(ostr.str().c_str());
+                    Close(file);
+                    throw;
+                }
+            }
+
+            // Allocate the slots first and let HDF5 read into R memory. shape decides how much
+            // of indptr and barcodes is read: an interrupted append may have grown them already
+            Rcpp::IntegerVector arrDims(GetDatasetSize(file, groupName, "shape"));
+            ReadDatasetVector<int>(file, groupName, "shape", arrDims.begin());
+            std::size_t n_cols = arrDims[1];
+            Rcpp::IntegerVector arrIndptr(n_cols + 1);
+            file->getDataSet(groupName + "/indptr").select({0}, {n_cols + 1}).read(&arrIndptr[0]);
+            std::size_t n_nonzeros = arrIndptr[n_cols];
+            Rcpp::IntegerVector arrIndices(n_nonzeros);
+            Rcpp::NumericVector arrData(n_nonzeros);
+            if(n_nonzeros > 0) {
+                file->getDataSet(groupName + "/indices").select({0}, {n_nonzeros}).read(&arrIndices[0]);
+                file->getDataSet(groupName + "/data").select({0}, {n_nonzeros}).read(&arrData[0]);
+            }
+            H5StringPool oFeaturePool;
+            oFeaturePool.Read(file->getDataSet(groupName + "/" + feature_slot));
+
+            s.slot("p") = arrIndptr;
+            s.slot("i") = arrIndices;
+            s.slot("x") = arrData;
+            s.slot("Dim") = arrDims;
+
+            if (file->exist(groupName + "/" + "barcodes")) {
+              H5StringPool oBarcodePool;
+              oBarcodePool.Read(file->getDataSet(groupName + "/barcodes"));
+              Rcpp::CharacterVector arrBarcode = oBarcodePool.ToCharacterVector();
+              if((std::size_t)arrBarcode.size() > n_cols) {
+                  arrBarcode.erase(arrBarcode.begin() + n_cols, arrBarcode.end());
+              }
+              s.slot("Dimnames") = Rcpp::List::create(oFeaturePool.ToCharacterVector(), arrBarcode);
+            } else{
+              Rcpp::CharacterVector arrBarcode(arrDims[1], "col");
+              s.slot("Dimnames") = Rcpp::List::create(oFeaturePool.ToCharacterVector(), arrBarcode);
+            }
+            return s;
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "ReadSpMtAsS4 in HDF5 format, error=" << err.what();
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+
+        return s;
+    }
+
+    // Write a dgCMatrix in the 10x V3 layout: data/indices/indptr/shape/barcodes and features/{id, name}
+    // in groupName, plus features/feature_type and features/genome when given (one entry per row)
+    void Write10XH5(HighFive::File *file, const Rcpp::S4 &mat, const std::string &groupName,
+                    const std::vector<std::string> &featureTypes, const std::vector<std::string> &genomes) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not write dataset, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        Rcpp::IntegerVector dims = mat.slot("Dim");
+        if((featureTypes.size() > 0 && featureTypes.size() != (std::size_t)dims[0]) ||
+           (genomes.size() > 0 && genomes.size() != (std::size_t)dims[0])) {
+            Close(file);
+            ::Rf_error("Feature types and genomes must have one entry per row");
+        }
+
+        try {
+            if(file->exist(groupName) == true) {
+                std::stringstream ostr;
+                ostr << "Existing group :" << groupName;
+                Close(file);
+                ::Rf_error(ostr.str().c_str());
+                throw;
+            }
+
+            Rcpp::IntegerVector i = mat.slot("i");
+            Rcpp::IntegerVector p = mat.slot("p");
+            Rcpp::NumericVector x = mat.slot("x");
+            Rcpp::List dim_names = mat.slot("Dimnames");
+
+            file->createGroup(groupName + "/features");
+            WriteDatasetFromPtr<int>(file, groupName + "/shape", dims.begin(), dims.size());
+            WriteDatasetFromPtr<long long>(file, groupName + "/indices", i.begin(), i.size());
+            WriteDatasetFromPtr<long long>(file, groupName + "/indptr", p.begin(), p.size());
+            WriteDatasetFromPtr<double>(file, groupName + "/data", x.begin(), x.size());
+
+            Rcpp::CharacterVector rownames = dim_names[0];
+            std::vector<std::string> arrRowNames(rownames.begin(), rownames.end());
+            Rcpp::CharacterVector colnames = dim_names[1];
+            std::vector<std::string> arrColNames(colnames.begin(), colnames.end());
+            std::vector<std::pair<std::string, const std::vector<std::string>*>> arrNames = {
+                {"features/id", &arrRowNames}, {"features/name", &arrRowNames},
+                {"features/feature_type", &featureTypes}, {"features/genome", &genomes}, {"barcodes", &arrColNames}
+            };
+            for(const auto &names : arrNames) {
+                if(names.second->size() > 0) {
+                    HighFive::DataSet dataset = file->createDataSet<std::string>(groupName + "/" + names.first, HighFive::DataSpace::From(*names.second));
+                    dataset.write(*names.second);
+                }
+            }
+
+            file->flush();
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "Write10XH5 HDF5 format, error=" << err.what() ;
+            Close(file);
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+    }
+
+    Rcpp::List Read10XH5(HighFive::File *file, const std::string &filePath, const bool &use_names, const bool &unique_features, const std::vector<std::string> &featureTypes) {
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not read dataset, please open file :" << file_name;
+            ::Rf_error(ostr.str().c_str());
+            throw;
+        }
+
+        Rcpp::List arrList = Rcpp::List::create();
+        try {
+            std::vector<std::string> genomes;
+            GetListRootObjectNames(file, genomes);
+
+            for(std::string &groupName : genomes) {
+                if(file->exist(groupName) == false) {
+                    std::stringstream ostr;
+                    ostr << "Can not exist group :" << groupName;
+                    ::Rf_error(ostr.str().c_str());
+                    Close(file);
+                    throw;
+                }
+
+                std::string feature_slot;
+                if(file->exist(groupName + "/features") == true) {
+                    ::Rf_warning("FORMAT_VERSION >= 3");
+                    feature_slot = (use_names == true) ? "features/name" : "features/id";
+                    if(file->exist(groupName + "/" + feature_slot) == false) {
+                        feature_slot = (use_names == true) ? "features/id" : "features/name";
+                    }
+                } else {
+                    ::Rf_warning("FORMAT_VERSION < 3");
+                    feature_slot = (use_names == true) ? "gene_names" : "genes";
+                    if(file->exist(groupName + "/" + feature_slot) == false) {
+                        feature_slot = (use_names == true) ? "genes" : "gene_names";
+                    }
+                }
+
+                std::vector<std::string> arrDatasetName = {"data", "indices", "indptr", "shape", feature_slot, "barcodes"};
+                for(const std::string &datasetName : arrDatasetName) {
+                    if(file->exist(groupName + "/" + datasetName) == false) {
+                        std::stringstream ostr;
+                        ostr << "Can not exist dataset : " << datasetName << " in " << groupName;
+                        ::Rf_error(ostr.str().c_str());
+                        Close(file);
+                        throw;
+                    }
+                }
+
+                std::vector<int> arrDims;
+                ReadDatasetVector<int>(file, groupName, "shape", arrDims);
+
+                // 10x H5 is already CSC: read the slots straight into R vectors
+                Rcpp::IntegerVector arrIndices(GetDatasetSize(file, groupName, "indices"));
+                ReadDatasetVector<int>(file, groupName, "indices", arrIndices.begin());
+                Rcpp::IntegerVector arrIndptr(GetDatasetSize(file, groupName, "indptr"));
+                ReadDatasetVector<int>(file, groupName, "indptr", arrIndptr.begin());
+                Rcpp::NumericVector arrData(GetDatasetSize(file, groupName, "data"));
+                ReadDatasetVector<double>(file, groupName, "data", arrData.begin());
+                std::vector<std::string> arrFeature;
+                ReadDatasetVector(file, groupName, feature_slot, arrFeature);
+                H5StringPool oBarcodePool;
+                oBarcodePool.Read(file->getDataSet(groupName + "/barcodes"));
+                Rcpp::CharacterVector arrBarcode = oBarcodePool.ToCharacterVector();
+
+                std::vector<std::string> arrFeatureType;
+                if(file->exist(groupName + "/features/feature_type") == true) {
+                    ReadDatasetVector(file, groupName, "features/feature_type", arrFeatureType);
+                }
+
+                std::vector<std::string> arrFeatureGenome;
+                if(file->exist(groupName + "/features/genome") == true) {
+                    ReadDatasetVector(file, groupName, "features/genome", arrFeatureGenome);
+                }
+
+                // V2 layout: no per-feature annotation, the group is one matrix
+                if(arrFeatureType.size() == 0 && arrFeatureGenome.size() == 0) {
+                    if (unique_features == true) {
+                        MakeUnique(arrFeature, ".");
+                    }
+
+                    arrList[groupName] = BuildDgCMatrix(arrIndices, arrIndptr, arrData, arrDims[0], arrDims[1], arrFeature, arrBarcode);
+                    continue;
+                }
+
+                arrList[groupName] = Split10XFeatures(arrIndices, arrIndptr, arrData, arrDims[0], arrDims[1], arrFeature, arrBarcode,
+                                                      arrFeatureGenome, arrFeatureType, featureTypes, groupName, unique_features);
+            }
+        } catch (HighFive::Exception& err) {
+            std::stringstream ostr;
+            ostr << "Read10XH5 HDF5 format, error=" << err.what() ;
+            ::Rf_error(ostr.str().c_str());
+            Close(file);
+            throw;
+        }
+
+        return arrList;
+    }
+
+    std::string GetFeatureSlot(HighFive::File *file, const std::string &groupName) {
+        std::string feature_slot;
+        if(file->exist(groupName + "/features") == true) {
+            if((file->exist(groupName + "/features/id") == true) || (file->exist(groupName + "/features/name") == true)) {
+                feature_slot = "features/id";
+                if(file->exist(groupName + "/" + feature_slot) == false) {
+                    feature_slot = "features/name";
+                }
+            } else {
+                feature_slot = "features";
+            }
+        } else {
+            feature_slot = "genes";
+            if(file->exist(groupName + "/" + feature_slot) == false) {
+                feature_slot = "gene_names";
+            }
+        }
+        return feature_slot;
+    }
+
+    // End column (exclusive) of the block starting at start, holding at most blockEntries nonzeros
+    template <typename T>
+    unsigned int NextColumnBlock(const std::vector<T> &indptr, const unsigned int &start, const unsigned int &n_cols, const std::size_t &blockEntries) {
+        unsigned int end = start + 1;
+        while ((end < n_cols) && ((std::size_t)(indptr[end + 1] - indptr[start]) <= blockEntries)) {
+            end++;
+        }
+        return end;
+    }
+
+    HighFive::File *Open(const int &mode) {
+        HighFive::File *file = nullptr;
+        try {
+            int new_mode = HighFive::File::OpenOrCreate;
+            switch(mode) {
+            case -1:
+                new_mode = HighFive::File::OpenOrCreate;
+                break;
+            default:
+                new_mode = HighFive::File::ReadOnly;
+            break;
+            }
+            file = new HighFive::File(file_name, new_mode);
+        } catch (HighFive::Exception& err) {
+            std::cerr << "Can not open HDF5 file, error=" << err.what() << std::endl;
+        }
+        return file;
+    }
+
+    void Close(HighFive::File *file) {
+        if(file != nullptr) {
+            delete file;
+        }
+    }
+
+protected:
+    Rcpp::S4 BuildDgCMatrix(const Rcpp::IntegerVector &i, const Rcpp::IntegerVector &p, const Rcpp::NumericVector &x,
+                            const int &n_rows, const int &n_cols,
+                            const std::vector<std::string> &rowNames, const Rcpp::CharacterVector &colNames) {
+        std::string klass = "dgCMatrix";
+        Rcpp::S4 mat(klass);
+        mat.slot("i") = i;
+        mat.slot("p") = p;
+        mat.slot("x") = x;
+        mat.slot("Dim") = Rcpp::IntegerVector::create(n_rows, n_cols);
+        mat.slot("Dimnames") = Rcpp::List::create(rowNames, colNames);
+        return mat;
+    }
+
+    // Distribute the nonzeros of a 10x CSC into one matrix per (genome, feature type) in a single pass.
+    // Feature types missing from featureTypes are dropped (empty featureTypes keeps all).
+    // Returns list(genome = list(feature_type = dgCMatrix)).
+    Rcpp::List Split10XFeatures(const Rcpp::IntegerVector &arrIndices, const Rcpp::IntegerVector &arrIndptr, const Rcpp::NumericVector &arrData,
+                                const int &n_rows, const int &n_cols,
+                                const std::vector<std::string> &arrFeature, const Rcpp::CharacterVector &arrBarcode,
+                                const std::vector<std::string> &arrFeatureGenome, const std::vector<std::string> &arrFeatureType,
+                                const std::vector<std::string> &featureTypes, const std::string &defaultGenome, const bool &unique_features) {
+        std::unordered_set<std::string> keepTypes(featureTypes.begin(), featureTypes.end());
+        std::vector<std::string> arrGenomeName;
+        std::vector<std::string> arrTypeName;
+        std::map<std::pair<std::string, std::string>, int> bucketMap;
+        std::vector<std::vector<std::string>> bucketFeature;
+
+        // Row -> (bucket, row inside bucket); -1 for filtered feature types
+        std::vector<int> rowBucket(n_rows, -1);
+        std::vector<int> rowLocal(n_rows, 0);
+        for(int r = 0; r < n_rows; r++) {
+            std::string genome = (arrFeatureGenome.size() > 0) ? arrFeatureGenome[r] : defaultGenome;
+            std::string type = (arrFeatureType.size() > 0) ? arrFeatureType[r] : "Gene Expression";
+            if(keepTypes.size() > 0 && keepTypes.count(type) == 0) {
+                continue;
+            }
+
+            auto key = std::make_pair(genome, type);
+            auto it = bucketMap.find(key);
+            if(it == bucketMap.end()) {
+                it = bucketMap.insert(std::make_pair(key, (int)bucketFeature.size())).first;
+                arrGenomeName.push_back(genome);
+                arrTypeName.push_back(type);
+                bucketFeature.push_back(std::vector<std::string>());
+            }
+
+            // Multi-genome references prefix feature names with "<genome>_"
+            std::string feature = arrFeature[r];
+            std::string prefix = genome + GENOME_SEPARATOR;
+            if(feature.size() > prefix.size() && feature.compare(0, prefix.size(), prefix) == 0) {
+                feature = feature.substr(prefix.size());
+            }
+
+            rowBucket[r] = it->second;
+            rowLocal[r] = bucketFeature[it->second].size();
+            bucketFeature[it->second].push_back(feature);
+        }
+
+        std::size_t n_buckets = bucketFeature.size();
+        std::vector<std::size_t> bucketNnz(n_buckets, 0);
+        std::size_t nnz = arrIndptr[n_cols];
+        for(std::size_t k = 0; k < nnz; k++) {
+            int b = rowBucket[arrIndices[k]];
+            if(b >= 0) {
+                bucketNnz[b]++;
+            }
+        }
+
+        std::vector<Rcpp::IntegerVector> bucketI(n_buckets);
+        std::vector<Rcpp::IntegerVector> bucketP(n_buckets);
+        std::vector<Rcpp::NumericVector> bucketX(n_buckets);
+        for(std::size_t b = 0; b < n_buckets; b++) {
+            bucketI[b] = Rcpp::IntegerVector(bucketNnz[b]);
+            bucketX[b] = Rcpp::NumericVector(bucketNnz[b]);
+            bucketP[b] = Rcpp::IntegerVector(n_cols + 1);
+        }
+
+        // Rows of a column are sorted and local rows keep that order, so every bucket stays a valid CSC
+        std::vector<int> fill(n_buckets, 0);
+        for(int c = 0; c < n_cols; c++) {
+            for(int k = arrIndptr[c]; k < arrIndptr[c + 1]; k++) {
+                int b = rowBucket[arrIndices[k]];
+                if(b < 0) {
+                    continue;
+                }
+
+                int pos = fill[b]++;
+                bucketI[b][pos] = rowLocal[arrIndices[k]];
+                bucketX[b][pos] = arrData[k];
+            }
+
+            for(std::size_t b = 0; b < n_buckets; b++) {
+                bucketP[b][c + 1] = fill[b];
+            }
+        }
+
+        Rcpp::List arrGenomeList = Rcpp::List::create();
+        for(std::size_t b = 0; b < n_buckets; b++) {
+            if (unique_features == true) {
+                MakeUnique(bucketFeature[b], ".");
+            }
+
+            Rcpp::List arrTypeList = arrGenomeList.containsElementNamed(arrGenomeName[b].c_str()) ?
+                Rcpp::List(arrGenomeList[arrGenomeName[b]]) : Rcpp::List::create();
+            arrTypeList[arrTypeName[b]] = BuildDgCMatrix(bucketI[b], bucketP[b], bucketX[b], bucketFeature[b].size(), n_cols, bucketFeature[b], arrBarcode);
+            arrGenomeList[arrGenomeName[b]] = arrTypeList;
+        }
+
+        return arrGenomeList;
+    }
+
+    std::string file_name;
 
     std::string GetH5FilePathOfGroupName(const std::string &groupName) {
         std::vector<std::string> arrPath;
@@ -1034,6 +2415,94 @@ private:
         std::string fileGroupPath = boost::replace_all_copy(file_name, fileName, fileGroupName);
         return fileGroupPath;
     }
+
+    // Unique prefix of one transpose's spill files, made by R's tempfile() next to the H5 file
+    // so that concurrent sessions on the same file do not share spill files
+    std::string GetSpillFileBase() {
+        std::size_t pos = file_name.find_last_of("/\\");
+        std::string dirName = (pos == std::string::npos) ? "." : file_name.substr(0, pos);
+        std::string baseName = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
+        Rcpp::Function tempfile("tempfile");
+        return Rcpp::as<std::string>(tempfile(Rcpp::Named("pattern") = baseName + ".", Rcpp::Named("tmpdir") = dirName));
+    }
+
+    std::string GetSpillFilePath(const std::string &spillBase, const std::size_t &bucket) {
+        return spillBase + "." + std::to_string(bucket) + ".spill";
+    }
+
+    // 1-d virtual dataset laying the datasetName of each source group end to end
+    void CreateVirtualConcat(HighFive::File *file, const std::string &datasetPath, const hid_t &dataType,
+                             const std::vector<std::string> &filePaths, const std::vector<std::string> &groupNames,
+                             const std::string &datasetName, const std::vector<std::size_t> &sizes) {
+        hsize_t total = 0;
+        for(const std::size_t &size : sizes) {
+            total += size;
+        }
+
+        hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        hid_t space = H5Screate_simple(1, &total, NULL);
+        hsize_t offset = 0;
+        for(std::size_t s = 0; s < sizes.size(); s++) {
+            if(sizes[s] == 0) {
+                continue;
+            }
+
+            hsize_t count = sizes[s];
+            hid_t sourceSpace = H5Screate_simple(1, &count, NULL);
+            H5Sselect_hyperslab(space, H5S_SELECT_SET, &offset, NULL, &count, NULL);
+            H5Pset_virtual(dcpl, space, filePaths[s].c_str(), (groupNames[s] + "/" + datasetName).c_str(), sourceSpace);
+            H5Sclose(sourceSpace);
+            offset += count;
+        }
+        H5Sselect_all(space);
+
+        hid_t dataset = H5Dcreate2(file->getId(), datasetPath.c_str(), dataType, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Sclose(space);
+        H5Pclose(dcpl);
+        if(dataset < 0) {
+            HighFive::HDF5ErrMapper::ToException<HighFive::DataSetException>("Unable to create virtual dataset " + datasetPath);
+        }
+        H5Dclose(dataset);
+    }
+
+    void CloseTypes(hid_t &indicesType, hid_t &dataType) {
+        if(indicesType >= 0) {
+            H5Tclose(indicesType);
+            indicesType = -1;
+        }
+        if(dataType >= 0) {
+            H5Tclose(dataType);
+            dataType = -1;
+        }
+    }
+
+    template <typename T>
+    HighFive::DataSet CreateExtendibleDataSet(HighFive::File *file, const std::string &datasetName, const std::size_t &size, const hsize_t &chunkSize) {
+        HighFive::DataSetCreateProps props;
+        props.add(HighFive::Chunking(std::vector<hsize_t>{chunkSize}));
+        return file->createDataSet<T>(datasetName, HighFive::DataSpace({size}, {HighFive::DataSpace::UNLIMITED}), props);
+    }
+
+    void CreateTransposedGroup(HighFive::File *file, const std::string &tGroupName, const unsigned int &n_rows, const unsigned int &n_cols, const std::size_t &nnz) {
+        file->createGroup(tGroupName);
+
+        std::vector<unsigned int> arrDims = {n_cols, n_rows};
+        HighFive::DataSet datasetDim = file->createDataSet<unsigned int>(tGroupName + "/shape", HighFive::DataSpace::From(arrDims));
+        datasetDim.write(arrDims);
+
+        file->createDataSet<unsigned int>(tGroupName + "/indptr", HighFive::DataSpace({(std::size_t)n_rows + 1}));
+        file->createDataSet<unsigned int>(tGroupName + "/indices", HighFive::DataSpace({nnz}));
+        file->createDataSet<double>(tGroupName + "/data", HighFive::DataSpace({nnz}));
+    }
+
+    void WriteTransposedNames(HighFive::File *file, const std::string &tGroupName, const std::vector<std::string> &arrRowNames, const std::vector<std::string> &arrColNames) {
+        // Rows of the transposed group are the cells, columns are the features
+        HighFive::DataSet datasetRowNames = file->createDataSet<std::string>(tGroupName + "/features", HighFive::DataSpace::From(arrColNames));
+        datasetRowNames.write(arrColNames);
+
+        HighFive::DataSet datasetColNames = file->createDataSet<std::string>(tGroupName + "/barcodes", HighFive::DataSpace::From(arrRowNames));
+        datasetColNames.write(arrRowNames);
+    }
 };
 
 } // namespace bioturing
@@ -0,0 +1,155 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "KnnUtil.h"
+
+// R matrix (column-major) to row-major points
+std::vector<double> GetRowMajorPoints(const Rcpp::NumericMatrix &mat) {
+    std::size_t n = mat.nrow();
+    std::size_t d = mat.ncol();
+    std::vector<double> points(n * d);
+    for(std::size_t j = 0; j < d; j++) {
+        for(std::size_t r = 0; r < n; r++) {
+            points[r * d + j] = mat[j * n + r];
+        }
+    }
+    return points;
+}
+
+// Query every row of points (row-major, n x d) and return list(index, distance), n x k, 1-based
+Rcpp::List QueryKnnPoints(const com::bioturing::RpForestIndex &index, const std::vector<double> &points, const std::size_t &n,
+                          const int &k, const int &searchK) {
+    if(k < 1) {
+        ::Rf_error("k must be positive");
+    }
+    std::size_t n_dims = index.GetNumDims();
+    std::size_t search = (searchK > 0) ? searchK : k * index.GetNumTrees();
+    std::vector<int> indices(n * k);
+    std::vector<double> distances(n * k);
+    com::bioturing::KnnQueryWorker queryWorker(index, points.data(), n_dims, k, search, indices, distances);
+    RcppParallel::parallelFor(0, n, queryWorker, 64);
+
+    Rcpp::IntegerMatrix indexMat(n, k);
+    Rcpp::NumericMatrix distanceMat(n, k);
+    for(std::size_t q = 0; q < n; q++) {
+        for(int j = 0; j < k; j++) {
+            int idx = indices[q * k + j];
+            indexMat[j * n + q] = (idx >= 0) ? idx + 1 : NA_INTEGER;
+            distanceMat[j * n + q] = (idx >= 0) ? distances[q * k + j] : NA_REAL;
+        }
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("index") = indexMat,
+        Rcpp::Named("distance") = distanceMat
+    );
+}
+
+//' FindKnn
+//'
+//' Approximate k nearest neighbours of every row of an embedding (e.g. PCA cell embeddings)
+//' by a random projection forest built and queried in parallel. The first neighbour of a
+//' point is usually itself. When filePath is given the index is kept in groupName of that
+//' HDF5 file: an index built on the same embeddings with the same nTrees, leafSize and seed is
+//' reused, any other is rebuilt.
+//'
+//' @param embeddings A numeric matrix, points x dimensions
+//' @param k Number of neighbours. Default 20
+//' @param nTrees Number of trees. Default 50
+//' @param searchK Candidates examined per query. Default 0 means k * nTrees
+//' @param leafSize Maximum number of points in a leaf. Default 32
+//' @param seed Random seed of the trees. Default 1
+//' @param filePath A string (HDF5 path). Default "" keeps the index in memory only
+//' @param groupName A string (HDF5 group of the index). Default "knn"
+//' @param rebuild Rebuild the index even if filePath holds one. Default FALSE
+//' @return A list of index (1-based) and distance (euclidean) matrices, points x k
+//' @export
+// [[Rcpp::export]]
+Rcpp::List FindKnn(const Rcpp::NumericMatrix &embeddings, const int &k = 20, const int &nTrees = 50, const int &searchK = 0,
+                   const int &leafSize = 32, const int &seed = 1, const std::string &filePath = "",
+                   const std::string &groupName = "knn", const bool &rebuild = false) {
+    std::size_t n = embeddings.nrow();
+    std::size_t d = embeddings.ncol();
+    std::vector<double> points = GetRowMajorPoints(embeddings);
+
+    com::bioturing::RpForestIndex index;
+    bool loaded = false;
+    HighFive::File *file = nullptr;
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    if(filePath.empty() == false) {
+        file = oHdf5Util.Open(-1);
+        if(file == nullptr) {
+            std::stringstream ostr;
+            ostr << "Can not open HDF5 file :" << filePath;
+            ::Rf_error(ostr.str().c_str());
+        }
+    }
+
+    std::stringstream ostr;
+    try {
+        if(file != nullptr && rebuild == false && file->exist(groupName + "/shape") == true) {
+            index.Load(file, groupName);
+            loaded = index.HasData(points, n, d) && index.HasParams(std::max(nTrees, 1), std::max(leafSize, 2), seed);
+        }
+        if(loaded == false) {
+            index.SetData(points, n, d);
+            index.Build(std::max(nTrees, 1), std::max(leafSize, 2), seed);
+            if(file != nullptr) {
+                index.Save(file, groupName);
+            }
+        }
+    } catch(HighFive::Exception& err) {
+        ostr << "FindKnn HDF5 format, error=" << err.what();
+    }
+    oHdf5Util.Close(file);
+    if(ostr.str().empty() == false) {
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    return QueryKnnPoints(index, points, n, k, searchK);
+}
+
+//' QueryKnnIndex
+//'
+//' k nearest indexed points of new points, using an index saved by FindKnn
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group of the index)
+//' @param query A numeric matrix, points x dimensions
+//' @param k Number of neighbours. Default 20
+//' @param searchK Candidates examined per query. Default 0 means k * number of trees
+//' @return A list of index (1-based) and distance (euclidean) matrices, query points x k
+//' @export
+// [[Rcpp::export]]
+Rcpp::List QueryKnnIndex(const std::string &filePath, const std::string &groupName, const Rcpp::NumericMatrix &query,
+                         const int &k = 20, const int &searchK = 0) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    com::bioturing::RpForestIndex index;
+    std::stringstream ostr;
+    try {
+        index.Load(file, groupName);
+    } catch(HighFive::Exception& err) {
+        ostr << "QueryKnnIndex HDF5 format, error=" << err.what();
+    }
+    oHdf5Util.Close(file);
+    if(ostr.str().empty() == false) {
+        ::Rf_error(ostr.str().c_str());
+    }
+    if((std::size_t)query.ncol() != index.GetNumDims()) {
+        ::Rf_error("query must have as many columns as the indexed embedding");
+    }
+
+    return QueryKnnPoints(index, GetRowMajorPoints(query), query.nrow(), k, searchK);
+}
@@ -0,0 +1,334 @@
+#ifndef KNN_UTIL
+#define KNN_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <random>
+#include <vector>
+#include "H5FormatUtil.h"
+
+namespace com {
+namespace bioturing {
+
+// Approximate nearest neighbours by a forest of random projection trees (Annoy
+// style). Every internal node splits its points by the hyperplane equidistant to
+// two random points; a query walks all trees at once through a priority queue on
+// the margin until searchK candidates are gathered, then ranks them exactly.
+// Trees are stored in flat arrays so the index is saved to and loaded from HDF5
+// datasets as is.
+class RpForestIndex {
+public:
+    RpForestIndex() {
+        n_points = 0;
+        n_dims = 0;
+        n_trees = -1;
+        leaf_size = -1;
+        tree_seed = -1;
+    }
+
+    // data is n x d, row-major
+    void SetData(const std::vector<double> &data_, const std::size_t &n, const std::size_t &d) {
+        data = data_;
+        n_points = n;
+        n_dims = d;
+    }
+
+    // True when the index was built on exactly these points (n x d, row-major)
+    bool HasData(const std::vector<double> &points, const std::size_t &n, const std::size_t &d) const {
+        return n_points == n && n_dims == d && data == points;
+    }
+
+    // True when the index was built with these parameters; an index saved without them never matches
+    bool HasParams(const std::size_t &nTrees, const std::size_t &leafSize, const int &seed) const {
+        return n_trees == (long long)nTrees && leaf_size == (long long)leafSize && tree_seed == seed;
+    }
+
+    // Trees are grown in parallel, tree t seeded with seed + t so the index does not
+    // depend on the number of threads
+    void Build(const std::size_t &nTrees, const std::size_t &leafSize, const int &seed) {
+        std::vector<Tree> trees(nTrees);
+        TreeWorker treeWorker(*this, trees, std::max<std::size_t>(leafSize, 2), seed);
+        RcppParallel::parallelFor(0, nTrees, treeWorker, 1);
+        n_trees = nTrees;
+        leaf_size = std::max<std::size_t>(leafSize, 2);
+        tree_seed = seed;
+
+        roots.clear();
+        children.clear();
+        offsets.clear();
+        normals.clear();
+        leafStart.assign(1, 0);
+        leafItems.clear();
+        for(const Tree &tree : trees) {
+            int nodeBase = offsets.size();
+            int leafBase = leafStart.size() - 1;
+            roots.push_back(tree.root >= 0 ? tree.root + nodeBase : tree.root - leafBase);
+            for(const int &child : tree.children) {
+                children.push_back(child >= 0 ? child + nodeBase : child - leafBase);
+            }
+            offsets.insert(offsets.end(), tree.offsets.begin(), tree.offsets.end());
+            normals.insert(normals.end(), tree.normals.begin(), tree.normals.end());
+            for(std::size_t l = 1; l < tree.leafStart.size(); l++) {
+                leafStart.push_back(leafItems.size() + tree.leafStart[l]);
+            }
+            leafItems.insert(leafItems.end(), tree.leafItems.begin(), tree.leafItems.end());
+        }
+    }
+
+    // k nearest indexed points of query (d values) into index/distance, closest first.
+    // Fewer than k are returned only when the index holds fewer points.
+    void Query(const double *query, const std::size_t &k, const std::size_t &searchK,
+               std::vector<int> &index, std::vector<double> &distance) const {
+        typedef std::pair<double, int> QueueItem;
+        std::priority_queue<QueueItem> queue;
+        for(const int &root : roots) {
+            queue.push(QueueItem(std::numeric_limits<double>::infinity(), root));
+        }
+
+        std::vector<int> candidates;
+        while(queue.empty() == false && candidates.size() < std::max(searchK, k)) {
+            QueueItem item = queue.top();
+            queue.pop();
+            int node = item.second;
+            if(node < 0) {
+                int leaf = -node - 1;
+                candidates.insert(candidates.end(), leafItems.begin() + leafStart[leaf], leafItems.begin() + leafStart[leaf + 1]);
+                continue;
+            }
+            double margin = Margin(node, query);
+            queue.push(QueueItem(std::min(item.first, -margin), children[2 * node]));
+            queue.push(QueueItem(std::min(item.first, margin), children[2 * node + 1]));
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        std::vector<QueueItem> ranked(candidates.size());
+        for(std::size_t c = 0; c < candidates.size(); c++) {
+            ranked[c] = QueueItem(Distance(query, &data[candidates[c] * n_dims]), candidates[c]);
+        }
+        std::size_t n_top = std::min(k, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + n_top, ranked.end());
+
+        index.resize(n_top);
+        distance.resize(n_top);
+        for(std::size_t j = 0; j < n_top; j++) {
+            index[j] = ranked[j].second;
+            distance[j] = std::sqrt(ranked[j].first);
+        }
+    }
+
+    // Throws HighFive::Exception
+    void Save(HighFive::File *file, const std::string &groupName) const {
+        if(file->exist(groupName) == true) {
+            H5Ldelete(file->getId(), groupName.c_str(), H5P_DEFAULT);
+        }
+        HighFive::Group group = file->createGroup(groupName);
+        WriteIntArrayAttribute(group.getId(), "build_params", {n_trees, leaf_size, tree_seed});
+        std::vector<unsigned int> shape = {(unsigned int)n_points, (unsigned int)n_dims};
+        WriteVector(file, groupName + "/shape", shape);
+        WriteVector(file, groupName + "/data", data);
+        WriteVector(file, groupName + "/roots", roots);
+        WriteVector(file, groupName + "/children", children);
+        WriteVector(file, groupName + "/offsets", offsets);
+        WriteVector(file, groupName + "/normals", normals);
+        WriteVector(file, groupName + "/leaf_start", leafStart);
+        WriteVector(file, groupName + "/leaf_items", leafItems);
+    }
+
+    // Throws HighFive::Exception
+    void Load(HighFive::File *file, const std::string &groupName) {
+        std::vector<unsigned int> shape;
+        file->getDataSet(groupName + "/shape").read(shape);
+        n_points = shape[0];
+        n_dims = shape[1];
+        file->getDataSet(groupName + "/data").read(data);
+        file->getDataSet(groupName + "/roots").read(roots);
+        file->getDataSet(groupName + "/children").read(children);
+        file->getDataSet(groupName + "/offsets").read(offsets);
+        file->getDataSet(groupName + "/normals").read(normals);
+        file->getDataSet(groupName + "/leaf_start").read(leafStart);
+        file->getDataSet(groupName + "/leaf_items").read(leafItems);
+
+        std::vector<long long> params;
+        HighFive::Group group = file->getGroup(groupName);
+        if(ReadIntArrayAttribute(group.getId(), "build_params", params) == true && params.size() == 3) {
+            n_trees = params[0];
+            leaf_size = params[1];
+            tree_seed = params[2];
+        } else {
+            n_trees = leaf_size = tree_seed = -1;
+        }
+    }
+
+    std::size_t GetNumPoints() const { return n_points; }
+    std::size_t GetNumDims() const { return n_dims; }
+    std::size_t GetNumTrees() const { return roots.size(); }
+    const double *GetPoint(const std::size_t &k) const { return &data[k * n_dims]; }
+
+private:
+    // Nodes of one tree: children holds 2 entries per internal node, a child >= 0
+    // being another node and a child < 0 the leaf -child - 1
+    struct Tree {
+        int root;
+        std::vector<int> children;
+        std::vector<double> offsets;
+        std::vector<double> normals;
+        std::vector<int> leafStart;
+        std::vector<int> leafItems;
+    };
+
+    struct TreeWorker : public RcppParallel::Worker
+    {
+        const RpForestIndex &index;
+        std::vector<Tree> &trees;
+        const std::size_t leafSize;
+        const int seed;
+
+        TreeWorker(const RpForestIndex &index, std::vector<Tree> &trees, const std::size_t &leafSize, const int &seed)
+            : index(index), trees(trees), leafSize(leafSize), seed(seed) {}
+
+        void operator()(std::size_t begin, std::size_t end) {
+            for(std::size_t t = begin; t < end; t++) {
+                std::mt19937 rng(seed + t);
+                std::vector<int> items(index.n_points);
+                for(std::size_t k = 0; k < items.size(); k++) {
+                    items[k] = k;
+                }
+                trees[t].leafStart.assign(1, 0);
+                trees[t].root = index.BuildNode(trees[t], items, 0, items.size(), leafSize, rng);
+            }
+        }
+    };
+
+    // Returns the node id, or -(leaf id) - 1 for a leaf
+    int BuildNode(Tree &tree, std::vector<int> &items, const std::size_t &begin, const std::size_t &end,
+                  const std::size_t &leafSize, std::mt19937 &rng) const {
+        if(end - begin <= leafSize) {
+            tree.leafItems.insert(tree.leafItems.end(), items.begin() + begin, items.begin() + end);
+            tree.leafStart.push_back(tree.leafItems.size());
+            return -(int)(tree.leafStart.size() - 1);
+        }
+
+        int node = tree.offsets.size();
+        tree.children.resize(2 * node + 2);
+        tree.offsets.push_back(0);
+        tree.normals.resize((node + 1) * n_dims, 0);
+
+        std::size_t n = end - begin;
+        std::size_t mid = begin;
+        for(int attempt = 0; attempt < 3 && (mid == begin || mid == end); attempt++) {
+            int a = items[begin + rng() % n];
+            int b = items[begin + rng() % n];
+            double *normal = &tree.normals[node * n_dims];
+            double offset = 0;
+            for(std::size_t j = 0; j < n_dims; j++) {
+                double pa = data[a * n_dims + j];
+                double pb = data[b * n_dims + j];
+                normal[j] = pa - pb;
+                offset -= normal[j] * (pa + pb) / 2;
+            }
+            tree.offsets[node] = offset;
+            mid = std::partition(items.begin() + begin, items.begin() + end, [&](const int &item) {
+                return Margin(normal, offset, &data[item * n_dims]) <= 0;
+            }) - items.begin();
+        }
+
+        // Duplicated points: fall back to a random half split, sending every query both ways
+        if(mid == begin || mid == end) {
+            std::fill(tree.normals.begin() + node * n_dims, tree.normals.begin() + (node + 1) * n_dims, 0);
+            tree.offsets[node] = 0;
+            std::shuffle(items.begin() + begin, items.begin() + end, rng);
+            mid = begin + n / 2;
+        }
+
+        int left = BuildNode(tree, items, begin, mid, leafSize, rng);
+        int right = BuildNode(tree, items, mid, end, leafSize, rng);
+        tree.children[2 * node] = left;
+        tree.children[2 * node + 1] = right;
+        return node;
+    }
+
+    double Margin(const double *normal, const double &offset, const double *point) const {
+        double margin = offset;
+        for(std::size_t j = 0; j < n_dims; j++) {
+            margin += normal[j] * point[j];
+        }
+        return margin;
+    }
+
+    double Margin(const int &node, const double *point) const {
+        return Margin(&normals[node * n_dims], offsets[node], point);
+    }
+
+    // Squared euclidean distance
+    double Distance(const double *a, const double *b) const {
+        double dist = 0;
+        for(std::size_t j = 0; j < n_dims; j++) {
+            double diff = a[j] - b[j];
+            dist += diff * diff;
+        }
+        return dist;
+    }
+
+    template <typename T>
+    static void WriteVector(HighFive::File *file, const std::string &path, const std::vector<T> &vec) {
+        HighFive::DataSet dataset = file->createDataSet<T>(path, HighFive::DataSpace(std::vector<size_t>{vec.size()}));
+        if(vec.size() > 0) {
+            dataset.write(vec);
+        }
+    }
+
+    std::size_t n_points;
+    std::size_t n_dims;
+    // nTrees, leafSize and seed of Build, saved as the build_params attribute of the group
+    long long n_trees;
+    long long leaf_size;
+    long long tree_seed;
+    std::vector<double> data;
+    std::vector<int> roots;
+    std::vector<int> children;
+    std::vector<double> offsets;
+    std::vector<double> normals;
+    std::vector<int> leafStart;
+    std::vector<int> leafItems;
+};
+
+// k nearest neighbours of every row of a query matrix (n x d, row-major)
+struct KnnQueryWorker : public RcppParallel::Worker
+{
+    const RpForestIndex &index;
+    const double *query;
+    const std::size_t n_dims;
+    const std::size_t k;
+    const std::size_t searchK;
+    std::vector<int> &indices;
+    std::vector<double> &distances;
+
+    KnnQueryWorker(const RpForestIndex &index, const double *query, const std::size_t &n_dims, const std::size_t &k,
+                   const std::size_t &searchK, std::vector<int> &indices, std::vector<double> &distances)
+        : index(index), query(query), n_dims(n_dims), k(k), searchK(searchK), indices(indices), distances(distances) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::vector<int> idx;
+        std::vector<double> dist;
+        for(std::size_t q = begin; q < end; q++) {
+            index.Query(query + q * n_dims, k, searchK, idx, dist);
+            for(std::size_t j = 0; j < k; j++) {
+                indices[q * k + j] = (j < idx.size()) ? idx[j] : -1;
+                distances[q * k + j] = (j < dist.size()) ? dist[j] : std::numeric_limits<double>::infinity();
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::List FindKnn(const Rcpp::NumericMatrix &embeddings, const int &k, const int &nTrees, const int &searchK, const int &leafSize,
+                   const int &seed, const std::string &filePath, const std::string &groupName, const bool &rebuild);
+Rcpp::List QueryKnnIndex(const std::string &filePath, const std::string &groupName, const Rcpp::NumericMatrix &query,
+                         const int &k, const int &searchK);
+
+#endif //KNN_UTIL
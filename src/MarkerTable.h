@@ -0,0 +1,78 @@
+#ifndef MARKER_TABLE
+#define MARKER_TABLE
+
+#include <RcppArmadillo.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace com {
+namespace bioturing {
+
+// One gene of a marker table; p value and fold change are natural logs
+struct MarkerRow {
+    int gene_id;
+    double d_score;
+    double b_cnt;
+    double log_p_value;
+    double perm_p_value;
+    double ud_score;
+    double log_fc;
+};
+
+// Marker table shared by HarmonyMarker and WilcoxMarkers: genes sorted by p value,
+// Benjamini-Hochberg adjusted p values computed in log space. R is any type with
+// the fields of MarkerRow; names[k] is the name of rows[k].
+template <typename R>
+Rcpp::DataFrame BuildMarkerTable(const std::vector<R> &rows, const std::vector<std::string> &names) {
+    std::size_t n_genes = rows.size();
+    std::vector<std::pair<double, int>> order(n_genes);
+    for(std::size_t g = 0; g < n_genes; g++) {
+        order[g] = std::make_pair(rows[g].log_p_value, g);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<std::string> g_names(n_genes);
+    std::vector<int> g_id(n_genes);
+    std::vector<double> d_score(n_genes), ud_score(n_genes), log2_fc(n_genes);
+    std::vector<double> log10_pv(n_genes), perm_pv(n_genes), log10_adj_pv(n_genes);
+    std::vector<double> b_cnt(n_genes);
+
+    // p * n / rank, made monotone by a running minimum from the largest rank down and capped at 1
+    double adj = 0;
+    for(std::size_t j = n_genes; j-- > 0; ) {
+        adj = std::min(adj, order[j].first + std::log((double)n_genes) - std::log(j + 1.0));
+        log10_adj_pv[j] = adj * M_LOG10E;
+    }
+
+    for(std::size_t j = 0; j < n_genes; j++) {
+        const R &row = rows[order[j].second];
+        g_names[j]  = names[order[j].second];
+        g_id[j]     = row.gene_id;
+        d_score[j]  = row.d_score;
+        b_cnt[j]    = row.b_cnt;
+        log10_pv[j] = row.log_p_value * M_LOG10E;
+        perm_pv[j]  = row.perm_p_value;
+        ud_score[j] = row.ud_score;
+        log2_fc[j]  = row.log_fc * M_LOG2E;
+    }
+
+    return Rcpp::DataFrame::create(
+        Rcpp::Named("Gene ID")                = Rcpp::wrap(g_id),
+        Rcpp::Named("Gene Name")              = Rcpp::wrap(g_names),
+        Rcpp::Named("Dissimilarity")          = Rcpp::wrap(d_score),
+        Rcpp::Named("Bin count")              = Rcpp::wrap(b_cnt),
+        Rcpp::Named("Log10 p value")          = Rcpp::wrap(log10_pv),
+        Rcpp::Named("Perm p value")           = Rcpp::wrap(perm_pv),
+        Rcpp::Named("Log10 adjusted p value") = Rcpp::wrap(log10_adj_pv),
+        Rcpp::Named("Up-Down score")          = Rcpp::wrap(ud_score),
+        Rcpp::Named("Log2 fold change")       = Rcpp::wrap(log2_fc)
+    );
+}
+
+} // namespace bioturing
+} // namespace com
+
+#endif //MARKER_TABLE
@@ -0,0 +1,141 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "MarkerUtil.h"
+
+// One marker table of a cluster, in the layout of the HarmonyMarker result
+Rcpp::DataFrame GetMarkerTable(const std::size_t &k, const std::size_t &n_genes, const std::vector<std::string> &geneNames,
+                               const std::vector<double> &auc, const std::vector<double> &logPValue,
+                               const std::vector<double> &logFc, const std::vector<int> &nnzCount) {
+    std::vector<com::bioturing::MarkerRow> rows(n_genes);
+    for(std::size_t g = 0; g < n_genes; g++) {
+        std::size_t idx = k * n_genes + g;
+        rows[g].gene_id = g + 1;
+        rows[g].d_score = auc[idx];
+        rows[g].b_cnt = nnzCount[idx];
+        rows[g].log_p_value = logPValue[idx];
+        rows[g].perm_p_value = NA_REAL;
+        rows[g].ud_score = 2 * auc[idx] - 1;
+        rows[g].log_fc = logFc[idx];
+    }
+    return com::bioturing::BuildMarkerTable(rows, geneNames);
+}
+
+//' WilcoxMarkers
+//'
+//' Markers of every cluster against the rest of the cells by Wilcoxon rank sum tests.
+//' Each gene is ranked once, its implicit zeros being handled as a single tie block, and the
+//' rank sums of all clusters come from the same pass; genes are tested in parallel.
+//' Tables have the columns of HarmonyMarker: Dissimilarity holds the AUC, Bin count the number
+//' of expressing cells of the cluster, Up-Down score 2 * AUC - 1 and Perm p value is NA.
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param cluster An integer vector of cluster labels, one per cell. 0 or NA leaves a cell out
+//' @return A list of marker tables, one per non-empty cluster, named by the cluster label
+//' @export
+// [[Rcpp::export]]
+Rcpp::List WilcoxMarkers(const Rcpp::S4 &mat, const Rcpp::IntegerVector &cluster) {
+    com::bioturing::CscView input(mat);
+    std::size_t n_genes = input.n_rows;
+    std::size_t n_cols = input.n_cols;
+    if((std::size_t)cluster.size() != n_cols) {
+        ::Rf_error("cluster must have one label per column");
+    }
+
+    std::size_t n_labels = 0;
+    for(const int &label : cluster) {
+        if(label != NA_INTEGER) {
+            if(label < 0) {
+                ::Rf_error("Cluster labels must not be negative");
+            }
+            n_labels = std::max<std::size_t>(n_labels, label);
+        }
+    }
+
+    // Non-empty labels become clusters 0 .. n_clusters - 1
+    std::vector<std::size_t> labelSize(n_labels + 1, 0);
+    for(const int &label : cluster) {
+        if(label != NA_INTEGER) {
+            labelSize[label]++;
+        }
+    }
+    std::vector<int> clusterOf(n_labels + 1, -1);
+    std::vector<int> clusterLabels;
+    std::vector<std::size_t> clusterSize;
+    std::size_t n_cells = 0;
+    for(std::size_t label = 1; label <= n_labels; label++) {
+        if(labelSize[label] > 0) {
+            clusterOf[label] = clusterLabels.size();
+            clusterLabels.push_back(label);
+            clusterSize.push_back(labelSize[label]);
+            n_cells += labelSize[label];
+        }
+    }
+    if(clusterSize.size() < 2) {
+        ::Rf_error("At least two non-empty clusters are needed");
+    }
+
+    // Gene-major copy of the nonzeros of the labelled cells
+    std::vector<int> ptr(n_genes + 1, 0);
+    for(std::size_t c = 0; c < n_cols; c++) {
+        if(cluster[c] == NA_INTEGER || cluster[c] == 0) {
+            continue;
+        }
+        for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+            if(input.x[k] != 0) {
+                ptr[input.i[k] + 1]++;
+            }
+        }
+    }
+    for(std::size_t g = 0; g < n_genes; g++) {
+        ptr[g + 1] += ptr[g];
+    }
+    std::vector<double> values(ptr[n_genes]);
+    std::vector<int> labels(ptr[n_genes]);
+    std::vector<int> pos(ptr.begin(), ptr.end() - 1);
+    for(std::size_t c = 0; c < n_cols; c++) {
+        if(cluster[c] == NA_INTEGER || cluster[c] == 0) {
+            continue;
+        }
+        for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+            if(input.x[k] != 0) {
+                int e = pos[input.i[k]]++;
+                values[e] = input.x[k];
+                labels[e] = clusterOf[cluster[c]];
+            }
+        }
+    }
+
+    std::size_t n_clusters = clusterSize.size();
+    std::vector<double> auc(n_clusters * n_genes);
+    std::vector<double> logPValue(n_clusters * n_genes);
+    std::vector<double> logFc(n_clusters * n_genes);
+    std::vector<int> nnzCount(n_clusters * n_genes);
+    com::bioturing::RankSumWorker rankSumWorker(ptr, values, labels, clusterSize, n_cells, auc, logPValue, logFc, nnzCount);
+    RcppParallel::parallelFor(0, n_genes, rankSumWorker, 16);
+
+    std::vector<std::string> geneNames(n_genes);
+    SEXP rownames = input.dimnames[0];
+    if(Rf_isNull(rownames) == false) {
+        geneNames = Rcpp::as<std::vector<std::string>>(rownames);
+    } else {
+        for(std::size_t g = 0; g < n_genes; g++) {
+            geneNames[g] = std::to_string(g + 1);
+        }
+    }
+
+    Rcpp::List tables(n_clusters);
+    Rcpp::CharacterVector tableNames(n_clusters);
+    for(std::size_t k = 0; k < n_clusters; k++) {
+        tables[k] = GetMarkerTable(k, n_genes, geneNames, auc, logPValue, logFc, nnzCount);
+        tableNames[k] = std::to_string(clusterLabels[k]);
+    }
+    tables.attr("names") = tableNames;
+    return tables;
+}
@@ -0,0 +1,124 @@
+#ifndef MARKER_UTIL
+#define MARKER_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Preprocess.h"
+#include "MarkerTable.h"
+
+namespace com {
+namespace bioturing {
+
+// Wilcoxon rank sum test of every cluster against the rest, for the genes in
+// [begin, end) of a gene-major copy (values and 0-based cluster of the nonzeros
+// of gene g in [ptr[g], ptr[g + 1])). The nonzeros of a gene are sorted once and
+// the rank sums of all clusters are accumulated in the same pass; the implicit
+// zeros form one tie block whose average rank is added per cluster as
+// (cluster size - nonzeros) * rank. p values use the normal approximation with
+// tie and continuity corrections, like wilcox.test(exact = FALSE).
+// Results are stored at [k * n_genes + g].
+struct RankSumWorker : public RcppParallel::Worker
+{
+    const std::vector<int> &ptr;
+    const std::vector<double> &values;
+    const std::vector<int> &labels;
+    const std::vector<std::size_t> &clusterSize;
+    const std::size_t n_genes;
+    const std::size_t n_cells;
+
+    std::vector<double> &auc;
+    std::vector<double> &logPValue;
+    std::vector<double> &logFc;
+    std::vector<int> &nnzCount;
+
+    RankSumWorker(const std::vector<int> &ptr, const std::vector<double> &values, const std::vector<int> &labels,
+                  const std::vector<std::size_t> &clusterSize, const std::size_t &n_cells, std::vector<double> &auc,
+                  std::vector<double> &logPValue, std::vector<double> &logFc, std::vector<int> &nnzCount)
+        : ptr(ptr), values(values), labels(labels), clusterSize(clusterSize), n_genes(ptr.size() - 1), n_cells(n_cells),
+          auc(auc), logPValue(logPValue), logFc(logFc), nnzCount(nnzCount) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::size_t n_clusters = clusterSize.size();
+        std::vector<std::pair<double, int>> entries;
+        std::vector<double> rankSum(n_clusters);
+        std::vector<double> exprSum(n_clusters);
+        std::vector<int> nnz(n_clusters);
+        double n = n_cells;
+
+        for(std::size_t g = begin; g < end; g++) {
+            entries.clear();
+            for(int k = ptr[g]; k < ptr[g + 1]; k++) {
+                entries.push_back(std::make_pair(values[k], labels[k]));
+            }
+            std::sort(entries.begin(), entries.end());
+            std::fill(rankSum.begin(), rankSum.end(), 0);
+            std::fill(exprSum.begin(), exprSum.end(), 0);
+            std::fill(nnz.begin(), nnz.end(), 0);
+
+            // Zeros rank after the negative values and before the positive ones
+            double n_zeros = n_cells - entries.size();
+            double zeroRank = 0;
+            double ranked = 0;
+            double ties = 0;
+            bool zerosRanked = false;
+            double total = 0;
+            for(std::size_t e = 0; e < entries.size();) {
+                if(zerosRanked == false && entries[e].first > 0) {
+                    zeroRank = ranked + (n_zeros + 1) / 2;
+                    ranked += n_zeros;
+                    ties += n_zeros * n_zeros * n_zeros - n_zeros;
+                    zerosRanked = true;
+                }
+                std::size_t f = e + 1;
+                while(f < entries.size() && entries[f].first == entries[e].first) {
+                    f++;
+                }
+                double t = f - e;
+                double rank = ranked + (t + 1) / 2;
+                for(; e < f; e++) {
+                    int k = entries[e].second;
+                    rankSum[k] += rank;
+                    exprSum[k] += entries[e].first;
+                    nnz[k]++;
+                    total += entries[e].first;
+                }
+                ranked += t;
+                ties += t * t * t - t;
+            }
+            if(zerosRanked == false) {
+                zeroRank = ranked + (n_zeros + 1) / 2;
+                ties += n_zeros * n_zeros * n_zeros - n_zeros;
+            }
+
+            double tieFactor = (n + 1) - ((n > 1) ? ties / (n * (n - 1)) : 0);
+            for(std::size_t k = 0; k < n_clusters; k++) {
+                double n1 = clusterSize[k];
+                double n2 = n - n1;
+                double u = rankSum[k] + (n1 - nnz[k]) * zeroRank - n1 * (n1 + 1) / 2;
+                double z = u - n1 * n2 / 2;
+                double sigma = std::sqrt(std::max(n1 * n2 / 12 * tieFactor, 0.0));
+                double logP = 0;
+                if(sigma > 0) {
+                    z = (std::fabs(z) - ((z != 0) ? 0.5 : 0)) / sigma;
+                    logP = std::min(std::log(2.0) + R::pnorm(-std::fabs(z), 0.0, 1.0, 1, 1), 0.0);
+                }
+
+                double m1 = exprSum[k] / n1;
+                double m2 = (total - exprSum[k]) / n2;
+                auc[k * n_genes + g] = u / (n1 * n2);
+                logPValue[k * n_genes + g] = logP;
+                logFc[k * n_genes + g] = std::log((m1 / (m2 + 1)) + 1);
+                nnzCount[k * n_genes + g] = nnz[k];
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::List WilcoxMarkers(const Rcpp::S4 &mat, const Rcpp::IntegerVector &cluster);
+
+#endif //MARKER_UTIL
@@ -0,0 +1,125 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "ModuleScoreUtil.h"
+
+//' ModuleScore
+//'
+//' Scores of gene signatures for every cell, as AddModuleScore computes them: the weighted
+//' mean expression of the signature genes minus the mean expression of control genes drawn
+//' from the same bins of average expression. Controls are drawn in parallel with a seeded
+//' generator, then all signatures are scored in a single pass over the nonzero values by
+//' merging signature and control weights into one gene x signature weight table.
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells, usually log-normalized
+//' @param signatures A sparse matrix (dgCMatrix), genes x signatures, of gene weights.
+//'        Use 1 for the genes of a plain gene set
+//' @param nBins Number of bins of average expression. Default 24
+//' @param nCtrl Number of control genes drawn per signature gene. Default 100
+//' @param seed Random seed, signature s using seed + s. Default 1
+//' @return A numeric matrix, cells x signatures
+//' @export
+// [[Rcpp::export]]
+Rcpp::NumericMatrix ModuleScore(const Rcpp::S4 &mat, const Rcpp::S4 &signatures, const int &nBins = 24, const int &nCtrl = 100,
+                                const int &seed = 1) {
+    com::bioturing::CscView input(mat);
+    com::bioturing::CscView weights(signatures);
+    std::size_t n_rows = input.n_rows;
+    std::size_t n_cols = input.n_cols;
+    std::size_t n_signatures = weights.n_cols;
+    if((std::size_t)weights.n_rows != n_rows) {
+        ::Rf_error("signatures must have one row per gene of mat");
+    }
+    if(nBins < 1) {
+        ::Rf_error("nBins must be positive");
+    }
+
+    // Genes of every signature, explicit zero weights dropped
+    std::vector<int> sigPtr(n_signatures + 1, 0);
+    std::vector<int> sigGenes;
+    std::vector<double> sigWeights;
+    for(std::size_t s = 0; s < n_signatures; s++) {
+        double weightSum = 0;
+        for(int k = weights.p[s]; k < weights.p[s + 1]; k++) {
+            if(weights.x[k] != 0) {
+                sigGenes.push_back(weights.i[k]);
+                sigWeights.push_back(weights.x[k]);
+                weightSum += weights.x[k];
+            }
+        }
+        sigPtr[s + 1] = sigGenes.size();
+        if(weightSum == 0) {
+            ::Rf_error("The weights of every signature must have a nonzero sum");
+        }
+    }
+
+    // Equal-frequency bins of genes ranked by average expression
+    com::bioturing::GeneStatsWorker<int, int> statsWorker(input.p, input.i, input.x, n_rows);
+    RcppParallel::parallelReduce(0, n_cols, statsWorker);
+    std::vector<int> order(n_rows);
+    for(std::size_t r = 0; r < n_rows; r++) {
+        order[r] = r;
+    }
+    std::stable_sort(order.begin(), order.end(), [&statsWorker](const int &a, const int &b) {
+        return statsWorker.sum[a] < statsWorker.sum[b];
+    });
+    std::vector<int> binOf(n_rows);
+    for(std::size_t rank = 0; rank < n_rows; rank++) {
+        binOf[order[rank]] = rank * nBins / n_rows;
+    }
+    std::vector<std::vector<int>> bins(nBins);
+    for(std::size_t r = 0; r < n_rows; r++) {
+        bins[binOf[r]].push_back(r);
+    }
+
+    std::vector<std::vector<int>> controls(n_signatures);
+    com::bioturing::ControlSampleWorker controlWorker(bins, binOf, sigPtr, sigGenes, std::max(nCtrl, 0), seed, controls);
+    RcppParallel::parallelFor(0, n_signatures, controlWorker, 1);
+
+    // Gene-major weights: signature genes w / sum(w), control genes -1 / number of controls
+    std::vector<int> wPtr(n_rows + 1, 0);
+    for(std::size_t s = 0; s < n_signatures; s++) {
+        for(int k = sigPtr[s]; k < sigPtr[s + 1]; k++) {
+            wPtr[sigGenes[k] + 1]++;
+        }
+        for(const int &g : controls[s]) {
+            wPtr[g + 1]++;
+        }
+    }
+    for(std::size_t r = 0; r < n_rows; r++) {
+        wPtr[r + 1] += wPtr[r];
+    }
+    std::vector<int> wSig(wPtr[n_rows]);
+    std::vector<double> wVal(wPtr[n_rows]);
+    std::vector<int> pos(wPtr.begin(), wPtr.end() - 1);
+    for(std::size_t s = 0; s < n_signatures; s++) {
+        double weightSum = 0;
+        for(int k = sigPtr[s]; k < sigPtr[s + 1]; k++) {
+            weightSum += sigWeights[k];
+        }
+        for(int k = sigPtr[s]; k < sigPtr[s + 1]; k++) {
+            int e = pos[sigGenes[k]]++;
+            wSig[e] = s;
+            wVal[e] = sigWeights[k] / weightSum;
+        }
+        for(const int &g : controls[s]) {
+            int e = pos[g]++;
+            wSig[e] = s;
+            wVal[e] = -1.0 / controls[s].size();
+        }
+    }
+
+    std::vector<double> scores(n_cols * n_signatures, 0);
+    com::bioturing::ModuleScoreWorker scoreWorker(input, wPtr, wSig, wVal, scores.data());
+    RcppParallel::parallelFor(0, n_cols, scoreWorker, 64);
+
+    Rcpp::NumericMatrix res(n_cols, n_signatures, scores.begin());
+    res.attr("dimnames") = Rcpp::List::create(input.dimnames[1], weights.dimnames[1]);
+    return res;
+}
@@ -0,0 +1,86 @@
+#ifndef MODULE_SCORE_UTIL
+#define MODULE_SCORE_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "Preprocess.h"
+
+namespace com {
+namespace bioturing {
+
+// Control genes of every signature, as AddModuleScore picks them: for each gene
+// of the signature, nCtrl genes drawn without replacement from its expression bin,
+// the union being the control set. Signature s uses its own generator seeded with
+// seed + s, and draws by modulo of the raw mt19937 output, so controls depend
+// neither on the number of threads nor on the standard library.
+struct ControlSampleWorker : public RcppParallel::Worker
+{
+    const std::vector<std::vector<int>> &bins;
+    const std::vector<int> &binOf;
+    const std::vector<int> &sigPtr;
+    const std::vector<int> &sigGenes;
+    const std::size_t nCtrl;
+    const int seed;
+    std::vector<std::vector<int>> &controls;
+
+    ControlSampleWorker(const std::vector<std::vector<int>> &bins, const std::vector<int> &binOf, const std::vector<int> &sigPtr,
+                        const std::vector<int> &sigGenes, const std::size_t &nCtrl, const int &seed,
+                        std::vector<std::vector<int>> &controls)
+        : bins(bins), binOf(binOf), sigPtr(sigPtr), sigGenes(sigGenes), nCtrl(nCtrl), seed(seed), controls(controls) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::vector<int> pool;
+        for(std::size_t s = begin; s < end; s++) {
+            std::mt19937 rng(seed + s);
+            std::vector<int> &control = controls[s];
+            control.clear();
+            for(int k = sigPtr[s]; k < sigPtr[s + 1]; k++) {
+                pool = bins[binOf[sigGenes[k]]];
+                std::size_t n_draws = std::min(nCtrl, pool.size());
+                for(std::size_t j = 0; j < n_draws; j++) {
+                    std::swap(pool[j], pool[j + rng() % (pool.size() - j)]);
+                    control.push_back(pool[j]);
+                }
+            }
+            std::sort(control.begin(), control.end());
+            control.erase(std::unique(control.begin(), control.end()), control.end());
+        }
+    }
+};
+
+// Scores of all signatures for the cells [begin, end) in one pass over their
+// nonzeros: the weights of gene g are wSig/wVal[wPtr[g] .. wPtr[g + 1]), and
+// scores is cells x signatures, column-major. Each cell owns its row of scores.
+struct ModuleScoreWorker : public RcppParallel::Worker
+{
+    const CscView &input;
+    const std::vector<int> &wPtr;
+    const std::vector<int> &wSig;
+    const std::vector<double> &wVal;
+    double *scores;
+
+    ModuleScoreWorker(const CscView &input, const std::vector<int> &wPtr, const std::vector<int> &wSig,
+                      const std::vector<double> &wVal, double *scores)
+        : input(input), wPtr(wPtr), wSig(wSig), wVal(wVal), scores(scores) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::size_t n_cols = input.n_cols;
+        for(std::size_t c = begin; c < end; c++) {
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                int g = input.i[k];
+                for(int e = wPtr[g]; e < wPtr[g + 1]; e++) {
+                    scores[wSig[e] * n_cols + c] += input.x[k] * wVal[e];
+                }
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::NumericMatrix ModuleScore(const Rcpp::S4 &mat, const Rcpp::S4 &signatures, const int &nBins, const int &nCtrl, const int &seed);
+
+#endif //MODULE_SCORE_UTIL
@@ -0,0 +1,515 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+#define ARMA_USE_HDF5
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+// [[Rcpp::depends(Rhdf5lib)]]
+// [[Rcpp::depends(BH)]]
+#include "Preprocess.h"
+
+// Columns per scaled block written to HDF5, keeping a block around 64MB
+std::size_t GetScaleBlockCols(const std::size_t &n_selected, const std::size_t &elementSize) {
+    std::size_t bytes = std::max<std::size_t>(n_selected * elementSize, 1);
+    return std::max<std::size_t>((std::size_t(1) << 26) / bytes, 1);
+}
+
+template <typename T>
+void WriteScaledH5(const com::bioturing::CscView &input, const double *logX, const std::vector<int> &rowMap,
+                   const std::vector<double> &mean, const std::vector<double> &invSd, const double &scaleMax,
+                   const std::string &h5Path, const std::string &datasetName, const bool &overwrite) {
+    std::size_t n_selected = mean.size();
+    std::size_t n_cols = input.n_cols;
+    std::size_t blockCols = std::min<std::size_t>(GetScaleBlockCols(n_selected, sizeof(T)), std::max<std::size_t>(n_cols, 1));
+
+    com::bioturing::Hdf5Util oHdf5Util(h5Path);
+    HighFive::File *file = oHdf5Util.Open(-1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << h5Path;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::stringstream ostr;
+    try {
+        if(file->exist(datasetName) == true) {
+            if(overwrite == false) {
+                ostr << "Existing dataset :" << datasetName << " in " << h5Path << ", set overwrite to replace it";
+                oHdf5Util.Close(file);
+                ::Rf_error(ostr.str().c_str());
+            }
+            H5Ldelete(file->getId(), datasetName.c_str(), H5P_DEFAULT);
+        }
+        std::size_t slash = datasetName.rfind('/');
+        if(slash != std::string::npos && slash > 0 && file->exist(datasetName.substr(0, slash)) == false) {
+            file->createGroup(datasetName.substr(0, slash));
+        }
+
+        // One row per cell, so a block of cells is a contiguous hyperslab
+        HighFive::DataSetCreateProps props;
+        props.add(HighFive::Chunking(std::vector<hsize_t>{std::max<hsize_t>(blockCols, 1), std::max<hsize_t>(n_selected, 1)}));
+        HighFive::DataSet dataset = file->createDataSet<T>(datasetName, HighFive::DataSpace(std::vector<size_t>{n_cols, n_selected}), props);
+
+        std::vector<T> block(blockCols * n_selected);
+        const T *blockData = block.data();
+        for(std::size_t c0 = 0; c0 < n_cols && n_selected > 0; c0 += blockCols) {
+            std::size_t nc = std::min(blockCols, n_cols - c0);
+            com::bioturing::ScaleWorker<T> scaleWorker(input, logX, rowMap, mean, invSd, scaleMax, c0, block.data());
+            RcppParallel::parallelFor(0, nc, scaleWorker);
+            dataset.select({c0, 0}, {nc, n_selected}).write(blockData);
+        }
+    } catch(HighFive::Exception& err) {
+        ostr << "NormalizeLogScale HDF5 format, error=" << err.what();
+        oHdf5Util.Close(file);
+        ::Rf_error(ostr.str().c_str());
+    }
+    oHdf5Util.Close(file);
+}
+
+//' NormalizeLogScale
+//'
+//' Library-size normalization and log1p of a dgCMatrix in one pass over its nonzero values,
+//' then z-scoring (clipped at scaleMax) of the selected genes into a dense matrix
+//'
+//' @param mat A sparse matrix (dgCMatrix)
+//' @param genes 1-based row indices of the genes to scale. Default scales every gene
+//' @param scaleFactor Total count each cell is normalized to. Default 1e4
+//' @param scaleMax Upper bound of the scaled values. Default 10
+//' @param doScale Compute the scaled matrix. Default TRUE
+//' @param h5Path If not empty, the scaled matrix is written block-wise to this HDF5 file (cells x genes) instead of being returned
+//' @param datasetName Dataset path of the scaled matrix in h5Path. Default "scaled.data"
+//' @param useFloat Store the HDF5 scaled matrix as float32. Default FALSE
+//' @param overwrite Replace datasetName when h5Path already has it, otherwise an error is raised. Default FALSE
+//' @return A list of log.data (dgCMatrix), scaled.data (genes x cells matrix or NULL), mean and sd of the scaled genes
+//' @export
+// [[Rcpp::export]]
+Rcpp::List NormalizeLogScale(const Rcpp::S4 &mat, const Rcpp::IntegerVector &genes = Rcpp::IntegerVector(0),
+                             const double &scaleFactor = 10000, const double &scaleMax = 10, const bool &doScale = true,
+                             const std::string &h5Path = "", const std::string &datasetName = "scaled.data",
+                             const bool &useFloat = false, const bool &overwrite = false) {
+    com::bioturing::CscView input(mat);
+    std::size_t n_rows = input.n_rows;
+    std::size_t n_cols = input.n_cols;
+
+    std::vector<int> rowMap(n_rows, -1);
+    std::vector<int> selected;
+    if(doScale == true) {
+        if(genes.size() == 0) {
+            for(std::size_t r = 0; r < n_rows; r++) {
+                selected.push_back(r);
+            }
+        }
+        for(const int &gene : genes) {
+            if(gene < 1 || gene > (int)n_rows) {
+                ::Rf_error("Gene indices must be between 1 and the number of rows");
+            }
+            selected.push_back(gene - 1);
+        }
+        for(std::size_t g = 0; g < selected.size(); g++) {
+            if(rowMap[selected[g]] >= 0) {
+                ::Rf_error("Gene indices must be unique");
+            }
+            rowMap[selected[g]] = g;
+        }
+    }
+    std::size_t n_selected = selected.size();
+
+    // The log matrix shares i, p, Dim and Dimnames with the input; only x is new
+    Rcpp::NumericVector logX(input.p[n_cols]);
+    com::bioturing::LogNormalizeWorker logWorker(input, rowMap, n_selected, scaleFactor, logX.begin());
+    RcppParallel::parallelReduce(0, n_cols, logWorker);
+
+    std::string klass = "dgCMatrix";
+    Rcpp::S4 logMat(klass);
+    logMat.slot("i") = mat.slot("i");
+    logMat.slot("p") = mat.slot("p");
+    logMat.slot("x") = logX;
+    logMat.slot("Dim") = mat.slot("Dim");
+    logMat.slot("Dimnames") = mat.slot("Dimnames");
+
+    // Sample sd (n - 1); constant genes scale to 0
+    std::vector<double> mean(n_selected, 0);
+    std::vector<double> sd(n_selected, 0);
+    std::vector<double> invSd(n_selected, 0);
+    for(std::size_t g = 0; g < n_selected && n_cols > 0; g++) {
+        mean[g] = logWorker.sum[g] / n_cols;
+        if(n_cols > 1) {
+            double var = (logWorker.sumSq[g] - n_cols * mean[g] * mean[g]) / (n_cols - 1);
+            sd[g] = std::sqrt(std::max(var, 0.0));
+        }
+        invSd[g] = (sd[g] > 0) ? 1 / sd[g] : 0;
+    }
+
+    Rcpp::RObject scaled = R_NilValue;
+    if(doScale == true && h5Path.empty() == true) {
+        Rcpp::NumericMatrix scaledMat(n_selected, n_cols);
+        com::bioturing::ScaleWorker<double> scaleWorker(input, logX.begin(), rowMap, mean, invSd, scaleMax, 0, scaledMat.begin());
+        RcppParallel::parallelFor(0, n_cols, scaleWorker);
+
+        SEXP rownames = input.dimnames[0];
+        Rcpp::List scaledNames(2);
+        if(Rf_isNull(rownames) == false) {
+            Rcpp::CharacterVector allNames(rownames);
+            Rcpp::CharacterVector selectedNames(n_selected);
+            for(std::size_t g = 0; g < n_selected; g++) {
+                selectedNames[g] = allNames[selected[g]];
+            }
+            scaledNames[0] = selectedNames;
+        }
+        scaledNames[1] = input.dimnames[1];
+        scaledMat.attr("dimnames") = scaledNames;
+        scaled = scaledMat;
+    } else if(doScale == true) {
+        if(useFloat == true) {
+            WriteScaledH5<float>(input, logX.begin(), rowMap, mean, invSd, scaleMax, h5Path, datasetName, overwrite);
+        } else {
+            WriteScaledH5<double>(input, logX.begin(), rowMap, mean, invSd, scaleMax, h5Path, datasetName, overwrite);
+        }
+    }
+
+    return Rcpp::List::create(
+        Rcpp::Named("log.data") = logMat,
+        Rcpp::Named("scaled.data") = scaled,
+        Rcpp::Named("mean") = Rcpp::wrap(mean),
+        Rcpp::Named("sd") = Rcpp::wrap(sd)
+    );
+}
+
+//' ReadScaledH5
+//'
+//' Read back a scaled matrix written by NormalizeLogScale to HDF5
+//'
+//' @param h5Path A string (HDF5 path)
+//' @param datasetName Dataset path of the scaled matrix. Default "scaled.data"
+//' @return A genes x cells matrix, without dimnames
+//' @export
+// [[Rcpp::export]]
+Rcpp::NumericMatrix ReadScaledH5(const std::string &h5Path, const std::string &datasetName = "scaled.data") {
+    com::bioturing::Hdf5Util oHdf5Util(h5Path);
+    HighFive::File *file = oHdf5Util.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << h5Path;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::stringstream ostr;
+    try {
+        if(file->exist(datasetName) == false) {
+            ostr << "Can not exist dataset :" << datasetName << " in " << h5Path;
+            oHdf5Util.Close(file);
+            ::Rf_error(ostr.str().c_str());
+        }
+
+        // Stored cells x genes row by row, which is the column-major layout of genes x cells
+        HighFive::DataSet dataset = file->getDataSet(datasetName);
+        std::vector<size_t> dims = dataset.getSpace().getDimensions();
+        if(dims.size() != 2) {
+            ostr << datasetName << " in " << h5Path << " is not a matrix";
+            oHdf5Util.Close(file);
+            ::Rf_error(ostr.str().c_str());
+        }
+        Rcpp::NumericMatrix scaledMat(dims[1], dims[0]);
+        if(scaledMat.size() > 0) {
+            dataset.read(scaledMat.begin());
+        }
+        oHdf5Util.Close(file);
+        return scaledMat;
+    } catch(HighFive::Exception& err) {
+        ostr << "ReadScaledH5 HDF5 format, error=" << err.what();
+        oHdf5Util.Close(file);
+        ::Rf_error(ostr.str().c_str());
+    }
+    return Rcpp::NumericMatrix(0, 0);
+}
+
+// Fit log10(variance) on log10(mean) of the non-constant genes and return the
+// expected standard deviation of every gene (0 for constant genes)
+std::vector<double> FitExpectedSd(const std::vector<double> &mean, const std::vector<double> &var, const double &span) {
+    std::vector<std::size_t> order;
+    for(std::size_t r = 0; r < mean.size(); r++) {
+        if(var[r] > 0) {
+            order.push_back(r);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&mean](const std::size_t &a, const std::size_t &b) { return mean[a] < mean[b]; });
+
+    std::size_t n = order.size();
+    std::vector<double> x(n), y(n), fitted(n);
+    for(std::size_t k = 0; k < n; k++) {
+        x[k] = std::log10(mean[order[k]]);
+        y[k] = std::log10(var[order[k]]);
+    }
+
+    std::size_t n_neighbors = std::min<std::size_t>(std::max<std::size_t>(std::floor(span * n), 3), n);
+    com::bioturing::LoessWorker loessWorker(x, y, n_neighbors, fitted);
+    RcppParallel::parallelFor(0, n, loessWorker, 64);
+
+    std::vector<double> expectedSd(mean.size(), 0);
+    for(std::size_t k = 0; k < n; k++) {
+        expectedSd[order[k]] = std::sqrt(std::pow(10, fitted[k]));
+    }
+    return expectedSd;
+}
+
+// Log dispersion z-scored within equal-width bins of mean (genes with zero mean get -Inf)
+std::vector<double> ScaleDispersionByBin(const std::vector<double> &mean, const std::vector<double> &dispersion, const int &nBins) {
+    std::size_t n_rows = mean.size();
+    double minMean = std::numeric_limits<double>::infinity();
+    double maxMean = -std::numeric_limits<double>::infinity();
+    for(std::size_t r = 0; r < n_rows; r++) {
+        if(std::isfinite(dispersion[r]) == true) {
+            minMean = std::min(minMean, mean[r]);
+            maxMean = std::max(maxMean, mean[r]);
+        }
+    }
+
+    std::size_t bins = std::max(nBins, 1);
+    double width = (maxMean > minMean) ? (maxMean - minMean) / bins : 1;
+    std::vector<int> bin(n_rows, -1);
+    std::vector<double> binSum(bins, 0), binSumSq(bins, 0);
+    std::vector<std::size_t> binCount(bins, 0);
+    for(std::size_t r = 0; r < n_rows; r++) {
+        if(std::isfinite(dispersion[r]) == true) {
+            bin[r] = std::min<std::size_t>((mean[r] - minMean) / width, bins - 1);
+            binSum[bin[r]] += dispersion[r];
+            binSumSq[bin[r]] += dispersion[r] * dispersion[r];
+            binCount[bin[r]]++;
+        }
+    }
+
+    std::vector<double> scaled(n_rows, -std::numeric_limits<double>::infinity());
+    for(std::size_t r = 0; r < n_rows; r++) {
+        if(bin[r] < 0) {
+            continue;
+        }
+        std::size_t count = binCount[bin[r]];
+        double binMean = binSum[bin[r]] / count;
+        double binVar = (count > 1) ? (binSumSq[bin[r]] - count * binMean * binMean) / (count - 1) : 0;
+        double binSd = std::sqrt(std::max(binVar, 0.0));
+        scaled[r] = (binSd > 0) ? (dispersion[r] - binMean) / binSd : 0;
+    }
+    return scaled;
+}
+
+// Shared by the in-memory and HDF5 variants: gene statistics are streamed by scanStats,
+// and scanStandardized runs the second pass needed by vst
+template <typename StatsScan, typename StandardizedScan>
+Rcpp::List FindVariableGenes(const std::size_t &n_rows, const std::size_t &n_cols, const Rcpp::CharacterVector &features,
+                             const int &nFeatures, const std::string &method, const double &span, const int &nBins,
+                             StatsScan scanStats, StandardizedScan scanStandardized) {
+    if(method != "vst" && method != "dispersion") {
+        ::Rf_error("method must be vst or dispersion");
+    }
+
+    std::vector<double> sum(n_rows, 0), sumSq(n_rows, 0);
+    scanStats(sum, sumSq);
+
+    std::vector<double> mean(n_rows, 0), var(n_rows, 0);
+    for(std::size_t r = 0; r < n_rows && n_cols > 0; r++) {
+        mean[r] = sum[r] / n_cols;
+        if(n_cols > 1) {
+            var[r] = std::max((sumSq[r] - n_cols * mean[r] * mean[r]) / (n_cols - 1), 0.0);
+        }
+    }
+
+    Rcpp::DataFrame stats;
+    std::vector<double> score(n_rows);
+    if(method == "vst") {
+        std::vector<double> expectedSd = FitExpectedSd(mean, var, span);
+        std::vector<double> sumSqStd(n_rows, 0);
+        std::vector<std::size_t> nnz(n_rows, 0);
+        scanStandardized(mean, expectedSd, std::sqrt((double)n_cols), sumSqStd, nnz);
+
+        std::vector<double> expectedVar(n_rows);
+        for(std::size_t r = 0; r < n_rows; r++) {
+            expectedVar[r] = expectedSd[r] * expectedSd[r];
+            score[r] = 0;
+            if(expectedSd[r] > 0 && n_cols > 1) {
+                double zero = mean[r] / expectedSd[r];
+                score[r] = (sumSqStd[r] + (n_cols - nnz[r]) * zero * zero) / (n_cols - 1);
+            }
+        }
+        stats = Rcpp::DataFrame::create(
+            Rcpp::Named("mean") = Rcpp::wrap(mean),
+            Rcpp::Named("variance") = Rcpp::wrap(var),
+            Rcpp::Named("variance.expected") = Rcpp::wrap(expectedVar),
+            Rcpp::Named("variance.standardized") = Rcpp::wrap(score)
+        );
+    } else {
+        std::vector<double> dispersion(n_rows);
+        for(std::size_t r = 0; r < n_rows; r++) {
+            dispersion[r] = (mean[r] > 0 && var[r] > 0) ? std::log(var[r] / mean[r]) : -std::numeric_limits<double>::infinity();
+        }
+        score = ScaleDispersionByBin(mean, dispersion, nBins);
+        stats = Rcpp::DataFrame::create(
+            Rcpp::Named("mean") = Rcpp::wrap(mean),
+            Rcpp::Named("variance") = Rcpp::wrap(var),
+            Rcpp::Named("dispersion") = Rcpp::wrap(dispersion),
+            Rcpp::Named("dispersion.scaled") = Rcpp::wrap(score)
+        );
+    }
+    if(features.size() == (R_xlen_t)n_rows) {
+        stats.attr("row.names") = features;
+    }
+
+    // Top genes by decreasing score, ties broken by position
+    std::vector<std::size_t> order;
+    for(std::size_t r = 0; r < n_rows; r++) {
+        if(std::isfinite(score[r]) == true) {
+            order.push_back(r);
+        }
+    }
+    std::size_t n_top = std::min<std::size_t>(std::max(nFeatures, 0), order.size());
+    std::partial_sort(order.begin(), order.begin() + n_top, order.end(), [&score](const std::size_t &a, const std::size_t &b) {
+        return score[a] > score[b] || (score[a] == score[b] && a < b);
+    });
+
+    Rcpp::IntegerVector variable(n_top);
+    for(std::size_t k = 0; k < n_top; k++) {
+        variable[k] = order[k] + 1;
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("variable") = variable,
+        Rcpp::Named("stats") = stats
+    );
+}
+
+//' VariableGenesSpMt
+//'
+//' Highly variable genes of a dgCMatrix. Gene means and variances come from a single pass
+//' over the nonzero values; vst ranks genes by the variance of their values standardized
+//' by a loess fit of log variance on log mean (counts expected), dispersion by the log
+//' dispersion z-scored within bins of mean
+//'
+//' @param mat A sparse matrix (dgCMatrix), genes x cells
+//' @param nFeatures Number of genes to select. Default 2000
+//' @param method "vst" or "dispersion". Default "vst"
+//' @param span Loess span of vst. Default 0.3
+//' @param nBins Number of mean bins of dispersion. Default 20
+//' @return A list of variable (1-based row indices, most variable first) and stats (data frame)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List VariableGenesSpMt(const Rcpp::S4 &mat, const int &nFeatures = 2000, const std::string &method = "vst",
+                             const double &span = 0.3, const int &nBins = 20) {
+    com::bioturing::CscView input(mat);
+    std::size_t n_rows = input.n_rows;
+    std::size_t n_cols = input.n_cols;
+
+    SEXP rownames = input.dimnames[0];
+    Rcpp::CharacterVector features;
+    if(Rf_isNull(rownames) == false) {
+        features = Rcpp::CharacterVector(rownames);
+    }
+
+    return FindVariableGenes(n_rows, n_cols, features, nFeatures, method, span, nBins,
+        [&](std::vector<double> &sum, std::vector<double> &sumSq) {
+            com::bioturing::GeneStatsWorker<int, int> statsWorker(input.p, input.i, input.x, n_rows);
+            RcppParallel::parallelReduce(0, n_cols, statsWorker);
+            sum.swap(statsWorker.sum);
+            sumSq.swap(statsWorker.sumSq);
+        },
+        [&](const std::vector<double> &mean, const std::vector<double> &sd, const double &clipMax,
+            std::vector<double> &sumSq, std::vector<std::size_t> &nnz) {
+            com::bioturing::StandardizedVarWorker<int, int> stdWorker(input.p, input.i, input.x, mean, sd, clipMax);
+            RcppParallel::parallelReduce(0, n_cols, stdWorker);
+            sumSq.swap(stdWorker.sumSq);
+            nnz.swap(stdWorker.nnz);
+        });
+}
+
+//' VariableGenesH5
+//'
+//' Highly variable genes of a sparse matrix group, read block-wise so the matrix is never
+//' loaded in memory. Same methods as VariableGenesSpMt; vst reads the group twice
+//'
+//' @param filePath A string (HDF5 path)
+//' @param groupName A string (HDF5 group)
+//' @param nFeatures Number of genes to select. Default 2000
+//' @param method "vst" or "dispersion". Default "vst"
+//' @param span Loess span of vst. Default 0.3
+//' @param nBins Number of mean bins of dispersion. Default 20
+//' @return A list of variable (1-based row indices, most variable first) and stats (data frame)
+//' @export
+// [[Rcpp::export]]
+Rcpp::List VariableGenesH5(const std::string &filePath, const std::string &groupName, const int &nFeatures = 2000,
+                           const std::string &method = "vst", const double &span = 0.3, const int &nBins = 20) {
+    com::bioturing::Hdf5Util oHdf5Util(filePath);
+    HighFive::File *file = oHdf5Util.Open(1);
+    if(file == nullptr) {
+        std::stringstream ostr;
+        ostr << "Can not open HDF5 file :" << filePath;
+        ::Rf_error(ostr.str().c_str());
+    }
+
+    std::size_t n_rows = 0;
+    std::size_t n_cols = 0;
+    Rcpp::CharacterVector features;
+    std::string error;
+    try {
+        std::vector<unsigned int> shape;
+        file->getDataSet(groupName + "/shape").read(shape);
+        n_rows = shape[0];
+        n_cols = shape[1];
+        std::string featureSlot = groupName + "/" + oHdf5Util.GetFeatureSlot(file, groupName);
+        if(file->exist(featureSlot) == true) {
+            com::bioturing::H5StringPool pool;
+            pool.Read(file->getDataSet(featureSlot));
+            features = pool.ToCharacterVector();
+        }
+    } catch(HighFive::Exception& err) {
+        error = std::string("VariableGenesH5 HDF5 format, error=") + err.what();
+    }
+    if(error.empty() == false) {
+        oHdf5Util.Close(file);
+        ::Rf_error(error.c_str());
+    }
+
+    // The scans run inside R code paths, so HDF5/prefetch errors are carried out as a message
+    Rcpp::List res = FindVariableGenes(n_rows, n_cols, features, nFeatures, method, span, nBins,
+        [&](std::vector<double> &sum, std::vector<double> &sumSq) {
+            try {
+                com::bioturing::H5Prefetcher prefetcher(file, groupName, 1 << 22);
+                prefetcher.Start();
+                com::bioturing::H5ColumnBlock block;
+                while(prefetcher.Next(block) == true) {
+                    com::bioturing::GeneStatsWorker<unsigned int, unsigned int> statsWorker(block.p.data(), block.i.data(), block.x.data(), n_rows);
+                    RcppParallel::parallelReduce(0, block.n_cols, statsWorker);
+                    for(std::size_t r = 0; r < n_rows; r++) {
+                        sum[r] += statsWorker.sum[r];
+                        sumSq[r] += statsWorker.sumSq[r];
+                    }
+                }
+            } catch(std::exception &err) {
+                error = err.what();
+            }
+        },
+        [&](const std::vector<double> &mean, const std::vector<double> &sd, const double &clipMax,
+            std::vector<double> &sumSq, std::vector<std::size_t> &nnz) {
+            if(error.empty() == false) {
+                return;
+            }
+            try {
+                com::bioturing::H5Prefetcher prefetcher(file, groupName, 1 << 22);
+                prefetcher.Start();
+                com::bioturing::H5ColumnBlock block;
+                while(prefetcher.Next(block) == true) {
+                    com::bioturing::StandardizedVarWorker<unsigned int, unsigned int> stdWorker(block.p.data(), block.i.data(), block.x.data(), mean, sd, clipMax);
+                    RcppParallel::parallelReduce(0, block.n_cols, stdWorker);
+                    for(std::size_t r = 0; r < n_rows; r++) {
+                        sumSq[r] += stdWorker.sumSq[r];
+                        nnz[r] += stdWorker.nnz[r];
+                    }
+                }
+            } catch(std::exception &err) {
+                error = err.what();
+            }
+        });
+    oHdf5Util.Close(file);
+
+    if(error.empty() == false) {
+        ::Rf_error(error.c_str());
+    }
+    return res;
+}
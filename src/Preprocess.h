@@ -0,0 +1,253 @@
+#ifndef PREPROCESS_UTIL
+#define PREPROCESS_UTIL
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Hdf5Util.h"
+
+namespace com {
+namespace bioturing {
+
+// Read-only view over the slots of a dgCMatrix. The pointers stay valid as
+// long as the S4 object is alive; nothing is copied.
+struct CscView {
+    int n_rows;
+    int n_cols;
+    const int *p;
+    const int *i;
+    const double *x;
+    Rcpp::List dimnames;
+
+    CscView(const Rcpp::S4 &mat) {
+        Rcpp::IntegerVector dims = mat.slot("Dim");
+        Rcpp::IntegerVector pVec = mat.slot("p");
+        Rcpp::IntegerVector iVec = mat.slot("i");
+        Rcpp::NumericVector xVec = mat.slot("x");
+        n_rows = dims[0];
+        n_cols = dims[1];
+        p = pVec.begin();
+        i = iVec.begin();
+        x = xVec.begin();
+        dimnames = mat.slot("Dimnames");
+    }
+};
+
+// Library-size normalization and log1p of every column in one pass over x,
+// accumulating per-gene sum and sum of squares of the log values for the
+// genes selected by rowMap (>= 0). Per-thread sums are joined by parallelReduce.
+struct LogNormalizeWorker : public RcppParallel::Worker
+{
+    const CscView &input;
+    const std::vector<int> &rowMap;
+    const double scaleFactor;
+    double *logX;
+    std::vector<double> sum;
+    std::vector<double> sumSq;
+
+    LogNormalizeWorker(const CscView &input, const std::vector<int> &rowMap, const std::size_t &n_selected,
+                       const double &scaleFactor, double *logX)
+        : input(input), rowMap(rowMap), scaleFactor(scaleFactor), logX(logX), sum(n_selected, 0), sumSq(n_selected, 0) {}
+
+    LogNormalizeWorker(const LogNormalizeWorker &worker, RcppParallel::Split)
+        : input(worker.input), rowMap(worker.rowMap), scaleFactor(worker.scaleFactor), logX(worker.logX),
+          sum(worker.sum.size(), 0), sumSq(worker.sumSq.size(), 0) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t c = begin; c < end; c++) {
+            double libSize = 0;
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                libSize += input.x[k];
+            }
+
+            double factor = (libSize > 0) ? scaleFactor / libSize : 0;
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                double value = std::log1p(input.x[k] * factor);
+                logX[k] = value;
+                int g = rowMap[input.i[k]];
+                if(g >= 0) {
+                    sum[g] += value;
+                    sumSq[g] += value * value;
+                }
+            }
+        }
+    }
+
+    void join(const LogNormalizeWorker &worker) {
+        for(std::size_t g = 0; g < sum.size(); g++) {
+            sum[g] += worker.sum[g];
+            sumSq[g] += worker.sumSq[g];
+        }
+    }
+};
+
+// Z-score the selected genes of columns [colStart + begin, colStart + end) into a dense
+// n_selected x block buffer (column-major), clipping at scaleMax
+template <typename T>
+struct ScaleWorker : public RcppParallel::Worker
+{
+    const CscView &input;
+    const double *logX;
+    const std::vector<int> &rowMap;
+    const std::vector<double> &mean;
+    const std::vector<double> &invSd;
+    const double scaleMax;
+    const std::size_t colStart;
+    T *output;
+
+    ScaleWorker(const CscView &input, const double *logX, const std::vector<int> &rowMap, const std::vector<double> &mean,
+                const std::vector<double> &invSd, const double &scaleMax, const std::size_t &colStart, T *output)
+        : input(input), logX(logX), rowMap(rowMap), mean(mean), invSd(invSd), scaleMax(scaleMax), colStart(colStart), output(output) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::size_t n_selected = mean.size();
+        for(std::size_t b = begin; b < end; b++) {
+            std::size_t c = colStart + b;
+            T *column = output + b * n_selected;
+            for(std::size_t g = 0; g < n_selected; g++) {
+                column[g] = (T)std::min(-mean[g] * invSd[g], scaleMax);
+            }
+            for(int k = input.p[c]; k < input.p[c + 1]; k++) {
+                int g = rowMap[input.i[k]];
+                if(g >= 0) {
+                    column[g] = (T)std::min((logX[k] - mean[g]) * invSd[g], scaleMax);
+                }
+            }
+        }
+    }
+};
+
+// Per-gene sum and sum of squares over columns [begin, end) of a CSC block, in
+// thread-local row accumulators joined by parallelReduce
+template <typename P, typename I>
+struct GeneStatsWorker : public RcppParallel::Worker
+{
+    const P *p;
+    const I *i;
+    const double *x;
+    std::vector<double> sum;
+    std::vector<double> sumSq;
+
+    GeneStatsWorker(const P *p, const I *i, const double *x, const std::size_t &n_rows)
+        : p(p), i(i), x(x), sum(n_rows, 0), sumSq(n_rows, 0) {}
+
+    GeneStatsWorker(const GeneStatsWorker &worker, RcppParallel::Split)
+        : p(worker.p), i(worker.i), x(worker.x), sum(worker.sum.size(), 0), sumSq(worker.sumSq.size(), 0) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(P k = p[begin]; k < p[end]; k++) {
+            sum[i[k]] += x[k];
+            sumSq[i[k]] += x[k] * x[k];
+        }
+    }
+
+    void join(const GeneStatsWorker &worker) {
+        for(std::size_t r = 0; r < sum.size(); r++) {
+            sum[r] += worker.sum[r];
+            sumSq[r] += worker.sumSq[r];
+        }
+    }
+};
+
+// Sum of squared standardized values (x - mean) / sd, clipped at clipMax, over the
+// nonzeros of a CSC block, plus the number of nonzeros per gene so that the zeros
+// can be added afterwards
+template <typename P, typename I>
+struct StandardizedVarWorker : public RcppParallel::Worker
+{
+    const P *p;
+    const I *i;
+    const double *x;
+    const std::vector<double> &mean;
+    const std::vector<double> &sd;
+    const double clipMax;
+    std::vector<double> sumSq;
+    std::vector<std::size_t> nnz;
+
+    StandardizedVarWorker(const P *p, const I *i, const double *x, const std::vector<double> &mean,
+                          const std::vector<double> &sd, const double &clipMax)
+        : p(p), i(i), x(x), mean(mean), sd(sd), clipMax(clipMax), sumSq(mean.size(), 0), nnz(mean.size(), 0) {}
+
+    StandardizedVarWorker(const StandardizedVarWorker &worker, RcppParallel::Split)
+        : p(worker.p), i(worker.i), x(worker.x), mean(worker.mean), sd(worker.sd), clipMax(worker.clipMax),
+          sumSq(worker.mean.size(), 0), nnz(worker.mean.size(), 0) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(P k = p[begin]; k < p[end]; k++) {
+            std::size_t r = i[k];
+            if(sd[r] > 0) {
+                double value = std::min((x[k] - mean[r]) / sd[r], clipMax);
+                sumSq[r] += value * value;
+            }
+            nnz[r]++;
+        }
+    }
+
+    void join(const StandardizedVarWorker &worker) {
+        for(std::size_t r = 0; r < sumSq.size(); r++) {
+            sumSq[r] += worker.sumSq[r];
+            nnz[r] += worker.nnz[r];
+        }
+    }
+};
+
+// Local quadratic regression with tricube weights (loess, degree 2) evaluated at
+// every point. x must be sorted; each fit uses the span * n nearest points.
+struct LoessWorker : public RcppParallel::Worker
+{
+    const std::vector<double> &x;
+    const std::vector<double> &y;
+    const std::size_t n_neighbors;
+    std::vector<double> &fitted;
+
+    LoessWorker(const std::vector<double> &x, const std::vector<double> &y, const std::size_t &n_neighbors, std::vector<double> &fitted)
+        : x(x), y(y), n_neighbors(n_neighbors), fitted(fitted) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        std::size_t n = x.size();
+        std::size_t lo = 0;
+        for(std::size_t j = begin; j < end; j++) {
+            while(lo + n_neighbors < n && x[j] - x[lo] > x[lo + n_neighbors] - x[j]) {
+                lo++;
+            }
+            std::size_t hi = lo + n_neighbors;
+            double h = std::max(x[j] - x[lo], x[hi - 1] - x[j]) * 1.000001;
+
+            // Normal equations of the weighted fit centered at x[j]
+            double s[5] = {0, 0, 0, 0, 0};
+            double t[3] = {0, 0, 0};
+            for(std::size_t k = lo; k < hi; k++) {
+                double d = x[k] - x[j];
+                double u = (h > 0) ? std::fabs(d) / h : 0;
+                double w = (u < 1) ? std::pow(1 - u * u * u, 3) : 0;
+                double dk = w;
+                for(int m = 0; m < 5; m++) {
+                    s[m] += dk;
+                    if(m < 3) {
+                        t[m] += dk * y[k];
+                    }
+                    dk *= d;
+                }
+            }
+
+            double det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) + s[2] * (s[1] * s[3] - s[2] * s[2]);
+            if(std::fabs(det) > 1e-12 * std::max(s[0] * s[2] * s[4], 1e-300)) {
+                fitted[j] = (t[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (t[1] * s[4] - s[3] * t[2]) + s[2] * (t[1] * s[3] - s[2] * t[2])) / det;
+            } else {
+                fitted[j] = (s[0] > 0) ? t[0] / s[0] : y[j];
+            }
+        }
+    }
+};
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::List NormalizeLogScale(const Rcpp::S4 &mat, const Rcpp::IntegerVector &genes, const double &scaleFactor, const double &scaleMax,
+                             const bool &doScale, const std::string &h5Path, const std::string &datasetName, const bool &useFloat);
+Rcpp::List VariableGenesSpMt(const Rcpp::S4 &mat, const int &nFeatures, const std::string &method, const double &span, const int &nBins);
+Rcpp::List VariableGenesH5(const std::string &filePath, const std::string &groupName, const int &nFeatures, const std::string &method,
+                           const double &span, const int &nBins);
+
+#endif //PREPROCESS_UTIL
@@ -7,6 +7,62 @@
 
 using namespace Rcpp;
 
+// AggregateSpMt
+Rcpp::List AggregateSpMt(const Rcpp::S4& mat, const Rcpp::IntegerVector& group);
+RcppExport SEXP _Signac_AggregateSpMt(SEXP matSEXP, SEXP groupSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type group(groupSEXP);
+    rcpp_result_gen = Rcpp::wrap(AggregateSpMt(mat, group));
+    return rcpp_result_gen;
+END_RCPP
+}
+// AggregateH5
+Rcpp::List AggregateH5(const std::string& filePath, const std::string& groupName, const Rcpp::IntegerVector& group);
+RcppExport SEXP _Signac_AggregateH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP groupSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type group(groupSEXP);
+    rcpp_result_gen = Rcpp::wrap(AggregateH5(filePath, groupName, group));
+    return rcpp_result_gen;
+END_RCPP
+}
+// GroupExpressionSpMt
+Rcpp::List GroupExpressionSpMt(const Rcpp::S4& mat, const Rcpp::IntegerVector& group, const Rcpp::IntegerVector& genes, const bool& logScale, const double& scaleFactor);
+RcppExport SEXP _Signac_GroupExpressionSpMt(SEXP matSEXP, SEXP groupSEXP, SEXP genesSEXP, SEXP logScaleSEXP, SEXP scaleFactorSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type group(groupSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type genes(genesSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type logScale(logScaleSEXP);
+    Rcpp::traits::input_parameter< const double& >::type scaleFactor(scaleFactorSEXP);
+    rcpp_result_gen = Rcpp::wrap(GroupExpressionSpMt(mat, group, genes, logScale, scaleFactor));
+    return rcpp_result_gen;
+END_RCPP
+}
+// GroupExpressionH5
+Rcpp::List GroupExpressionH5(const std::string& filePath, const std::string& groupName, const Rcpp::IntegerVector& group, const Rcpp::IntegerVector& genes, const bool& logScale, const double& scaleFactor);
+RcppExport SEXP _Signac_GroupExpressionH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP groupSEXP, SEXP genesSEXP, SEXP logScaleSEXP, SEXP scaleFactorSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type group(groupSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type genes(genesSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type logScale(logScaleSEXP);
+    Rcpp::traits::input_parameter< const double& >::type scaleFactor(scaleFactorSEXP);
+    rcpp_result_gen = Rcpp::wrap(GroupExpressionH5(filePath, groupName, group, genes, logScale, scaleFactor));
+    return rcpp_result_gen;
+END_RCPP
+}
 // FastGetCurrentDate
 Rcpp::Date FastGetCurrentDate();
 RcppExport SEXP _Signac_FastGetCurrentDate() {
@@ -40,6 +96,156 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// RandomizedPca
+Rcpp::List RandomizedPca(const Rcpp::S4& mat, const Rcpp::IntegerVector& genes, const int& nComponents, const bool& center, const bool& scale, const int& nIter, const int& oversample);
+RcppExport SEXP _Signac_RandomizedPca(SEXP matSEXP, SEXP genesSEXP, SEXP nComponentsSEXP, SEXP centerSEXP, SEXP scaleSEXP, SEXP nIterSEXP, SEXP oversampleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type genes(genesSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nComponents(nComponentsSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type center(centerSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type scale(scaleSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nIter(nIterSEXP);
+    Rcpp::traits::input_parameter< const int& >::type oversample(oversampleSEXP);
+    rcpp_result_gen = Rcpp::wrap(RandomizedPca(mat, genes, nComponents, center, scale, nIter, oversample));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ComputeSnn
+Rcpp::S4 ComputeSnn(const Rcpp::IntegerMatrix& knnIndex, const double& prune);
+RcppExport SEXP _Signac_ComputeSnn(SEXP knnIndexSEXP, SEXP pruneSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type knnIndex(knnIndexSEXP);
+    Rcpp::traits::input_parameter< const double& >::type prune(pruneSEXP);
+    rcpp_result_gen = Rcpp::wrap(ComputeSnn(knnIndex, prune));
+    return rcpp_result_gen;
+END_RCPP
+}
+// LeidenClustering
+Rcpp::List LeidenClustering(const Rcpp::S4& graph, const double& resolution, const int& nStarts, const int& nIterations, const double& randomness, const int& seed);
+RcppExport SEXP _Signac_LeidenClustering(SEXP graphSEXP, SEXP resolutionSEXP, SEXP nStartsSEXP, SEXP nIterationsSEXP, SEXP randomnessSEXP, SEXP seedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type graph(graphSEXP);
+    Rcpp::traits::input_parameter< const double& >::type resolution(resolutionSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nStarts(nStartsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nIterations(nIterationsSEXP);
+    Rcpp::traits::input_parameter< const double& >::type randomness(randomnessSEXP);
+    Rcpp::traits::input_parameter< const int& >::type seed(seedSEXP);
+    rcpp_result_gen = Rcpp::wrap(LeidenClustering(graph, resolution, nStarts, nIterations, randomness, seed));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadH5AD
+Rcpp::S4 ReadH5AD(const std::string& filePath, const std::string& layer, const Rcpp::IntegerVector& cells);
+RcppExport SEXP _Signac_ReadH5AD(SEXP filePathSEXP, SEXP layerSEXP, SEXP cellsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type layer(layerSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type cells(cellsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadH5AD(filePath, layer, cells));
+    return rcpp_result_gen;
+END_RCPP
+}
+// WriteH5AD
+void WriteH5AD(const std::string& filePath, const Rcpp::S4& mat, const std::string& layer);
+RcppExport SEXP _Signac_WriteH5AD(SEXP filePathSEXP, SEXP matSEXP, SEXP layerSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type layer(layerSEXP);
+    WriteH5AD(filePath, mat, layer);
+    return R_NilValue;
+END_RCPP
+}
+// ImportH5ADToH5
+void ImportH5ADToH5(const std::string& h5adPath, const std::string& filePath, const std::string& groupName, const std::string& layer);
+RcppExport SEXP _Signac_ImportH5ADToH5(SEXP h5adPathSEXP, SEXP filePathSEXP, SEXP groupNameSEXP, SEXP layerSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type h5adPath(h5adPathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type layer(layerSEXP);
+    ImportH5ADToH5(h5adPath, filePath, groupName, layer);
+    return R_NilValue;
+END_RCPP
+}
+// ReadLoom
+Rcpp::S4 ReadLoom(const std::string& filePath, const std::string& layer, const Rcpp::IntegerVector& cells);
+RcppExport SEXP _Signac_ReadLoom(SEXP filePathSEXP, SEXP layerSEXP, SEXP cellsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type layer(layerSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type cells(cellsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadLoom(filePath, layer, cells));
+    return rcpp_result_gen;
+END_RCPP
+}
+// WriteLoom
+void WriteLoom(const std::string& filePath, const Rcpp::S4& mat, const std::string& layer);
+RcppExport SEXP _Signac_WriteLoom(SEXP filePathSEXP, SEXP matSEXP, SEXP layerSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type layer(layerSEXP);
+    WriteLoom(filePath, mat, layer);
+    return R_NilValue;
+END_RCPP
+}
+// ShardH5
+void ShardH5(const std::string& filePath, const std::string& groupName, const std::string& manifestPath, const int& nShards, const std::string& outGroupName);
+RcppExport SEXP _Signac_ShardH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP manifestPathSEXP, SEXP nShardsSEXP, SEXP outGroupNameSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type manifestPath(manifestPathSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nShards(nShardsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outGroupName(outGroupNameSEXP);
+    ShardH5(filePath, groupName, manifestPath, nShards, outGroupName);
+    return R_NilValue;
+END_RCPP
+}
+// ReadShardedH5
+Rcpp::S4 ReadShardedH5(const std::string& manifestPath, const std::string& groupName, const Rcpp::IntegerVector& shards, const int& nThreads);
+RcppExport SEXP _Signac_ReadShardedH5(SEXP manifestPathSEXP, SEXP groupNameSEXP, SEXP shardsSEXP, SEXP nThreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type manifestPath(manifestPathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type shards(shardsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nThreads(nThreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadShardedH5(manifestPath, groupName, shards, nThreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadShardedSums
+Rcpp::NumericVector ReadShardedSums(const std::string& manifestPath, const std::string& groupName, const int& margin, const int& nThreads);
+RcppExport SEXP _Signac_ReadShardedSums(SEXP manifestPathSEXP, SEXP groupNameSEXP, SEXP marginSEXP, SEXP nThreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type manifestPath(manifestPathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const int& >::type margin(marginSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nThreads(nThreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadShardedSums(manifestPath, groupName, margin, nThreads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // HarmonyMarker
 DataFrame HarmonyMarker(const Rcpp::S4& S4_mtx, const Rcpp::NumericVector& cluster, int threshold, int perm);
 RcppExport SEXP _Signac_HarmonyMarker(SEXP S4_mtxSEXP, SEXP clusterSEXP, SEXP thresholdSEXP, SEXP permSEXP) {
@@ -115,6 +321,18 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// ReadSpMtFromCache
+SEXP ReadSpMtFromCache(const std::string& filePath, const std::string& groupName);
+RcppExport SEXP _Signac_ReadSpMtFromCache(SEXP filePathSEXP, SEXP groupNameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadSpMtFromCache(filePath, groupName));
+    return rcpp_result_gen;
+END_RCPP
+}
 // ReadSpMtAsS4
 Rcpp::S4 ReadSpMtAsS4(const std::string& filePath, const std::string& groupName);
 RcppExport SEXP _Signac_ReadSpMtAsS4(SEXP filePathSEXP, SEXP groupNameSEXP) {
@@ -188,18 +406,32 @@ BEGIN_RCPP
 END_RCPP
 }
 // Read10XH5Content
-Rcpp::List Read10XH5Content(const std::string& filePath, const bool& use_names, const bool& unique_features);
-RcppExport SEXP _Signac_Read10XH5Content(SEXP filePathSEXP, SEXP use_namesSEXP, SEXP unique_featuresSEXP) {
+Rcpp::List Read10XH5Content(const std::string& filePath, const bool& use_names, const bool& unique_features, const Rcpp::CharacterVector& feature_types);
+RcppExport SEXP _Signac_Read10XH5Content(SEXP filePathSEXP, SEXP use_namesSEXP, SEXP unique_featuresSEXP, SEXP feature_typesSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
     Rcpp::traits::input_parameter< const bool& >::type use_names(use_namesSEXP);
     Rcpp::traits::input_parameter< const bool& >::type unique_features(unique_featuresSEXP);
-    rcpp_result_gen = Rcpp::wrap(Read10XH5Content(filePath, use_names, unique_features));
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type feature_types(feature_typesSEXP);
+    rcpp_result_gen = Rcpp::wrap(Read10XH5Content(filePath, use_names, unique_features, feature_types));
     return rcpp_result_gen;
 END_RCPP
 }
+// Write10XH5
+void Write10XH5(const std::string& filePath, const Rcpp::S4& mat, const Rcpp::CharacterVector& feature_types, const Rcpp::CharacterVector& genomes);
+RcppExport SEXP _Signac_Write10XH5(SEXP filePathSEXP, SEXP matSEXP, SEXP feature_typesSEXP, SEXP genomesSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type feature_types(feature_typesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type genomes(genomesSEXP);
+    Write10XH5(filePath, mat, feature_types, genomes);
+    return R_NilValue;
+END_RCPP
+}
 // WriteRootDataset
 void WriteRootDataset(const std::string& filePath, const std::string& datasetName, const std::vector<std::string>& datasetVal);
 RcppExport SEXP _Signac_WriteRootDataset(SEXP filePathSEXP, SEXP datasetNameSEXP, SEXP datasetValSEXP) {
@@ -225,7 +457,7 @@ BEGIN_RCPP
 END_RCPP
 }
 // ReadIntegerVector
-Rcpp::NumericVector ReadIntegerVector(const std::string& filePath, const std::string& groupName, const std::string& datasetName);
+Rcpp::IntegerVector ReadIntegerVector(const std::string& filePath, const std::string& groupName, const std::string& datasetName);
 RcppExport SEXP _Signac_ReadIntegerVector(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP datasetNameSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
@@ -250,6 +482,147 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// WriteSpMtAsDualLayout
+void WriteSpMtAsDualLayout(const std::string& filePath, const std::string& groupName, const Rcpp::S4& mat);
+RcppExport SEXP _Signac_WriteSpMtAsDualLayout(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP matSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    WriteSpMtAsDualLayout(filePath, groupName, mat);
+    return R_NilValue;
+END_RCPP
+}
+// WriteDualLayoutFromH5
+void WriteDualLayoutFromH5(const std::string& filePath, const std::string& groupName, const double& memLimitMb);
+RcppExport SEXP _Signac_WriteDualLayoutFromH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP memLimitMbSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const double& >::type memLimitMb(memLimitMbSEXP);
+    WriteDualLayoutFromH5(filePath, groupName, memLimitMb);
+    return R_NilValue;
+END_RCPP
+}
+// WriteSpMtAsExtendible
+void WriteSpMtAsExtendible(const std::string& filePath, const std::string& groupName, const Rcpp::S4& mat);
+RcppExport SEXP _Signac_WriteSpMtAsExtendible(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP matSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    WriteSpMtAsExtendible(filePath, groupName, mat);
+    return R_NilValue;
+END_RCPP
+}
+// AppendSpMtToH5
+void AppendSpMtToH5(const std::string& filePath, const std::string& groupName, const Rcpp::S4& mat);
+RcppExport SEXP _Signac_AppendSpMtToH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP matSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    AppendSpMtToH5(filePath, groupName, mat);
+    return R_NilValue;
+END_RCPP
+}
+// FilterSpMtH5
+Rcpp::List FilterSpMtH5(const std::string& filePath, const std::string& groupName, const std::string& outFilePath, const std::string& outGroupName, const Rcpp::LogicalVector& genes, const Rcpp::LogicalVector& cells, const double& minCells, const double& minGenes, const double& notExpressed);
+RcppExport SEXP _Signac_FilterSpMtH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP outFilePathSEXP, SEXP outGroupNameSEXP, SEXP genesSEXP, SEXP cellsSEXP, SEXP minCellsSEXP, SEXP minGenesSEXP, SEXP notExpressedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outFilePath(outFilePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outGroupName(outGroupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::LogicalVector& >::type genes(genesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::LogicalVector& >::type cells(cellsSEXP);
+    Rcpp::traits::input_parameter< const double& >::type minCells(minCellsSEXP);
+    Rcpp::traits::input_parameter< const double& >::type minGenes(minGenesSEXP);
+    Rcpp::traits::input_parameter< const double& >::type notExpressed(notExpressedSEXP);
+    rcpp_result_gen = Rcpp::wrap(FilterSpMtH5(filePath, groupName, outFilePath, outGroupName, genes, cells, minCells, minGenes, notExpressed));
+    return rcpp_result_gen;
+END_RCPP
+}
+// MergeH5ToH5
+void MergeH5ToH5(const std::vector<std::string>& filePaths, const std::vector<std::string>& groupNames, const std::vector<std::string>& prefixes, const std::string& outFilePath, const std::string& outGroupName);
+RcppExport SEXP _Signac_MergeH5ToH5(SEXP filePathsSEXP, SEXP groupNamesSEXP, SEXP prefixesSEXP, SEXP outFilePathSEXP, SEXP outGroupNameSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type filePaths(filePathsSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type groupNames(groupNamesSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type prefixes(prefixesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outFilePath(outFilePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outGroupName(outGroupNameSEXP);
+    MergeH5ToH5(filePaths, groupNames, prefixes, outFilePath, outGroupName);
+    return R_NilValue;
+END_RCPP
+}
+// FederateH5ToH5
+void FederateH5ToH5(const std::vector<std::string>& filePaths, const std::vector<std::string>& groupNames, const std::vector<std::string>& prefixes, const std::string& outFilePath, const std::string& outGroupName);
+RcppExport SEXP _Signac_FederateH5ToH5(SEXP filePathsSEXP, SEXP groupNamesSEXP, SEXP prefixesSEXP, SEXP outFilePathSEXP, SEXP outGroupNameSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type filePaths(filePathsSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type groupNames(groupNamesSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type prefixes(prefixesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outFilePath(outFilePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type outGroupName(outGroupNameSEXP);
+    FederateH5ToH5(filePaths, groupNames, prefixes, outFilePath, outGroupName);
+    return R_NilValue;
+END_RCPP
+}
+// FindKnn
+Rcpp::List FindKnn(const Rcpp::NumericMatrix& embeddings, const int& k, const int& nTrees, const int& searchK, const int& leafSize, const int& seed, const std::string& filePath, const std::string& groupName, const bool& rebuild);
+RcppExport SEXP _Signac_FindKnn(SEXP embeddingsSEXP, SEXP kSEXP, SEXP nTreesSEXP, SEXP searchKSEXP, SEXP leafSizeSEXP, SEXP seedSEXP, SEXP filePathSEXP, SEXP groupNameSEXP, SEXP rebuildSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type embeddings(embeddingsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type k(kSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nTrees(nTreesSEXP);
+    Rcpp::traits::input_parameter< const int& >::type searchK(searchKSEXP);
+    Rcpp::traits::input_parameter< const int& >::type leafSize(leafSizeSEXP);
+    Rcpp::traits::input_parameter< const int& >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type rebuild(rebuildSEXP);
+    rcpp_result_gen = Rcpp::wrap(FindKnn(embeddings, k, nTrees, searchK, leafSize, seed, filePath, groupName, rebuild));
+    return rcpp_result_gen;
+END_RCPP
+}
+// QueryKnnIndex
+Rcpp::List QueryKnnIndex(const std::string& filePath, const std::string& groupName, const Rcpp::NumericMatrix& query, const int& k, const int& searchK);
+RcppExport SEXP _Signac_QueryKnnIndex(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP querySEXP, SEXP kSEXP, SEXP searchKSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type query(querySEXP);
+    Rcpp::traits::input_parameter< const int& >::type k(kSEXP);
+    Rcpp::traits::input_parameter< const int& >::type searchK(searchKSEXP);
+    rcpp_result_gen = Rcpp::wrap(QueryKnnIndex(filePath, groupName, query, k, searchK));
+    return rcpp_result_gen;
+END_RCPP
+}
+// WilcoxMarkers
+Rcpp::List WilcoxMarkers(const Rcpp::S4& mat, const Rcpp::IntegerVector& cluster);
+RcppExport SEXP _Signac_WilcoxMarkers(SEXP matSEXP, SEXP clusterSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type cluster(clusterSEXP);
+    rcpp_result_gen = Rcpp::wrap(WilcoxMarkers(mat, cluster));
+    return rcpp_result_gen;
+END_RCPP
+}
 // FastMatMult
 arma::mat FastMatMult(const arma::mat& mat1, const arma::mat& mat2);
 RcppExport SEXP _Signac_FastMatMult(SEXP mat1SEXP, SEXP mat2SEXP) {
@@ -299,6 +672,83 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// ModuleScore
+Rcpp::NumericMatrix ModuleScore(const Rcpp::S4& mat, const Rcpp::S4& signatures, const int& nBins, const int& nCtrl, const int& seed);
+RcppExport SEXP _Signac_ModuleScore(SEXP matSEXP, SEXP signaturesSEXP, SEXP nBinsSEXP, SEXP nCtrlSEXP, SEXP seedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type signatures(signaturesSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nBins(nBinsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nCtrl(nCtrlSEXP);
+    Rcpp::traits::input_parameter< const int& >::type seed(seedSEXP);
+    rcpp_result_gen = Rcpp::wrap(ModuleScore(mat, signatures, nBins, nCtrl, seed));
+    return rcpp_result_gen;
+END_RCPP
+}
+// NormalizeLogScale
+Rcpp::List NormalizeLogScale(const Rcpp::S4& mat, const Rcpp::IntegerVector& genes, const double& scaleFactor, const double& scaleMax, const bool& doScale, const std::string& h5Path, const std::string& datasetName, const bool& useFloat, const bool& overwrite);
+RcppExport SEXP _Signac_NormalizeLogScale(SEXP matSEXP, SEXP genesSEXP, SEXP scaleFactorSEXP, SEXP scaleMaxSEXP, SEXP doScaleSEXP, SEXP h5PathSEXP, SEXP datasetNameSEXP, SEXP useFloatSEXP, SEXP overwriteSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type genes(genesSEXP);
+    Rcpp::traits::input_parameter< const double& >::type scaleFactor(scaleFactorSEXP);
+    Rcpp::traits::input_parameter< const double& >::type scaleMax(scaleMaxSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type doScale(doScaleSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type h5Path(h5PathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type datasetName(datasetNameSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type useFloat(useFloatSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type overwrite(overwriteSEXP);
+    rcpp_result_gen = Rcpp::wrap(NormalizeLogScale(mat, genes, scaleFactor, scaleMax, doScale, h5Path, datasetName, useFloat, overwrite));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadScaledH5
+Rcpp::NumericMatrix ReadScaledH5(const std::string& h5Path, const std::string& datasetName);
+RcppExport SEXP _Signac_ReadScaledH5(SEXP h5PathSEXP, SEXP datasetNameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type h5Path(h5PathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type datasetName(datasetNameSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadScaledH5(h5Path, datasetName));
+    return rcpp_result_gen;
+END_RCPP
+}
+// VariableGenesSpMt
+Rcpp::List VariableGenesSpMt(const Rcpp::S4& mat, const int& nFeatures, const std::string& method, const double& span, const int& nBins);
+RcppExport SEXP _Signac_VariableGenesSpMt(SEXP matSEXP, SEXP nFeaturesSEXP, SEXP methodSEXP, SEXP spanSEXP, SEXP nBinsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::S4& >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nFeatures(nFeaturesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type method(methodSEXP);
+    Rcpp::traits::input_parameter< const double& >::type span(spanSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nBins(nBinsSEXP);
+    rcpp_result_gen = Rcpp::wrap(VariableGenesSpMt(mat, nFeatures, method, span, nBins));
+    return rcpp_result_gen;
+END_RCPP
+}
+// VariableGenesH5
+Rcpp::List VariableGenesH5(const std::string& filePath, const std::string& groupName, const int& nFeatures, const std::string& method, const double& span, const int& nBins);
+RcppExport SEXP _Signac_VariableGenesH5(SEXP filePathSEXP, SEXP groupNameSEXP, SEXP nFeaturesSEXP, SEXP methodSEXP, SEXP spanSEXP, SEXP nBinsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filePath(filePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type groupName(groupNameSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nFeatures(nFeaturesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type method(methodSEXP);
+    Rcpp::traits::input_parameter< const double& >::type span(spanSEXP);
+    Rcpp::traits::input_parameter< const int& >::type nBins(nBinsSEXP);
+    rcpp_result_gen = Rcpp::wrap(VariableGenesH5(filePath, groupName, nFeatures, method, span, nBins));
+    return rcpp_result_gen;
+END_RCPP
+}
 // FastCreateSparseMat
 arma::sp_mat FastCreateSparseMat(int nrow, int ncol);
 RcppExport SEXP _Signac_FastCreateSparseMat(SEXP nrowSEXP, SEXP ncolSEXP) {
@@ -675,32 +1125,93 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// ReadMtx10X
+Rcpp::S4 ReadMtx10X(const std::string& matrixPath, const std::string& barcodePath, const std::string& featurePath, const int& featureColumn, const bool& stripSuffix, const bool& uniqueFeatures);
+RcppExport SEXP _Signac_ReadMtx10X(SEXP matrixPathSEXP, SEXP barcodePathSEXP, SEXP featurePathSEXP, SEXP featureColumnSEXP, SEXP stripSuffixSEXP, SEXP uniqueFeaturesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type matrixPath(matrixPathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type barcodePath(barcodePathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type featurePath(featurePathSEXP);
+    Rcpp::traits::input_parameter< const int& >::type featureColumn(featureColumnSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type stripSuffix(stripSuffixSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type uniqueFeatures(uniqueFeaturesSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadMtx10X(matrixPath, barcodePath, featurePath, featureColumn, stripSuffix, uniqueFeatures));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ReadDelimSparse
+Rcpp::S4 ReadDelimSparse(const std::string& matPath, const std::string& sep, const bool& header);
+RcppExport SEXP _Signac_ReadDelimSparse(SEXP matPathSEXP, SEXP sepSEXP, SEXP headerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type matPath(matPathSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type sep(sepSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type header(headerSEXP);
+    rcpp_result_gen = Rcpp::wrap(ReadDelimSparse(matPath, sep, header));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_Signac_AggregateSpMt", (DL_FUNC) &_Signac_AggregateSpMt, 2},
+    {"_Signac_AggregateH5", (DL_FUNC) &_Signac_AggregateH5, 3},
+    {"_Signac_GroupExpressionSpMt", (DL_FUNC) &_Signac_GroupExpressionSpMt, 5},
+    {"_Signac_GroupExpressionH5", (DL_FUNC) &_Signac_GroupExpressionH5, 6},
     {"_Signac_FastGetCurrentDate", (DL_FUNC) &_Signac_FastGetCurrentDate, 0},
     {"_Signac_FastDiffVector", (DL_FUNC) &_Signac_FastDiffVector, 2},
     {"_Signac_FastRandVector", (DL_FUNC) &_Signac_FastRandVector, 1},
+    {"_Signac_RandomizedPca", (DL_FUNC) &_Signac_RandomizedPca, 7},
+    {"_Signac_ComputeSnn", (DL_FUNC) &_Signac_ComputeSnn, 2},
+    {"_Signac_LeidenClustering", (DL_FUNC) &_Signac_LeidenClustering, 6},
+    {"_Signac_ReadH5AD", (DL_FUNC) &_Signac_ReadH5AD, 3},
+    {"_Signac_WriteH5AD", (DL_FUNC) &_Signac_WriteH5AD, 3},
+    {"_Signac_ImportH5ADToH5", (DL_FUNC) &_Signac_ImportH5ADToH5, 4},
+    {"_Signac_ReadLoom", (DL_FUNC) &_Signac_ReadLoom, 3},
+    {"_Signac_WriteLoom", (DL_FUNC) &_Signac_WriteLoom, 3},
+    {"_Signac_ShardH5", (DL_FUNC) &_Signac_ShardH5, 5},
+    {"_Signac_ReadShardedH5", (DL_FUNC) &_Signac_ReadShardedH5, 4},
+    {"_Signac_ReadShardedSums", (DL_FUNC) &_Signac_ReadShardedSums, 4},
     {"_Signac_HarmonyMarker", (DL_FUNC) &_Signac_HarmonyMarker, 4},
     {"_Signac_HarmonyMarkerH5", (DL_FUNC) &_Signac_HarmonyMarkerH5, 3},
     {"_Signac_WriteSpMtAsSpMat", (DL_FUNC) &_Signac_WriteSpMtAsSpMat, 3},
     {"_Signac_WriteSpMtAsSpMatFromS4", (DL_FUNC) &_Signac_WriteSpMtAsSpMatFromS4, 3},
     {"_Signac_WriteSpMtAsS4", (DL_FUNC) &_Signac_WriteSpMtAsS4, 3},
     {"_Signac_ReadSpMtAsSPMat", (DL_FUNC) &_Signac_ReadSpMtAsSPMat, 2},
+    {"_Signac_ReadSpMtFromCache", (DL_FUNC) &_Signac_ReadSpMtFromCache, 2},
     {"_Signac_ReadSpMtAsS4", (DL_FUNC) &_Signac_ReadSpMtAsS4, 2},
     {"_Signac_ReadRowSumSpMt", (DL_FUNC) &_Signac_ReadRowSumSpMt, 2},
     {"_Signac_ReadColSumSpMt", (DL_FUNC) &_Signac_ReadColSumSpMt, 2},
     {"_Signac_GetListAttributes", (DL_FUNC) &_Signac_GetListAttributes, 3},
     {"_Signac_GetListObjectNames", (DL_FUNC) &_Signac_GetListObjectNames, 2},
     {"_Signac_GetListRootObjectNames", (DL_FUNC) &_Signac_GetListRootObjectNames, 1},
-    {"_Signac_Read10XH5Content", (DL_FUNC) &_Signac_Read10XH5Content, 3},
+    {"_Signac_Read10XH5Content", (DL_FUNC) &_Signac_Read10XH5Content, 4},
+    {"_Signac_Write10XH5", (DL_FUNC) &_Signac_Write10XH5, 4},
     {"_Signac_WriteRootDataset", (DL_FUNC) &_Signac_WriteRootDataset, 3},
     {"_Signac_ReadRootDataset", (DL_FUNC) &_Signac_ReadRootDataset, 2},
     {"_Signac_ReadIntegerVector", (DL_FUNC) &_Signac_ReadIntegerVector, 3},
     {"_Signac_ReadDoubleVector", (DL_FUNC) &_Signac_ReadDoubleVector, 3},
+    {"_Signac_WriteSpMtAsDualLayout", (DL_FUNC) &_Signac_WriteSpMtAsDualLayout, 3},
+    {"_Signac_WriteDualLayoutFromH5", (DL_FUNC) &_Signac_WriteDualLayoutFromH5, 3},
+    {"_Signac_WriteSpMtAsExtendible", (DL_FUNC) &_Signac_WriteSpMtAsExtendible, 3},
+    {"_Signac_AppendSpMtToH5", (DL_FUNC) &_Signac_AppendSpMtToH5, 3},
+    {"_Signac_FilterSpMtH5", (DL_FUNC) &_Signac_FilterSpMtH5, 9},
+    {"_Signac_MergeH5ToH5", (DL_FUNC) &_Signac_MergeH5ToH5, 5},
+    {"_Signac_FederateH5ToH5", (DL_FUNC) &_Signac_FederateH5ToH5, 5},
+    {"_Signac_FindKnn", (DL_FUNC) &_Signac_FindKnn, 9},
+    {"_Signac_QueryKnnIndex", (DL_FUNC) &_Signac_QueryKnnIndex, 5},
+    {"_Signac_WilcoxMarkers", (DL_FUNC) &_Signac_WilcoxMarkers, 2},
     {"_Signac_FastMatMult", (DL_FUNC) &_Signac_FastMatMult, 2},
     {"_Signac_FastGetRowsOfMat", (DL_FUNC) &_Signac_FastGetRowsOfMat, 2},
     {"_Signac_FastGetColsOfMat", (DL_FUNC) &_Signac_FastGetColsOfMat, 2},
     {"_Signac_FastGetSubMat", (DL_FUNC) &_Signac_FastGetSubMat, 3},
+    {"_Signac_ModuleScore", (DL_FUNC) &_Signac_ModuleScore, 5},
+    {"_Signac_NormalizeLogScale", (DL_FUNC) &_Signac_NormalizeLogScale, 9},
+    {"_Signac_ReadScaledH5", (DL_FUNC) &_Signac_ReadScaledH5, 2},
+    {"_Signac_VariableGenesSpMt", (DL_FUNC) &_Signac_VariableGenesSpMt, 5},
+    {"_Signac_VariableGenesH5", (DL_FUNC) &_Signac_VariableGenesH5, 6},
     {"_Signac_FastCreateSparseMat", (DL_FUNC) &_Signac_FastCreateSparseMat, 2},
     {"_Signac_FastStatsOfSparseMat", (DL_FUNC) &_Signac_FastStatsOfSparseMat, 1},
     {"_Signac_FastCreateFromTriplet", (DL_FUNC) &_Signac_FastCreateFromTriplet, 3},
@@ -733,6 +1244,8 @@ static const R_CallMethodDef CallEntries[] = {
     {"_Signac_FastGetSumSparseMatByAllCols", (DL_FUNC) &_Signac_FastGetSumSparseMatByAllCols, 1},
     {"_Signac_FastGetMedianSparseMatByAllRows", (DL_FUNC) &_Signac_FastGetMedianSparseMatByAllRows, 1},
     {"_Signac_FastGetMedianSparseMatByAllCols", (DL_FUNC) &_Signac_FastGetMedianSparseMatByAllCols, 1},
+    {"_Signac_ReadMtx10X", (DL_FUNC) &_Signac_ReadMtx10X, 6},
+    {"_Signac_ReadDelimSparse", (DL_FUNC) &_Signac_ReadDelimSparse, 3},
     {NULL, NULL, 0}
 };
 
@@ -0,0 +1,377 @@
+#ifndef SPMT_CACHE
+#define SPMT_CACHE
+
+#define SPMT_CACHE_MAGIC "SGNCSC\0\0"
+#define SPMT_CACHE_VERSION 1
+#define SPMT_CACHE_ALIGN 64
+#define SPMT_CACHE_HAS_NAMES 0x1
+
+#include <RcppArmadillo.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(WIN32) || defined(_WIN32)
+#define SPMT_CACHE_NO_MMAP
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace Rcpp;
+using namespace arma;
+
+namespace com {
+namespace bioturing {
+
+// Fixed-size file header. Sections start on SPMT_CACHE_ALIGN boundaries so
+// p (int32), i (int32) and x (double) can be used in place once mapped.
+struct SpMtCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t n_rows;
+    uint64_t n_cols;
+    uint64_t nnz;
+    uint64_t p_offset;
+    uint64_t i_offset;
+    uint64_t x_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+// Versioned binary CSC cache: header, p, i, x and optional NUL-separated
+// row names followed by column names. Readers map the file read-only, so
+// several R processes loading the same cache share the page cache.
+class SpMtCache {
+public:
+    SpMtCache(const std::string &file_name_) {
+        file_name = std::string(file_name_.data(), file_name_.size());
+        header = nullptr;
+        buffer = nullptr;
+        buffer_size = 0;
+    }
+
+    ~SpMtCache() {
+        Close();
+    }
+
+    static bool IsCacheFile(const std::string &file_path) {
+        std::ifstream infile(file_path, std::ios::binary);
+        if(infile.good() == false) {
+            return false;
+        }
+
+        char magic[8];
+        infile.read(magic, sizeof(magic));
+        return (infile.gcount() == sizeof(magic)) && (std::memcmp(magic, SPMT_CACHE_MAGIC, sizeof(magic)) == 0);
+    }
+
+    template <typename P, typename I, typename X>
+    bool Write(const P &p, const I &i, const X &x, const std::size_t &n_rows, const std::size_t &n_cols,
+               const std::vector<std::string> &rowNames, const std::vector<std::string> &colNames) {
+        std::size_t nnz = p[n_cols];
+        bool hasNames = (rowNames.size() == n_rows) && (colNames.size() == n_cols) && (n_rows + n_cols > 0);
+
+        std::string names;
+        if(hasNames == true) {
+            for(const std::string &name : rowNames) {
+                names.append(name).push_back('\0');
+            }
+            for(const std::string &name : colNames) {
+                names.append(name).push_back('\0');
+            }
+        }
+
+        SpMtCacheHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, SPMT_CACHE_MAGIC, sizeof(h.magic));
+        h.version = SPMT_CACHE_VERSION;
+        h.byte_order = 0x01020304;
+        h.flags = hasNames ? SPMT_CACHE_HAS_NAMES : 0;
+        h.n_rows = n_rows;
+        h.n_cols = n_cols;
+        h.nnz = nnz;
+        h.p_offset = Align(sizeof(SpMtCacheHeader));
+        h.i_offset = Align(h.p_offset + (n_cols + 1) * sizeof(int32_t));
+        h.x_offset = Align(h.i_offset + nnz * sizeof(int32_t));
+        h.names_offset = Align(h.x_offset + nnz * sizeof(double));
+        h.names_size = names.size();
+
+        // Written aside and renamed into place: truncating the cache itself would crash
+        // (SIGBUS) any process that has it mapped
+        std::string tmpName = GetTempFileName();
+        std::ofstream outfile(tmpName, std::ios::binary | std::ios::trunc);
+        if(outfile.good() == false) {
+            return false;
+        }
+
+        outfile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+        std::vector<int32_t> colPtr(n_cols + 1);
+        for(std::size_t c = 0; c <= n_cols; c++) {
+            colPtr[c] = (int32_t)p[c];
+        }
+        Pad(outfile, h.p_offset);
+        outfile.write(reinterpret_cast<const char*>(colPtr.data()), colPtr.size() * sizeof(int32_t));
+
+        // Stream i and x in blocks to avoid a full int32/double copy of the matrix
+        const std::size_t blockSize = 1 << 20;
+        Pad(outfile, h.i_offset);
+        std::vector<int32_t> rowBlock;
+        for(std::size_t start = 0; start < nnz; start += blockSize) {
+            std::size_t end = std::min(nnz, start + blockSize);
+            rowBlock.resize(end - start);
+            for(std::size_t k = start; k < end; k++) {
+                rowBlock[k - start] = (int32_t)i[k];
+            }
+            outfile.write(reinterpret_cast<const char*>(rowBlock.data()), rowBlock.size() * sizeof(int32_t));
+        }
+
+        Pad(outfile, h.x_offset);
+        std::vector<double> valueBlock;
+        for(std::size_t start = 0; start < nnz; start += blockSize) {
+            std::size_t end = std::min(nnz, start + blockSize);
+            valueBlock.resize(end - start);
+            for(std::size_t k = start; k < end; k++) {
+                valueBlock[k - start] = (double)x[k];
+            }
+            outfile.write(reinterpret_cast<const char*>(valueBlock.data()), valueBlock.size() * sizeof(double));
+        }
+
+        Pad(outfile, h.names_offset);
+        outfile.write(names.data(), names.size());
+        outfile.close();
+        if(outfile.good() == false) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+#ifdef SPMT_CACHE_NO_MMAP
+        std::remove(file_name.c_str());
+#endif
+        if(std::rename(tmpName.c_str(), file_name.c_str()) != 0) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool Open() {
+        Close();
+#ifdef SPMT_CACHE_NO_MMAP
+        std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+        if(infile.good() == false) {
+            return false;
+        }
+
+        buffer_size = infile.tellg();
+        buffer = new char[buffer_size];
+        infile.seekg(0);
+        infile.read(buffer, buffer_size);
+#else
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if(::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SpMtCacheHeader)) {
+            ::close(fd);
+            return false;
+        }
+
+        buffer_size = st.st_size;
+        void *addr = ::mmap(nullptr, buffer_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(addr == MAP_FAILED) {
+            buffer_size = 0;
+            return false;
+        }
+        ::madvise(addr, buffer_size, MADV_SEQUENTIAL);
+        buffer = static_cast<char*>(addr);
+#endif
+
+        header = reinterpret_cast<const SpMtCacheHeader*>(buffer);
+        if(Validate() == false) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if(buffer != nullptr) {
+#ifdef SPMT_CACHE_NO_MMAP
+            delete[] buffer;
+#else
+            ::munmap(buffer, buffer_size);
+#endif
+        }
+        header = nullptr;
+        buffer = nullptr;
+        buffer_size = 0;
+    }
+
+    std::size_t GetNumRows() const { return header->n_rows; }
+    std::size_t GetNumCols() const { return header->n_cols; }
+    std::size_t GetNumNonZeros() const { return header->nnz; }
+    bool HasNames() const { return (header->flags & SPMT_CACHE_HAS_NAMES) != 0; }
+
+    // Views into the mapping, valid until Close()
+    const int32_t *GetColPtr() const { return reinterpret_cast<const int32_t*>(buffer + header->p_offset); }
+    const int32_t *GetRowIndices() const { return reinterpret_cast<const int32_t*>(buffer + header->i_offset); }
+    const double *GetValues() const { return reinterpret_cast<const double*>(buffer + header->x_offset); }
+
+    // Row indices in [0, n_rows), to be checked before the slots are handed out as a matrix
+    bool CheckRowIndices() const {
+        const int32_t *i = GetRowIndices();
+        for(std::size_t k = 0; k < header->nnz; k++) {
+            if(i[k] < 0 || (uint64_t)i[k] >= header->n_rows) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void GetNames(std::vector<std::string> &rowNames, std::vector<std::string> &colNames) const {
+        rowNames.clear();
+        colNames.clear();
+        if(HasNames() == false) {
+            return;
+        }
+
+        const char *ptr = buffer + header->names_offset;
+        const char *end = ptr + header->names_size;
+        rowNames.reserve(header->n_rows);
+        colNames.reserve(header->n_cols);
+        while(ptr < end) {
+            std::size_t len = std::strlen(ptr);
+            if(rowNames.size() < header->n_rows) {
+                rowNames.emplace_back(ptr, len);
+            } else {
+                colNames.emplace_back(ptr, len);
+            }
+            ptr += len + 1;
+        }
+    }
+
+    Rcpp::S4 ToS4() const {
+        std::size_t n_cols = header->n_cols;
+        std::size_t nnz = header->nnz;
+        Rcpp::IntegerVector p(n_cols + 1);
+        Rcpp::IntegerVector i(nnz);
+        Rcpp::NumericVector x(nnz);
+        std::memcpy(p.begin(), GetColPtr(), (n_cols + 1) * sizeof(int32_t));
+        std::memcpy(i.begin(), GetRowIndices(), nnz * sizeof(int32_t));
+        std::memcpy(x.begin(), GetValues(), nnz * sizeof(double));
+
+        std::string klass = "dgCMatrix";
+        Rcpp::S4 s(klass);
+        s.slot("i") = i;
+        s.slot("p") = p;
+        s.slot("x") = x;
+        s.slot("Dim") = Rcpp::IntegerVector::create(header->n_rows, n_cols);
+
+        std::vector<std::string> rowNames, colNames;
+        GetNames(rowNames, colNames);
+        if(HasNames() == true) {
+            s.slot("Dimnames") = Rcpp::List::create(rowNames, colNames);
+        }
+        return s;
+    }
+
+    arma::sp_mat ToArma() const {
+        std::size_t n_cols = header->n_cols;
+        std::size_t nnz = header->nnz;
+        const int32_t *p = GetColPtr();
+        const int32_t *i = GetRowIndices();
+        arma::uvec colPtr(n_cols + 1);
+        arma::uvec rowIndices(nnz);
+        for(std::size_t c = 0; c <= n_cols; c++) {
+            colPtr[c] = p[c];
+        }
+        for(std::size_t k = 0; k < nnz; k++) {
+            rowIndices[k] = i[k];
+        }
+        arma::vec values(const_cast<double*>(GetValues()), nnz, false, true);
+        return arma::sp_mat(rowIndices, colPtr, values, header->n_rows, n_cols);
+    }
+
+private:
+    static uint64_t Align(const uint64_t &offset) {
+        return (offset + SPMT_CACHE_ALIGN - 1) / SPMT_CACHE_ALIGN * SPMT_CACHE_ALIGN;
+    }
+
+    static void Pad(std::ofstream &outfile, const uint64_t &offset) {
+        static const char zeros[SPMT_CACHE_ALIGN] = {0};
+        uint64_t pos = outfile.tellp();
+        if(offset > pos) {
+            outfile.write(zeros, offset - pos);
+        }
+    }
+
+    // Same directory as the cache so that rename() stays atomic
+    std::string GetTempFileName() const {
+#ifdef SPMT_CACHE_NO_MMAP
+        return file_name + ".tmp";
+#else
+        return file_name + ".tmp." + std::to_string(::getpid());
+#endif
+    }
+
+    bool Validate() const {
+        if(std::memcmp(header->magic, SPMT_CACHE_MAGIC, sizeof(header->magic)) != 0) {
+            return false;
+        }
+
+        if(header->version != SPMT_CACHE_VERSION || header->byte_order != 0x01020304) {
+            return false;
+        }
+
+        const uint64_t maxIndex = INT32_MAX;
+        if(header->n_rows > maxIndex || header->n_cols >= maxIndex || header->nnz > maxIndex) {
+            return false;
+        }
+
+        uint64_t expected = header->names_offset + header->names_size;
+        bool layout = (buffer_size >= expected) &&
+                      (header->p_offset >= sizeof(SpMtCacheHeader)) &&
+                      (header->i_offset >= header->p_offset + (header->n_cols + 1) * sizeof(int32_t)) &&
+                      (header->x_offset >= header->i_offset + header->nnz * sizeof(int32_t)) &&
+                      (header->names_offset >= header->x_offset + header->nnz * sizeof(double)) &&
+                      (header->names_size == 0 || buffer[expected - 1] == '\0');
+        if(layout == false) {
+            return false;
+        }
+
+        // Opening stays O(n_cols): only the column pointers are checked here, row indices are
+        // checked by the readers that already go over every nonzero (CheckRowIndices)
+        const int32_t *p = GetColPtr();
+        if(p[0] != 0 || (uint64_t)p[header->n_cols] != header->nnz) {
+            return false;
+        }
+        for(std::size_t c = 0; c < header->n_cols; c++) {
+            if(p[c + 1] < p[c]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string file_name;
+    const SpMtCacheHeader *header;
+    char *buffer;
+    std::size_t buffer_size;
+};
+
+} // namespace bioturing
+} // namespace com
+
+#endif //SPMT_CACHE
@@ -0,0 +1,317 @@
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+
+// [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::depends(RcppArmadillo)]]
+#include "TextUtil.h"
+
+//' ReadMtx10X
+//'
+//' Read a 10X Matrix Market directory (plain or gzip) into a dgCMatrix. Entry lines are parsed in parallel chunks
+//'
+//' @param matrixPath Path to matrix.mtx or matrix.mtx.gz
+//' @param barcodePath Path to barcodes.tsv or barcodes.tsv.gz
+//' @param featurePath Path to genes.tsv or features.tsv.gz
+//' @param featureColumn Column of the feature file used as row names. Default is 2
+//' @param stripSuffix Remove the "-1" suffix when every barcode has it. Default is TRUE
+//' @param uniqueFeatures Make feature names unique like make.unique. Default is TRUE
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ReadMtx10X(const std::string &matrixPath, const std::string &barcodePath, const std::string &featurePath,
+                    const int &featureColumn = 2, const bool &stripSuffix = true, const bool &uniqueFeatures = true) {
+    com::bioturing::TextFile oTextFile(matrixPath);
+    if(oTextFile.Open() == false) {
+        std::stringstream ostr;
+        ostr << "Can not open matrix file :" << matrixPath;
+        Rcpp::stop(ostr.str());
+    }
+
+    const char *p = oTextFile.Begin();
+    const char *end = oTextFile.End();
+
+    // Banner, comments and the "rows cols nnz" size line
+    std::string banner(p, com::bioturing::NextLine(p, end));
+    if(banner.compare(0, 14, "%%MatrixMarket") != 0 || banner.find("coordinate") == std::string::npos) {
+        std::stringstream ostr;
+        ostr << "Not a coordinate Matrix Market file :" << matrixPath;
+        Rcpp::stop(ostr.str());
+    }
+    bool pattern = (banner.find("pattern") != std::string::npos);
+
+    while(p < end && *p == '%') {
+        p = com::bioturing::NextLine(p, end);
+    }
+
+    uint64_t n_rows = 0, n_cols = 0, n_entries = 0;
+    p = com::bioturing::SkipBlank(p, end);
+    bool ok = com::bioturing::ParseUnsigned(p, end, n_rows);
+    p = com::bioturing::SkipBlank(p, end);
+    ok = ok && com::bioturing::ParseUnsigned(p, end, n_cols);
+    p = com::bioturing::SkipBlank(p, end);
+    ok = ok && com::bioturing::ParseUnsigned(p, end, n_entries);
+    if(ok == false) {
+        std::stringstream ostr;
+        ostr << "Invalid size line in :" << matrixPath;
+        Rcpp::stop(ostr.str());
+    }
+    p = com::bioturing::NextLine(p, end);
+
+    // About 8MB of text per chunk keeps every worker busy on large files
+    std::size_t nChunks = std::max<std::size_t>(1, (end - p) >> 23);
+    std::vector<const char*> bounds;
+    com::bioturing::SplitLineChunks(p, end, nChunks, bounds);
+    std::vector<com::bioturing::MtxChunk> chunks(bounds.size() - 1);
+    com::bioturing::MtxParseWorker mtxParseWorker(bounds, pattern, chunks);
+    RcppParallel::parallelFor(0, chunks.size(), mtxParseWorker, 1);
+
+    std::size_t nnz = 0;
+    for(const com::bioturing::MtxChunk &chunk : chunks) {
+        if(chunk.failed == true) {
+            std::stringstream ostr;
+            ostr << "Invalid entry line in :" << matrixPath;
+            Rcpp::stop(ostr.str());
+        }
+        for(std::size_t k = 0; k < chunk.rows.size(); k++) {
+            if(chunk.rows[k] >= n_rows || chunk.cols[k] >= n_cols) {
+                std::stringstream ostr;
+                ostr << "Entry out of bounds in :" << matrixPath;
+                Rcpp::stop(ostr.str());
+            }
+        }
+        nnz += chunk.rows.size();
+    }
+    if(nnz != n_entries) {
+        ::Rf_warning("Number of entries does not match the Matrix Market size line");
+    }
+    oTextFile.Close();
+
+    // Counting sort of the triplets into CSC
+    std::vector<std::size_t> colPtr(n_cols + 1, 0);
+    for(const com::bioturing::MtxChunk &chunk : chunks) {
+        for(const uint32_t &col : chunk.cols) {
+            colPtr[col + 1]++;
+        }
+    }
+    for(std::size_t c = 0; c < n_cols; c++) {
+        colPtr[c + 1] += colPtr[c];
+    }
+
+    Rcpp::IntegerVector arrIndices(nnz);
+    Rcpp::NumericVector arrData(nnz);
+    int *i = arrIndices.begin();
+    double *x = arrData.begin();
+    std::vector<std::size_t> next(colPtr.begin(), colPtr.end() - 1);
+    for(com::bioturing::MtxChunk &chunk : chunks) {
+        for(std::size_t k = 0; k < chunk.rows.size(); k++) {
+            std::size_t pos = next[chunk.cols[k]]++;
+            i[pos] = chunk.rows[k];
+            x[pos] = pattern ? 1 : chunk.values[k];
+        }
+        std::vector<uint32_t>().swap(chunk.rows);
+        std::vector<uint32_t>().swap(chunk.cols);
+        std::vector<double>().swap(chunk.values);
+    }
+
+    std::size_t n_unique = com::bioturing::CanonicalizeCSC(colPtr, i, x, n_cols);
+    if(n_unique != nnz) {
+        arrIndices = Rcpp::IntegerVector(arrIndices.begin(), arrIndices.begin() + n_unique);
+        arrData = Rcpp::NumericVector(arrData.begin(), arrData.begin() + n_unique);
+    }
+    Rcpp::IntegerVector arrIndptr(colPtr.begin(), colPtr.end());
+
+    std::vector<std::string> arrBarcode;
+    if(com::bioturing::ReadTextLines(barcodePath, arrBarcode) == false || arrBarcode.size() != n_cols) {
+        std::stringstream ostr;
+        ostr << "Barcode file does not match the matrix columns :" << barcodePath;
+        Rcpp::stop(ostr.str());
+    }
+
+    if(stripSuffix == true) {
+        bool allSuffix = arrBarcode.size() > 0;
+        for(const std::string &barcode : arrBarcode) {
+            if(barcode.size() < 2 || barcode.compare(barcode.size() - 2, 2, "-1") != 0) {
+                allSuffix = false;
+                break;
+            }
+        }
+        if(allSuffix == true) {
+            for(std::string &barcode : arrBarcode) {
+                barcode.resize(barcode.size() - 2);
+            }
+        }
+    }
+
+    std::vector<std::string> arrFeature;
+    if(com::bioturing::ReadTextLines(featurePath, arrFeature) == false || arrFeature.size() != n_rows) {
+        std::stringstream ostr;
+        ostr << "Feature file does not match the matrix rows :" << featurePath;
+        Rcpp::stop(ostr.str());
+    }
+
+    for(std::string &feature : arrFeature) {
+        std::size_t start = 0;
+        for(int field = 1; field < featureColumn; field++) {
+            std::size_t tab = feature.find('\t', start);
+            if(tab == std::string::npos) {
+                break;
+            }
+            start = tab + 1;
+        }
+        std::size_t stop = feature.find('\t', start);
+        feature = feature.substr(start, (stop == std::string::npos) ? std::string::npos : stop - start);
+    }
+
+    if(uniqueFeatures == true) {
+        MakeUnique(arrFeature, ".");
+    }
+
+    std::string klass = "dgCMatrix";
+    Rcpp::S4 mat(klass);
+    mat.slot("i") = arrIndices;
+    mat.slot("p") = arrIndptr;
+    mat.slot("x") = arrData;
+    mat.slot("Dim") = Rcpp::IntegerVector::create(n_rows, n_cols);
+    mat.slot("Dimnames") = Rcpp::List::create(arrFeature, arrBarcode);
+    return mat;
+}
+
+//' ReadDelimSparse
+//'
+//' Stream a delimited text table (plain or gzip) of rows x cells into a dgCMatrix, keeping only nonzeros
+//'
+//' @param matPath Path to the table. The first field of each line is the row name
+//' @param sep Field separator. Default is ","
+//' @param header Whether the first line holds the column names. It may omit the row name column. Default is TRUE
+//' @export
+// [[Rcpp::export]]
+Rcpp::S4 ReadDelimSparse(const std::string &matPath, const std::string &sep = ",", const bool &header = true) {
+    if(sep.size() != 1) {
+        Rcpp::stop("Separator must be a single character");
+    }
+
+    // 64MB of text per block, parsed as ~1MB line-aligned chunks
+    const std::size_t blockSize = 1 << 26;
+    com::bioturing::TextBlockReader oTextBlockReader(matPath, blockSize);
+    if(oTextBlockReader.Open() == false) {
+        std::stringstream ostr;
+        ostr << "Can not open file :" << matPath;
+        Rcpp::stop(ostr.str());
+    }
+
+    std::string block;
+    if(oTextBlockReader.NextBlock(block) == false) {
+        std::stringstream ostr;
+        ostr << "Empty file :" << matPath;
+        Rcpp::stop(ostr.str());
+    }
+
+    // Column count comes from the first data line; a header one field shorter lacks the row name cell
+    std::size_t firstEnd = block.find('\n');
+    firstEnd = (firstEnd == std::string::npos) ? block.size() : firstEnd + 1;
+    std::size_t secondEnd = block.find('\n', firstEnd);
+    secondEnd = (secondEnd == std::string::npos) ? block.size() : secondEnd + 1;
+
+    std::vector<std::string> firstFields, dataFields;
+    com::bioturing::SplitFields(block.substr(0, firstEnd - ((firstEnd > 0 && block[firstEnd - 1] == '\n') ? 1 : 0)), sep[0], firstFields);
+    std::size_t dataStart = 0;
+    std::vector<std::string> colNames;
+    if(header == true) {
+        std::string secondLine = block.substr(firstEnd, secondEnd - firstEnd);
+        if(secondLine.size() > 0 && secondLine[secondLine.size() - 1] == '\n') {
+            secondLine.resize(secondLine.size() - 1);
+        }
+        com::bioturing::SplitFields(secondLine, sep[0], dataFields);
+        if(firstFields.size() == dataFields.size()) {
+            firstFields.erase(firstFields.begin());
+        }
+        colNames = firstFields;
+        dataStart = firstEnd;
+    } else {
+        dataFields = firstFields;
+        for(std::size_t c = 1; c < dataFields.size(); c++) {
+            colNames.push_back("c" + std::to_string(c));
+        }
+    }
+
+    std::size_t n_cols = (dataFields.size() > 0) ? dataFields.size() - 1 : 0;
+    if(colNames.size() != n_cols) {
+        std::stringstream ostr;
+        ostr << "Header has " << colNames.size() << " columns but data lines have " << n_cols << " in :" << matPath;
+        Rcpp::stop(ostr.str());
+    }
+
+    std::vector<std::string> arrRowNames;
+    std::vector<std::size_t> rowPtr(1, 0);
+    std::vector<uint32_t> rowCols;
+    std::vector<double> rowValues;
+    std::vector<const char*> bounds;
+    std::size_t lineOffset = (dataStart > 0) ? 1 : 0;
+    do {
+        const char *begin = block.data() + dataStart;
+        const char *end = block.data() + block.size();
+        dataStart = 0;
+        if(begin >= end) {
+            continue;
+        }
+
+        com::bioturing::SplitLineChunks(begin, end, std::max<std::size_t>(1, (end - begin) >> 20), bounds);
+        std::vector<com::bioturing::DelimChunk> chunks(bounds.size() - 1);
+        com::bioturing::DelimParseWorker delimParseWorker(bounds, sep[0], n_cols, chunks);
+        RcppParallel::parallelFor(0, chunks.size(), delimParseWorker, 1);
+
+        for(com::bioturing::DelimChunk &chunk : chunks) {
+            if(chunk.error.empty() == false) {
+                std::stringstream ostr;
+                ostr << "Line " << (lineOffset + chunk.n_lines + 1) << " has " << chunk.error << " in :" << matPath;
+                Rcpp::stop(ostr.str());
+            }
+            lineOffset += chunk.n_lines;
+            arrRowNames.insert(arrRowNames.end(), chunk.rowNames.begin(), chunk.rowNames.end());
+            for(const uint32_t &count : chunk.rowCounts) {
+                rowPtr.push_back(rowPtr.back() + count);
+            }
+            rowCols.insert(rowCols.end(), chunk.cols.begin(), chunk.cols.end());
+            rowValues.insert(rowValues.end(), chunk.values.begin(), chunk.values.end());
+        }
+    } while(oTextBlockReader.NextBlock(block) == true);
+
+    if(oTextBlockReader.IsFailed() == true) {
+        std::stringstream ostr;
+        ostr << "Can not decompress :" << matPath;
+        Rcpp::stop(ostr.str());
+    }
+    oTextBlockReader.Close();
+    std::string().swap(block);
+
+    // Rows were collected in order (CSR); a counting sort over columns gives a sorted CSC
+    std::size_t n_rows = arrRowNames.size();
+    std::size_t nnz = rowCols.size();
+    Rcpp::IntegerVector arrIndptr(n_cols + 1);
+    for(const uint32_t &col : rowCols) {
+        arrIndptr[col + 1]++;
+    }
+    for(std::size_t c = 0; c < n_cols; c++) {
+        arrIndptr[c + 1] += arrIndptr[c];
+    }
+
+    Rcpp::IntegerVector arrIndices(nnz);
+    Rcpp::NumericVector arrData(nnz);
+    std::vector<int> next(arrIndptr.begin(), arrIndptr.end() - 1);
+    for(std::size_t r = 0; r < n_rows; r++) {
+        for(std::size_t k = rowPtr[r]; k < rowPtr[r + 1]; k++) {
+            int pos = next[rowCols[k]]++;
+            arrIndices[pos] = r;
+            arrData[pos] = rowValues[k];
+        }
+    }
+
+    std::string klass = "dgCMatrix";
+    Rcpp::S4 mat(klass);
+    mat.slot("i") = arrIndices;
+    mat.slot("p") = arrIndptr;
+    mat.slot("x") = arrData;
+    mat.slot("Dim") = Rcpp::IntegerVector::create(n_rows, n_cols);
+    mat.slot("Dimnames") = Rcpp::List::create(arrRowNames, colNames);
+    return mat;
+}
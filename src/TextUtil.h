@@ -0,0 +1,592 @@
+#ifndef TEXT_UTIL
+#define TEXT_UTIL
+
+#define ARMA_USE_CXX11
+#define ARMA_NO_DEBUG
+
+#include <RcppArmadillo.h>
+#include <RcppParallel.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "CommonUtil.h"
+
+#if defined(WIN32) || defined(_WIN32)
+#define TEXT_UTIL_NO_MMAP
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace Rcpp;
+using namespace RcppParallel;
+
+namespace com {
+namespace bioturing {
+
+// Read-only view of a whole text file. Plain files are memory-mapped,
+// gzip files are inflated once into an owned buffer.
+class TextFile {
+public:
+    TextFile(const std::string &file_name_) {
+        file_name = std::string(file_name_.data(), file_name_.size());
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+
+    ~TextFile() {
+        Close();
+    }
+
+    bool Open() {
+        Close();
+        if(IsGzipFile(file_name) == true) {
+            return Inflate();
+        }
+
+#ifdef TEXT_UTIL_NO_MMAP
+        std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+        if(infile.good() == false) {
+            return false;
+        }
+
+        std::size_t size = infile.tellg();
+        inflated.resize(size);
+        infile.seekg(0);
+        infile.read(&inflated[0], size);
+        return true;
+#else
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        if(st.st_size == 0) {
+            ::close(fd);
+            return true;
+        }
+
+        void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(addr == MAP_FAILED) {
+            return false;
+        }
+
+        ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        mapped = static_cast<char*>(addr);
+        mapped_size = st.st_size;
+        return true;
+#endif
+    }
+
+    void Close() {
+#ifndef TEXT_UTIL_NO_MMAP
+        if(mapped != nullptr) {
+            ::munmap(mapped, mapped_size);
+        }
+#endif
+        mapped = nullptr;
+        mapped_size = 0;
+        std::string().swap(inflated);
+    }
+
+    const char *Begin() const {
+        return (mapped != nullptr) ? mapped : inflated.data();
+    }
+
+    const char *End() const {
+        return (mapped != nullptr) ? mapped + mapped_size : inflated.data() + inflated.size();
+    }
+
+    static bool IsGzipFile(const std::string &file_path) {
+        std::ifstream infile(file_path, std::ios::binary);
+        unsigned char magic[2] = {0, 0};
+        infile.read(reinterpret_cast<char*>(magic), 2);
+        return (infile.gcount() == 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b);
+    }
+
+private:
+    bool Inflate() {
+        gzFile gz = gzopen(file_name.c_str(), "rb");
+        if(gz == nullptr) {
+            return false;
+        }
+
+        gzbuffer(gz, 1 << 20);
+        const std::size_t blockSize = 1 << 22;
+        std::size_t used = 0;
+        int bytes = 0;
+        do {
+            inflated.resize(used + blockSize);
+            bytes = gzread(gz, &inflated[used], blockSize);
+            if(bytes > 0) {
+                used += bytes;
+            }
+        } while(bytes > 0);
+
+        inflated.resize(used);
+        int status = gzclose(gz);
+        return (bytes == 0) && (status == Z_OK);
+    }
+
+    std::string file_name;
+    char *mapped;
+    std::size_t mapped_size;
+    std::string inflated;
+};
+
+inline const char *SkipBlank(const char *p, const char *end) {
+    while(p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
+inline const char *NextLine(const char *p, const char *end) {
+    const char *eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return (eol == nullptr) ? end : eol + 1;
+}
+
+// Parse an unsigned integer, p is left on the first non-digit
+inline bool ParseUnsigned(const char *&p, const char *end, uint64_t &value) {
+    const char *start = p;
+    value = 0;
+    while(p < end && (unsigned)(*p - '0') < 10) {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return p != start;
+}
+
+// Decimal/scientific float parser. Mantissas below 2^53 with a decimal
+// exponent within +/-22 are exact; anything else falls back to strtod.
+inline bool ParseDouble(const char *&p, const char *end, double &value) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *start = p;
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while(p < end && (unsigned)(*p - '0') < 10) {
+        mantissa = mantissa * 10 + (*p - '0');
+        ++digits;
+        ++p;
+    }
+    if(p < end && *p == '.') {
+        ++p;
+        while(p < end && (unsigned)(*p - '0') < 10) {
+            mantissa = mantissa * 10 + (*p - '0');
+            ++digits;
+            --exponent;
+            ++p;
+        }
+    }
+    if(digits == 0) {
+        // NA, NaN, Inf and friends
+        char *stop = nullptr;
+        std::string token(start, std::find_if(start, end, [](char c) { return c == ',' || c == '\t' || c == ' ' || c == '\n' || c == '\r'; }));
+        value = std::strtod(token.c_str(), &stop);
+        p = start + (stop - token.c_str());
+        return p != start;
+    }
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool expNegative = false;
+        if(q < end && (*q == '-' || *q == '+')) {
+            expNegative = (*q == '-');
+            ++q;
+        }
+        uint64_t expValue = 0;
+        if(ParseUnsigned(q, end, expValue) == true) {
+            exponent += expNegative ? -(int)expValue : (int)expValue;
+            p = q;
+        }
+    }
+
+    if(digits > 19 || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+        std::string token(start, p);
+        value = std::strtod(token.c_str(), nullptr);
+        return true;
+    }
+
+    value = (double)mantissa;
+    value = (exponent < 0) ? value / pow10[-exponent] : value * pow10[exponent];
+    if(negative == true) {
+        value = -value;
+    }
+    return true;
+}
+
+// Split [begin, end) into about nChunks ranges that start and end on line boundaries
+inline void SplitLineChunks(const char *begin, const char *end, const std::size_t &nChunks, std::vector<const char*> &bounds) {
+    bounds.clear();
+    bounds.push_back(begin);
+    std::size_t size = end - begin;
+    for(std::size_t c = 1; c < nChunks; c++) {
+        const char *p = begin + size / nChunks * c;
+        if(p <= bounds.back()) {
+            continue;
+        }
+        p = NextLine(p, end);
+        if(p < end && p > bounds.back()) {
+            bounds.push_back(p);
+        }
+    }
+    bounds.push_back(end);
+}
+
+// Read all lines of a text file, dropping "\r" and a trailing empty line
+inline bool ReadTextLines(const std::string &file_path, std::vector<std::string> &lines) {
+    TextFile oTextFile(file_path);
+    if(oTextFile.Open() == false) {
+        return false;
+    }
+
+    lines.clear();
+    const char *p = oTextFile.Begin();
+    const char *end = oTextFile.End();
+    while(p < end) {
+        const char *next = NextLine(p, end);
+        const char *eol = next;
+        if(eol > p && *(eol - 1) == '\n') {
+            --eol;
+        }
+        if(eol > p && *(eol - 1) == '\r') {
+            --eol;
+        }
+        lines.emplace_back(p, eol);
+        p = next;
+    }
+    return true;
+}
+
+// Triplets parsed from one chunk of a Matrix Market body
+struct MtxChunk {
+    std::vector<uint32_t> rows;
+    std::vector<uint32_t> cols;
+    std::vector<double> values;
+    bool failed;
+};
+
+struct MtxParseWorker : public RcppParallel::Worker
+{
+    const std::vector<const char*> &bounds;
+    const bool pattern;
+    std::vector<MtxChunk> &chunks;
+
+    MtxParseWorker(const std::vector<const char*> &bounds, const bool &pattern, std::vector<MtxChunk> &chunks)
+        : bounds(bounds), pattern(pattern), chunks(chunks) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t c = begin; c < end; c++) {
+            MtxChunk &chunk = chunks[c];
+            chunk.failed = false;
+            const char *p = bounds[c];
+            const char *stop = bounds[c + 1];
+            std::size_t estimate = (stop - p) / 12;
+            chunk.rows.reserve(estimate);
+            chunk.cols.reserve(estimate);
+            chunk.values.reserve(pattern ? 0 : estimate);
+
+            while(p < stop) {
+                p = SkipBlank(p, stop);
+                if(p >= stop || *p == '\n' || *p == '\r' || *p == '%') {
+                    p = NextLine(p, stop);
+                    continue;
+                }
+
+                uint64_t row = 0, col = 0;
+                double value = 1;
+                bool ok = ParseUnsigned(p, stop, row);
+                p = SkipBlank(p, stop);
+                ok = ok && ParseUnsigned(p, stop, col);
+                if(pattern == false) {
+                    p = SkipBlank(p, stop);
+                    ok = ok && ParseDouble(p, stop, value);
+                }
+                if(ok == false || row == 0 || col == 0) {
+                    chunk.failed = true;
+                    return;
+                }
+
+                chunk.rows.push_back(row - 1);
+                chunk.cols.push_back(col - 1);
+                if(pattern == false) {
+                    chunk.values.push_back(value);
+                }
+                p = NextLine(p, stop);
+            }
+        }
+    }
+};
+
+// Streams a plain or gzip text file (gzread is transparent for plain files)
+// as blocks of whole lines, so only one block is resident at a time.
+class TextBlockReader {
+public:
+    TextBlockReader(const std::string &file_name_, const std::size_t &block_size_) {
+        file_name = std::string(file_name_.data(), file_name_.size());
+        block_size = block_size_;
+        gz = nullptr;
+        eof = false;
+        failed = false;
+    }
+
+    ~TextBlockReader() {
+        Close();
+    }
+
+    bool Open() {
+        Close();
+        gz = gzopen(file_name.c_str(), "rb");
+        if(gz == nullptr) {
+            return false;
+        }
+        gzbuffer(gz, 1 << 20);
+        eof = false;
+        failed = false;
+        return true;
+    }
+
+    void Close() {
+        if(gz != nullptr) {
+            gzclose(gz);
+        }
+        gz = nullptr;
+        std::string().swap(carry);
+    }
+
+    bool IsFailed() const {
+        return failed;
+    }
+
+    // Fill block with the next whole lines; false once the file is exhausted
+    bool NextBlock(std::string &block) {
+        block.swap(carry);
+        carry.clear();
+        while(eof == false) {
+            std::size_t used = block.size();
+            block.resize(used + block_size);
+            int bytes = gzread(gz, &block[used], block_size);
+            if(bytes < 0) {
+                failed = true;
+                block.clear();
+                return false;
+            }
+
+            block.resize(used + bytes);
+            if(bytes == 0 || gzeof(gz)) {
+                eof = true;
+                break;
+            }
+
+            std::size_t lastLine = block.rfind('\n');
+            if(lastLine != std::string::npos) {
+                carry.assign(block, lastLine + 1, std::string::npos);
+                block.resize(lastLine + 1);
+                break;
+            }
+        }
+        return block.empty() == false;
+    }
+
+private:
+    std::string file_name;
+    std::size_t block_size;
+    gzFile gz;
+    bool eof;
+    bool failed;
+    std::string carry;
+};
+
+// Strip "\r" and surrounding double quotes from a field
+inline std::string TrimField(const char *begin, const char *end) {
+    if(end > begin && *(end - 1) == '\r') {
+        --end;
+    }
+    if(end - begin >= 2 && *begin == '"' && *(end - 1) == '"') {
+        ++begin;
+        --end;
+    }
+    return std::string(begin, end);
+}
+
+inline void SplitFields(const std::string &line, const char &sep, std::vector<std::string> &fields) {
+    fields.clear();
+    const char *p = line.data();
+    const char *end = p + line.size();
+    while(true) {
+        const char *next = static_cast<const char*>(std::memchr(p, sep, end - p));
+        if(next == nullptr) {
+            fields.push_back(TrimField(p, end));
+            break;
+        }
+        fields.push_back(TrimField(p, next));
+        p = next + 1;
+    }
+}
+
+// Nonzeros of consecutive table rows parsed from one chunk of text
+struct DelimChunk {
+    std::vector<std::string> rowNames;
+    std::vector<uint32_t> rowCounts;
+    std::vector<uint32_t> cols;
+    std::vector<double> values;
+    std::size_t n_lines;    // lines of the chunk before the failed one, blank lines included
+    std::string error;      // empty unless a line failed to parse
+};
+
+// Parses "rowname<sep>v1<sep>v2..." lines; only nonzero values are kept
+struct DelimParseWorker : public RcppParallel::Worker
+{
+    const std::vector<const char*> &bounds;
+    const char sep;
+    const std::size_t n_cols;
+    std::vector<DelimChunk> &chunks;
+
+    DelimParseWorker(const std::vector<const char*> &bounds, const char &sep, const std::size_t &n_cols, std::vector<DelimChunk> &chunks)
+        : bounds(bounds), sep(sep), n_cols(n_cols), chunks(chunks) {}
+
+    void operator()(std::size_t begin, std::size_t end) {
+        for(std::size_t c = begin; c < end; c++) {
+            DelimChunk &chunk = chunks[c];
+            chunk.n_lines = 0;
+            chunk.error.clear();
+            const char *p = bounds[c];
+            const char *stop = bounds[c + 1];
+
+            while(p < stop) {
+                const char *next = NextLine(p, stop);
+                const char *eol = next;
+                if(eol > p && *(eol - 1) == '\n') {
+                    --eol;
+                }
+                if(eol > p && *(eol - 1) == '\r') {
+                    --eol;
+                }
+                if(eol == p) {
+                    chunk.n_lines++;
+                    p = next;
+                    continue;
+                }
+
+                const char *field = static_cast<const char*>(std::memchr(p, sep, eol - p));
+                if(field == nullptr) {
+                    field = eol;
+                }
+                chunk.rowNames.push_back(TrimField(p, field));
+
+                uint32_t count = 0;
+                std::size_t col = 0;
+                while(field < eol) {
+                    const char *fs = field + 1;
+                    const char *fe = static_cast<const char*>(std::memchr(fs, sep, eol - fs));
+                    if(fe == nullptr) {
+                        fe = eol;
+                    }
+                    if(col >= n_cols) {
+                        chunk.error = "more fields than the " + std::to_string(n_cols) + " columns";
+                        return;
+                    }
+
+                    // Dense count tables are mostly "0"; skip them before calling the parser
+                    if(fe > fs && !(fe - fs == 1 && *fs == '0')) {
+                        double value = 0;
+                        const char *q = fs;
+                        if(fe - fs == 2 && fs[0] == 'N' && fs[1] == 'A') {
+                            value = NA_REAL;
+                        } else if(ParseDouble(q, fe, value) == false || q != fe) {
+                            chunk.error = "invalid value \"" + std::string(fs, fe) + "\"";
+                            return;
+                        }
+                        if(value != 0) {
+                            chunk.cols.push_back(col);
+                            chunk.values.push_back(value);
+                            count++;
+                        }
+                    }
+                    col++;
+                    field = fe;
+                }
+                if(col < n_cols) {
+                    chunk.error = "fewer fields than the " + std::to_string(n_cols) + " columns";
+                    return;
+                }
+                chunk.rowCounts.push_back(count);
+                chunk.n_lines++;
+                p = next;
+            }
+        }
+    }
+};
+
+// Sort each column of a CSC by row and sum duplicated entries in place; returns the new nnz
+inline std::size_t CanonicalizeCSC(std::vector<std::size_t> &p, int *i, double *x, const std::size_t &n_cols) {
+    std::size_t out = 0;
+    std::vector<std::pair<int, double>> column;
+    for(std::size_t c = 0; c < n_cols; c++) {
+        std::size_t start = p[c];
+        std::size_t end = p[c + 1];
+        bool sorted = true;
+        for(std::size_t k = start + 1; k < end && sorted; k++) {
+            sorted = i[k - 1] < i[k];
+        }
+
+        p[c] = out;
+        if(sorted == false) {
+            column.clear();
+            for(std::size_t k = start; k < end; k++) {
+                column.push_back(std::make_pair(i[k], x[k]));
+            }
+            std::stable_sort(column.begin(), column.end(),
+                [](const std::pair<int, double> &a, const std::pair<int, double> &b) { return a.first < b.first; });
+            for(std::size_t k = 0; k < column.size(); k++) {
+                if(k > 0 && column[k].first == column[k - 1].first) {
+                    x[out - 1] += column[k].second;
+                    continue;
+                }
+                i[out] = column[k].first;
+                x[out] = column[k].second;
+                ++out;
+            }
+        } else {
+            for(std::size_t k = start; k < end; k++) {
+                i[out] = i[k];
+                x[out] = x[k];
+                ++out;
+            }
+        }
+    }
+    p[n_cols] = out;
+    return out;
+}
+
+} // namespace bioturing
+} // namespace com
+
+Rcpp::S4 ReadMtx10X(const std::string &matrixPath, const std::string &barcodePath, const std::string &featurePath,
+                    const int &featureColumn, const bool &stripSuffix, const bool &uniqueFeatures);
+Rcpp::S4 ReadDelimSparse(const std::string &matPath, const std::string &sep, const bool &header);
+
+#endif //TEXT_UTIL